@@ -7,9 +7,6 @@ cd::IsoReader::IsoReader()
 
 cd::IsoReader::~IsoReader()
 {
-    if (filePtr != NULL)
-		fclose(filePtr);
-
 }
 
 
@@ -17,16 +14,14 @@ bool cd::IsoReader::Open(const fs::path& fileName)
 {
 	Close();
 
-    filePtr = OpenFile(fileName, "rb");
+    source = OpenSectorSource(fileName);
 
-    if (filePtr == NULL)
+    if (source == nullptr)
 		return(false);
 
-	fseek(filePtr, 0, SEEK_END);
-	totalSectors = ftell(filePtr) / CD_SECTOR_SIZE;
-	fseek(filePtr, 0, SEEK_SET);
+	totalSectors = source->GetSize() / CD_SECTOR_SIZE;
 
-    if (fread(sectorBuff, CD_SECTOR_SIZE, 1, filePtr) != 1) {
+    if (!ReadSector(0)) {
 		Close();
 		return false;
 	}
@@ -137,6 +132,26 @@ size_t cd::IsoReader::ReadBytesDA(void* ptr, size_t bytes, bool singleSector)
 
 }
 
+int64_t cd::IsoReader::CopyBytesDA(FILE* outFile, size_t bytes)
+{
+	if (currentSector >= totalSectors || source == nullptr) {
+		return 0;
+	}
+
+	const int64_t bytesCopied = source->CopyBytes(GetPos(), bytes, outFile);
+	if (bytesCopied <= 0) {
+		return bytesCopied;
+	}
+
+	// Continue after the copied bytes, like ReadBytesDA would have
+	const size_t pos = GetPos() + bytesCopied;
+	currentSector = pos / CD_SECTOR_SIZE;
+	currentByte = pos % CD_SECTOR_SIZE;
+	ReadSector(currentSector);
+
+	return bytesCopied;
+}
+
 size_t cd::IsoReader::SkipBytes(size_t bytes, bool singleSector) {
 
 	if (currentSector >= totalSectors) {
@@ -166,11 +181,10 @@ size_t cd::IsoReader::SkipBytes(size_t bytes, bool singleSector) {
 
 bool cd::IsoReader::SeekToSector(int sector) {
 
-	if (sector >= totalSectors || filePtr == nullptr)
+	if (sector >= totalSectors || source == nullptr)
 		return false;
 
-    fseek(filePtr, CD_SECTOR_SIZE*sector, SEEK_SET);
-	if (fread(sectorBuff, CD_SECTOR_SIZE, 1, filePtr) != 1) {
+	if (!ReadSector(sector)) {
 		return false;
 	}
 
@@ -180,7 +194,7 @@ bool cd::IsoReader::SeekToSector(int sector) {
 	sectorM2F1 = (cd::SECTOR_M2F1*)sectorBuff;
     sectorM2F2 = (cd::SECTOR_M2F2*)sectorBuff;
 
-	return !ferror(filePtr);
+	return true;
 
 }
 
@@ -188,8 +202,7 @@ size_t cd::IsoReader::SeekToByte(size_t offs) {
 
 	int sector = (offs/CD_SECTOR_SIZE);
 
-	fseek(filePtr, CD_SECTOR_SIZE*sector, SEEK_SET);
-    if (fread(sectorBuff, CD_SECTOR_SIZE, 1, filePtr) != 1) {
+    if (!ReadSector(sector)) {
 		return 0;
 	}
 
@@ -210,10 +223,7 @@ size_t cd::IsoReader::GetPos() const
 
 void cd::IsoReader::Close() {
 
-    if (filePtr != NULL) {
-		fclose(filePtr);
-		filePtr = NULL;
-    }
+	source.reset();
 
 }
 
@@ -222,7 +232,7 @@ bool cd::IsoReader::PrepareNextSector()
 	currentByte = 0;
 	currentSector++;
 
-    if (fread(sectorBuff, CD_SECTOR_SIZE, 1, filePtr) != 1)
+    if (!ReadSector(currentSector))
 	{
 		return false;
     }
@@ -232,6 +242,11 @@ bool cd::IsoReader::PrepareNextSector()
 	return true;
 }
 
+bool cd::IsoReader::ReadSector(int sector)
+{
+	return source != nullptr && sector >= 0 && source->ReadSector(sector, sectorBuff);
+}
+
 
 void cd::IsoPathTable::FreePathTable()
 {
@@ -298,12 +313,51 @@ fs::path cd::IsoPathTable::GetFullDirPath(int dirEntry) const
 	return path;
 }
 
+EntryType GetXAEntryType(unsigned short xa_attr)
+{
+	// we try to guess the file type. Usually, the xa_attr should tell this, but there are many games
+	// that do not follow the standard, and sometime leave some or all the attributes unset.
+	if (xa_attr & 0x40)
+	{
+		// if the cddata flag is set, we assume this is the case
+		return EntryType::EntryDA;
+	}
+	if (xa_attr & 0x80)
+	{
+		// if the directory flag is set, we assume this is the case
+		return EntryType::EntryDir;
+	}
+	if ( (xa_attr & 0x08) && !(xa_attr & 0x10) )
+	{
+		// if the mode 2 form 1 flag is set, and form 2 is not, we assume this is a regular file.
+		return EntryType::EntryFile;
+	}
+	if ( (xa_attr & 0x10) && !(xa_attr & 0x08) )
+	{
+		// if the mode 2 form 2 flag is set, and form 1 is not, we assume this is a pure audio xa file.
+		return EntryType::EntryXA;
+	}
+
+	// here all flags are set to the same value. From what I could see until now, when both flags are the same,
+	// this is interpreted in the following two ways, which both lead us to choose str/xa type.
+	// 1. Both values are 1, which means there is an indication by the mode 2 form 2 flag that the data is not
+	//    regular mode 2 form 1 data (i.e., it is either mixed or just xa).
+	// 2. Both values are 0. The fact that the mode 2 form 2 flag is 0 simply means that the data might not
+	//    be *pure* mode 2 form 2 data (i.e., xa), so, we do not conclude it is regular mode 2 form 1 data.
+	//    We thus give priority to the mode 2 form 1 flag, which is also zero,
+	//	  and conclude that the data is not regular mode 2 form 1 data, and thus can be either mode 2 form 2 or mixed.
+
+	// Remark: Some games (Legend of Mana), use a very strange STR+XA format that is stored in plain mode 2 form 1.
+	// This is properly marked in the xa_attr, and there is nothing wrong in extracting them as data.
+	return EntryType::EntryXA;
+}
+
 cd::IsoDirEntries::IsoDirEntries(ListView<Entry> view)
 	: dirEntryList(std::move(view))
 {
 }
 
-void cd::IsoDirEntries::ReadDirEntries(cd::IsoReader* reader, int lba, int sectors)
+void cd::IsoDirEntries::ReadDirEntries(cd::IsoReader* reader, int lba, int sectors, bool newType)
 {
 	short order = 0;
 	size_t numEntries = 0; // Used to skip the first two entries, . and ..
@@ -321,7 +375,7 @@ void cd::IsoDirEntries::ReadDirEntries(cd::IsoReader* reader, int lba, int secto
 
 			if (numEntries++ >= 2)
 			{
-				if (*global::new_type)
+				if (newType)
 				{
 					entry->order = order++;
 				}
@@ -337,7 +391,7 @@ void cd::IsoDirEntries::ReadDirEntries(cd::IsoReader* reader, int lba, int secto
 		});
 
 	// Delete orders if all are correct to avoid populate the xml with unnecessary strings
-	if (*global::new_type)
+	if (newType)
 	{
 		auto& entriesInDir = dirEntryList.GetView();
 		for (int index = 0; index < entriesInDir.size(); index++)
@@ -2,6 +2,7 @@
 #define _CDREADER_H
 
 #include "common.h"
+#include "sectorsource.h"
 #include "xa.h"
 #include "listview.h"
 
@@ -11,8 +12,8 @@ namespace cd {
     // data such as Sync, address and mode codes as well as the EDC/ECC data.
     class IsoReader {
 
-        // File pointer to opened ISO file
-        FILE*		filePtr = nullptr;
+        // Sectors of the opened image, which may be stored compressed
+        std::unique_ptr<SectorSource> source;
         // Sector buffer size
         unsigned char sectorBuff[CD_SECTOR_SIZE] {};
         // Mode 2 Form 1 sector struct for simplified reading of sectors (usually points to sectorBuff[])
@@ -44,6 +45,11 @@ namespace cd {
         // Read whole(2352) sector in bytes (supports sequential reading)
         size_t ReadBytesDA(void* ptr, size_t bytes, bool singleSector = false);
 
+        // Copy whole(2352) sector bytes straight into a file where the image allows it, without
+        // reading them in (returns bytes copied, the rest must be read with ReadBytesDA, or -1 if
+        // the output file was left at an unknown position)
+        int64_t CopyBytesDA(FILE* outFile, size_t bytes);
+
         // Skip bytes in data sectors (supports sequential skipping)
         size_t SkipBytes(size_t bytes, bool singleSector = false);
 
@@ -61,6 +67,7 @@ namespace cd {
 
     private:
         bool PrepareNextSector();
+        bool ReadSector(int sector);
 
     };
 
@@ -100,7 +107,7 @@ namespace cd {
         ListView<Entry> dirEntryList;
 
         IsoDirEntries(ListView<Entry> view);
-        void ReadDirEntries(cd::IsoReader* reader, int lba, int sectors);
+        void ReadDirEntries(cd::IsoReader* reader, int lba, int sectors, bool newType);
         void ReadRootDir(cd::IsoReader* reader, int lba);
 
     private:
@@ -108,5 +115,5 @@ namespace cd {
     };
 
 }
-extern EntryType GetXAEntryType(unsigned short xa_attr);
+EntryType GetXAEntryType(unsigned short xa_attr);
 #endif // _CDREADER_H
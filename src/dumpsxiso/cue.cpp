@@ -1,22 +1,33 @@
 #include "cue.h"
 #include "platform.h"
+#include "report.h"
+#include "sectorsource.h"
 #include <fstream>
 
-bool multiBinSeeker(const unsigned int sector, const cd::IsoDirEntries::Entry &entry, cd::IsoReader &reader, const CueFile &cueFile)
+int GetCueTrackIndex(const cd::IsoDirEntries::Entry &entry, const CueFile &cueFile)
 {
 	int trackIndex = (entry.trackid.empty() ? std::stoi(entry.identifier.substr(6, 2)) : std::stoi(entry.trackid)) - 1;
 	if (trackIndex < 1 || trackIndex >= static_cast<int>(cueFile.tracks.size()))
 	{
-		printf("Error: Invalid cue TRACK index \"%02d\" for AUDIO file.\n", trackIndex + 1);
-		exit(EXIT_FAILURE);
+		report::Error("", "Invalid cue TRACK index \"%02d\" for AUDIO file.", trackIndex + 1);
+		return -1;
+	}
+	return trackIndex;
+}
+
+bool multiBinSeeker(const unsigned int sector, int trackIndex, cd::IsoReader &reader, const CueFile &cueFile)
+{
+	if (trackIndex < 1 || trackIndex >= static_cast<int>(cueFile.tracks.size()))
+	{
+		return false;
 	}
 	reader.Open(cueFile.tracks[trackIndex].filePath);
 	return reader.SeekToSector(sector - cueFile.tracks[trackIndex - 1].endSector);
 }
 
-CueFile parseCueFile(fs::path& inputFile)
+bool parseCueFile(fs::path& inputFile, CueFile& cueFile)
 {
-	CueFile cueFile;
+	cueFile = CueFile();
 	std::string line, fileType;
 	fs::ifstream file(inputFile);
 	fs::path filePath = inputFile;
@@ -41,17 +52,18 @@ CueFile parseCueFile(fs::path& inputFile)
 			size_t lastQuote = line.rfind("\"");
 			std::string fileName = line.substr(firstQuote + 1, lastQuote - firstQuote - 1);
 			filePath.replace_filename(fileName);
-			if (int64_t fileSize = GetSize(filePath); fileSize < 0)
+			// The BIN file may also be stored compressed
+			if (int64_t fileSize = cd::GetImageSize(filePath); fileSize < 0)
 			{
-				printf("Error: Failed to get the file size for \"%s\"\n", fileName.c_str());
-				exit(EXIT_FAILURE);
+				report::Error("", "Failed to get the file size for \"%s\"", fileName.c_str());
+				return false;
 			}
 			else
 			{
 				if (fileSize % CD_SECTOR_SIZE != 0)
 				{
-					printf("Error: File size for \"%s\" is not a multiple of 2352\n", fileName.c_str());
-					exit(EXIT_FAILURE);
+					report::Error("", "File size for \"%s\" is not a multiple of 2352", fileName.c_str());
+					return false;
 				}
 				cueFile.totalSectors += fileSize / CD_SECTOR_SIZE;
 			}
@@ -101,8 +113,8 @@ CueFile parseCueFile(fs::path& inputFile)
 			pauseStartSector = TimecodeToSectors(startTime);
 			if (pauseStartSector < 0)
 			{
-				printf("Error: Invalid cue file timecode \"%s\" on line %d\n", startTime.c_str(), lineNumber);
-				exit(EXIT_FAILURE);
+				report::Error("", "Invalid cue file timecode \"%s\" on line %d", startTime.c_str(), lineNumber);
+				return false;
 			}
 
 			if (pauseStartSector)
@@ -118,8 +130,8 @@ CueFile parseCueFile(fs::path& inputFile)
 			int startSector = TimecodeToSectors(startTime);
 			if (startSector < 0)
 			{
-				printf("Error: Invalid cue file timecode \"%s\" on line %d\n", startTime.c_str(), lineNumber);
-				exit(EXIT_FAILURE);
+				report::Error("", "Invalid cue file timecode \"%s\" on line %d", startTime.c_str(), lineNumber);
+				return false;
 			}
 
 			if (!pauseStartSector)
@@ -134,8 +146,8 @@ CueFile parseCueFile(fs::path& inputFile)
 		}
 		else
 		{
-			printf("Error: Unsupported cue file syntax on line %d\n", lineNumber);
-			exit(EXIT_FAILURE);
+			report::Error("", "Unsupported cue file syntax on line %d", lineNumber);
+			return false;
 		}
 
 		lineNumber++;
@@ -148,5 +160,5 @@ CueFile parseCueFile(fs::path& inputFile)
 		lastTrack.endSector = lastTrack.startSector + lastTrack.sizeInSectors;
 	}
 
-	return cueFile;
+	return true;
 }
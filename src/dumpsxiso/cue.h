@@ -21,5 +21,8 @@ struct CueFile
 	std::vector<TrackInfo> tracks;
 };
 
-CueFile parseCueFile(fs::path& inputFile);
-bool multiBinSeeker(const unsigned int sector, const cd::IsoDirEntries::Entry &entry, cd::IsoReader &reader, const CueFile &cueFile);
+// Reports the problem and returns false if the cue file or one of its BIN files is invalid
+bool parseCueFile(fs::path& inputFile, CueFile& cueFile);
+// Returns the index of the cue track holding an audio entry, or reports the problem and returns -1 if there is none
+int GetCueTrackIndex(const cd::IsoDirEntries::Entry &entry, const CueFile &cueFile);
+bool multiBinSeeker(const unsigned int sector, int trackIndex, cd::IsoReader &reader, const CueFile &cueFile);
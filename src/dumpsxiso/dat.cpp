@@ -0,0 +1,183 @@
+#include "dat.h"
+#include "mmappedfile.h"
+#include "platform.h"
+#include "sectorsource.h"
+#include <ThreadPool.h>
+#include <map>
+#include <optional>
+
+// Contents of an image file in memory, mapped if the file is stored plain and decoded otherwise
+class ImageData
+{
+public:
+	bool Open(const fs::path& path)
+	{
+		std::unique_ptr<cd::SectorSource> source = cd::OpenSectorSource(path);
+		if (source == nullptr)
+		{
+			return false;
+		}
+
+		m_size = source->GetSize();
+		if (m_size == 0)
+		{
+			return true;
+		}
+
+		if (const fs::path plainPath = source->GetPlainFilePath(); !plainPath.empty() && m_file.Open(plainPath))
+		{
+			m_view.emplace(m_file.GetView(0, static_cast<size_t>(m_size)));
+			m_data = static_cast<const unsigned char*>(m_view->GetBuffer());
+			if (m_data != nullptr)
+			{
+				return true;
+			}
+		}
+
+		// Compressed images, or files too large to be mapped at once, are decoded whole
+		m_decoded.resize(static_cast<size_t>(m_size / CD_SECTOR_SIZE) * CD_SECTOR_SIZE);
+		for (size_t offset = 0; offset < m_decoded.size(); offset += CD_SECTOR_SIZE)
+		{
+			if (!source->ReadSector(static_cast<unsigned int>(offset / CD_SECTOR_SIZE), m_decoded.data() + offset))
+			{
+				return false;
+			}
+		}
+		m_data = m_decoded.data();
+		m_size = m_decoded.size();
+		return true;
+	}
+
+	const unsigned char* GetData() const { return m_data; }
+	uint64_t GetSize() const { return m_size; }
+
+private:
+	MMappedFile m_file;
+	std::optional<MMappedFile::View> m_view;
+	std::vector<unsigned char> m_decoded;
+	const unsigned char* m_data = nullptr;
+	uint64_t m_size = 0;
+};
+
+static std::string GetTrackName(const fs::path& file, const std::string& number)
+{
+	return file.stem().string() + " (Track " + (number.size() > 1 && number[0] == '0' ? number.substr(1) : number) + ")" + file.extension().string();
+}
+
+std::vector<dat::Rom> dat::GetRoms(const fs::path& imagePath, const fs::path& cuePath, const CueFile& cueFile)
+{
+	std::vector<Rom> roms;
+	if (cueFile.tracks.empty())
+	{
+		roms.push_back({ imagePath.filename().string(), imagePath, 0, static_cast<uint64_t>(std::max<int64_t>(cd::GetImageSize(imagePath), 0)), {} });
+		return roms;
+	}
+
+	// A track starts where the previous one ends, tracks without a pregap end where the next one starts
+	const std::vector<TrackInfo>& tracks = cueFile.tracks;
+	std::vector<unsigned int> startSectors { 0 };
+	for (size_t i = 1; i < tracks.size(); i++)
+	{
+		startSectors.push_back(tracks[i - 1].endSector != 0 ? tracks[i - 1].endSector : tracks[i].startSector);
+	}
+	startSectors.push_back(cueFile.totalSectors);
+
+	for (size_t i = 0; i < tracks.size(); i++)
+	{
+		// Tracks sharing a file are named after it, like Redump sets name the files of split tracks
+		size_t first = i, last = i;
+		while (first > 0 && tracks[first - 1].filePath == tracks[i].filePath)
+		{
+			first--;
+		}
+		while (last + 1 < tracks.size() && tracks[last + 1].filePath == tracks[i].filePath)
+		{
+			last++;
+		}
+
+		Rom& rom = roms.emplace_back();
+		rom.name = first == last ? tracks[i].filePath.filename().string() : GetTrackName(tracks[i].filePath.filename(), tracks[i].number);
+		rom.file = tracks[i].filePath;
+		rom.offset = static_cast<uint64_t>(startSectors[i] - startSectors[first]) * CD_SECTOR_SIZE;
+		rom.size = static_cast<uint64_t>(startSectors[i + 1] - startSectors[i]) * CD_SECTOR_SIZE;
+	}
+
+	if (!cuePath.empty())
+	{
+		roms.push_back({ cuePath.filename().string(), cuePath, 0, static_cast<uint64_t>(std::max<int64_t>(GetSize(cuePath), 0)), {} });
+	}
+	return roms;
+}
+
+bool dat::HashImage(std::vector<Rom>& roms, std::vector<File>& files)
+{
+	// Image files are read once, however many tracks they hold
+	std::map<fs::path, ImageData> images;
+	for (const Rom& rom : roms)
+	{
+		if (auto [image, inserted] = images.try_emplace(rom.file); inserted && !image->second.Open(rom.file))
+		{
+			printf("ERROR: Cannot read \"%s\".\n", rom.file.lexically_normal().string().c_str());
+			return false;
+		}
+	}
+
+	progschj::ThreadPool threadPool(std::thread::hardware_concurrency());
+	std::vector<std::future<void>> jobs;
+
+	// The algorithms are independent, so each of them goes through a track on a thread of its own
+	for (Rom& rom : roms)
+	{
+		const ImageData& image = images.at(rom.file);
+		rom.offset = std::min(rom.offset, image.GetSize());
+		rom.size = std::min(rom.size, image.GetSize() - rom.offset);
+		rom.digests.size = rom.size;
+
+		const unsigned char* data = image.GetData() + rom.offset;
+		jobs.push_back(threadPool.enqueue([&rom, data]
+			{
+				hash::Crc32 crc32;
+				crc32.Update(data, rom.size);
+				rom.digests.crc32 = crc32.Finish();
+			}));
+		jobs.push_back(threadPool.enqueue([&rom, data]
+			{
+				hash::Md5 md5;
+				md5.Update(data, rom.size);
+				rom.digests.md5 = md5.Finish();
+			}));
+		jobs.push_back(threadPool.enqueue([&rom, data]
+			{
+				hash::Sha1 sha1;
+				sha1.Update(data, rom.size);
+				rom.digests.sha1 = sha1.Finish();
+			}));
+	}
+
+	// Files are much smaller, so each of them is hashed with all algorithms at once
+	const ImageData& dataTrack = images.at(roms.front().file);
+	const unsigned char* dataBegin = dataTrack.GetData() + roms.front().offset;
+	const unsigned char* dataEnd = dataBegin + roms.front().size;
+	for (File& file : files)
+	{
+		jobs.push_back(threadPool.enqueue([&file, dataBegin, dataEnd]
+			{
+				hash::Digester digester;
+				uint64_t remaining = file.size;
+				const unsigned char* sector = dataBegin + static_cast<uint64_t>(file.lba) * CD_SECTOR_SIZE;
+				for (; remaining > 0 && sector < dataEnd && dataEnd - sector >= CD_SECTOR_SIZE; sector += CD_SECTOR_SIZE)
+				{
+					const size_t size = static_cast<size_t>(std::min<uint64_t>(remaining, file.xa ? XA_DATA_SIZE : F1_DATA_SIZE));
+					digester.Update(sector + (file.xa ? 16 : 24), size);
+					remaining -= size;
+				}
+				file.digests = digester.Finish();
+			}));
+	}
+
+	for (auto& job : jobs)
+	{
+		job.get();
+	}
+	return true;
+}
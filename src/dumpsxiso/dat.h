@@ -0,0 +1,42 @@
+#pragma once
+
+#include "cue.h"
+#include "hash.h"
+
+// Hashes of a disc image as Redump DAT files list them: every track over its raw sectors, cut as the
+// cue sheet cuts them, along with the data of every file on the disc as dumpsxiso extracts it
+namespace dat
+{
+
+// A file of a Redump set, which may be a part of an image file holding several tracks
+struct Rom
+{
+	std::string name;		// Name of the file in a Redump set
+	fs::path file;			// File it is stored in
+	uint64_t offset = 0;	// Start in that file in bytes
+	uint64_t size = 0;
+	hash::Digests digests;
+};
+
+// A file on the disc
+struct File
+{
+	std::string name;		// Path on the disc, with backslashes
+	unsigned int lba = 0;
+	uint64_t size = 0;		// Bytes of extracted data
+	bool xa = false;		// Extracted 2336 bytes per sector, with subheaders
+	hash::Digests digests;
+};
+
+// Lists the tracks of an image and its cue sheet, or the image alone if there is no cue sheet.
+// Tracks take in their pregap, like the track files of Redump sets do.
+std::vector<Rom> GetRoms(const fs::path& imagePath, const fs::path& cuePath, const CueFile& cueFile);
+
+// Hashes all roms and files, reading every image file once. Plain files are memory mapped and
+// compressed ones decoded into memory, then each hash algorithm of each rom and the files are
+// spread over threads. Files are read from the first rom, which must be the data track.
+//
+// Returns: False if an image file cannot be read, after printing an error.
+bool HashImage(std::vector<Rom>& roms, std::vector<File>& files);
+
+}
@@ -1,6 +1,9 @@
 #include "platform.h"
 #include "xml.h"
+#include "manifest.h"
+#include "seeksim.h"
 #include "cue.h"
+#include "dat.h"
 #include <map>
 #include <format>
 
@@ -52,11 +55,19 @@ namespace param {
 	bool pathTable = false;
     bool outputSortedByDir = false;
 	EncoderAudioFormats encodingFormat = EAF_WAV;
+	bool list = false;
+	bool listJSON = false;
+	bool update = false;
+	std::vector<std::string> extractPaths;
+	std::optional<fs::path> simulateTraceFile;
+	seeksim::DriveModel driveModel;
+	std::optional<fs::path> hashFile;
 }
 
 namespace global
 {
 	CueFile cueFile;
+	fs::path cuePath;
 	std::optional<bool> new_type;
 }
 
@@ -207,11 +218,132 @@ void SaveLicense(const cd::ISO_LICENSE& license) {
     fclose(outFile);
 }
 
-void writePCMFile(FILE *outFile, cd::IsoReader& reader, const size_t cddaSize, const bool isInvalid)
+// A file being extracted. In --update mode an existing file is compared with the extracted data instead,
+// and only rewritten from the first difference on, so files which did not change are left untouched.
+class OutputFile
+{
+public:
+	bool Open(const fs::path& path)
+	{
+		m_path = path;
+		m_offset = 0;
+		m_comparing = param::update && GetSize(path) >= 0;
+		m_file = OpenScopedFile(path, m_comparing ? "rb" : "wb");
+		return m_file != nullptr;
+	}
+
+	void Write(const void* data, size_t size)
+	{
+		if (m_comparing && !Matches(data, size))
+		{
+			StartWriting();
+		}
+		if (!m_comparing)
+		{
+			fwrite(data, 1, size, m_file.get());
+		}
+		m_offset += size;
+	}
+
+	// Writes the contents of another file
+	void WriteFrom(const fs::path& path)
+	{
+		unique_file file = OpenScopedFile(path, "rb");
+		std::vector<unsigned char> buffer(64 * 1024);
+		size_t bytesRead;
+		while (file != nullptr && (bytesRead = fread(buffer.data(), 1, buffer.size(), file.get())) != 0)
+		{
+			Write(buffer.data(), bytesRead);
+		}
+	}
+
+	// Copies whole sectors from the reader without passing them through memory, where possible.
+	// Returns the bytes copied, the rest must be written as usual.
+	size_t CopyFrom(cd::IsoReader& reader, size_t bytes)
+	{
+		const int64_t bytesCopied = !m_comparing ? reader.CopyBytesDA(m_file.get(), bytes) : 0;
+		if (bytesCopied < 0)
+		{
+			printf("\nERROR: Cannot write file \"%s\"\n", m_path.filename().string().c_str());
+			exit(EXIT_FAILURE);
+		}
+		m_offset += bytesCopied;
+		return static_cast<size_t>(bytesCopied);
+	}
+
+	bool IsComparing() const
+	{
+		return m_comparing;
+	}
+
+	// Hands the file over to code which writes and closes it on its own
+	FILE* Release()
+	{
+		return m_file.release();
+	}
+
+	// Returns false if the file was left as it was
+	bool Close()
+	{
+		m_file.reset();
+
+		// Data left past the end of the extracted file is cut off
+		bool changed = !m_comparing || m_truncate;
+		if (m_truncate || m_comparing)
+		{
+			const int64_t size = GetSize(m_path);
+			if (size >= 0 && static_cast<uint64_t>(size) != m_offset)
+			{
+				std::error_code ec;
+				fs::resize_file(m_path, m_offset, ec);
+				if (ec)
+				{
+					printf("\nERROR: Cannot truncate file \"%s\"\n", m_path.filename().string().c_str());
+					exit(EXIT_FAILURE);
+				}
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+private:
+	bool Matches(const void* data, size_t size)
+	{
+		m_compareBuffer.resize(size);
+		return fread(m_compareBuffer.data(), 1, size, m_file.get()) == size && memcmp(m_compareBuffer.data(), data, size) == 0;
+	}
+
+	void StartWriting()
+	{
+		m_file = OpenScopedFile(m_path, "r+b");
+		if (m_file == nullptr || SeekFile(m_file.get(), m_offset, SEEK_SET) != 0)
+		{
+			printf("\nERROR: Cannot update file \"%s\"\n", m_path.filename().string().c_str());
+			exit(EXIT_FAILURE);
+		}
+		m_comparing = false;
+		m_truncate = true;
+	}
+
+	fs::path m_path;
+	unique_file m_file;
+	uint64_t m_offset = 0;
+	bool m_comparing = false;
+	bool m_truncate = false; // Set once an existing file is being rewritten
+	std::vector<unsigned char> m_compareBuffer;
+};
+
+void writePCMFile(OutputFile& outFile, cd::IsoReader& reader, const size_t cddaSize, const bool isInvalid)
 {
 	constexpr size_t bufferSize = 64 * 1024; // Use a 64KiB buffer for better I/O performance
 	unsigned char copyBuff[bufferSize]{};
 	size_t bytesLeft = cddaSize;
+
+	// The samples are stored as they are, so plain images can be copied without reading them in
+	if (!isInvalid)
+		bytesLeft -= outFile.CopyFrom(reader, bytesLeft);
+
 	while (bytesLeft > 0) {
 
     	size_t bytesToRead = bytesLeft;
@@ -222,17 +354,17 @@ void writePCMFile(FILE *outFile, cd::IsoReader& reader, const size_t cddaSize, c
 		if (!isInvalid)
     		reader.ReadBytesDA(copyBuff, bytesToRead);
 
-    	fwrite(copyBuff, 1, bytesToRead, outFile);
+    	outFile.Write(copyBuff, bytesToRead);
 
     	bytesLeft -= bytesToRead;
     }
 }
 
-void writeWaveFile(FILE *outFile, cd::IsoReader& reader, const size_t cddaSize, const bool isInvalid)
+void writeWaveFile(OutputFile& outFile, cd::IsoReader& reader, const size_t cddaSize, const bool isInvalid)
 {
     cd::RIFF_HEADER riffHeader;
     prepareRIFFHeader(&riffHeader, cddaSize);
-    fwrite((void*)&riffHeader, 1, sizeof(cd::RIFF_HEADER), outFile);
+    outFile.Write(&riffHeader, sizeof(cd::RIFF_HEADER));
 
     writePCMFile(outFile, reader, cddaSize, isInvalid);
 }
@@ -427,50 +559,11 @@ static void SimplifyDefaultXMLAttributes(tinyxml2::XMLElement* element, const En
 	}
 }
 
-EntryType GetXAEntryType(unsigned short xa_attr)
-{
-	// we try to guess the file type. Usually, the xa_attr should tell this, but there are many games
-	// that do not follow the standard, and sometime leave some or all the attributes unset.
-	if (xa_attr & 0x40)
-	{
-		// if the cddata flag is set, we assume this is the case
-		return EntryType::EntryDA;
-	}
-	if (xa_attr & 0x80)
-	{
-		// if the directory flag is set, we assume this is the case
-		return EntryType::EntryDir;
-	}
-	if ( (xa_attr & 0x08) && !(xa_attr & 0x10) )
-	{
-		// if the mode 2 form 1 flag is set, and form 2 is not, we assume this is a regular file.
-		return EntryType::EntryFile;
-	}
-	if ( (xa_attr & 0x10) && !(xa_attr & 0x08) )
-	{
-		// if the mode 2 form 2 flag is set, and form 1 is not, we assume this is a pure audio xa file.
-		return EntryType::EntryXA;
-	}
-
-	// here all flags are set to the same value. From what I could see until now, when both flags are the same,
-	// this is interpreted in the following two ways, which both lead us to choose str/xa type.
-	// 1. Both values are 1, which means there is an indication by the mode 2 form 2 flag that the data is not
-	//    regular mode 2 form 1 data (i.e., it is either mixed or just xa).
-	// 2. Both values are 0. The fact that the mode 2 form 2 flag is 0 simply means that the data might not
-	//    be *pure* mode 2 form 2 data (i.e., xa), so, we do not conclude it is regular mode 2 form 1 data.
-	//    We thus give priority to the mode 2 form 1 flag, which is also zero,
-	//	  and conclude that the data is not regular mode 2 form 1 data, and thus can be either mode 2 form 2 or mixed.
-
-	// Remark: Some games (Legend of Mana), use a very strange STR+XA format that is stored in plain mode 2 form 1.
-	// This is properly marked in the xa_attr, and there is nothing wrong in extracting them as data.
-	return EntryType::EntryXA;
-}
-
 std::unique_ptr<cd::IsoDirEntries> ParseSubdirectory(cd::IsoReader& reader, ListView<cd::IsoDirEntries::Entry> view, int offs, int sectors,
 	const fs::path& path)
 {
     auto dirEntries = std::make_unique<cd::IsoDirEntries>(std::move(view));
-	dirEntries->ReadDirEntries(&reader, offs, sectors);
+	dirEntries->ReadDirEntries(&reader, offs, sectors, *global::new_type);
 
     for (auto& e : dirEntries->dirEntryList.GetView())
 	{
@@ -507,7 +600,7 @@ std::unique_ptr<cd::IsoDirEntries> ParsePathTable(cd::IsoReader& reader, ListVie
 		} while (!(sector.subHead[2] & 0x81)); // Directory records normally ends with submode 0x89
 	}
 
-	dirEntries->ReadDirEntries(&reader, pathTableList[index].entry.dirOffs, dirRecordSectors);
+	dirEntries->ReadDirEntries(&reader, pathTableList[index].entry.dirOffs, dirRecordSectors, *global::new_type);
 
 	// Only add the missing directories to the list
     for (int i = 1; i < pathTableList.size(); i++) {
@@ -583,6 +676,17 @@ std::unique_ptr<cd::IsoDirEntries> ParseRootPathTable(cd::IsoReader& reader, Lis
   	return dirEntries;
 }
 
+// Seeks to a sector of an audio entry stored in its own BIN file of the cue sheet
+static bool SeekToCueTrack(const unsigned int sector, const cd::IsoDirEntries::Entry& entry, cd::IsoReader& reader)
+{
+	const int trackIndex = GetCueTrackIndex(entry, global::cueFile);
+	if (trackIndex < 0)
+	{
+		exit(EXIT_FAILURE);
+	}
+	return multiBinSeeker(sector, trackIndex, reader, global::cueFile);
+}
+
 std::list<cd::IsoDirEntries::Entry*> ParseDAfiles(cd::IsoReader& reader, std::list<cd::IsoDirEntries::Entry>& entries)
 {
 	std::list<cd::IsoDirEntries::Entry*> DAfiles;
@@ -630,7 +734,7 @@ std::list<cd::IsoDirEntries::Entry*> ParseDAfiles(cd::IsoReader& reader, std::li
 			unsigned char emptyBuff[CD_SECTOR_SIZE] {};
 			while (true)
 			{
-				if (!reader.SeekToSector(entry.entry.entryOffs.lsb - 1) && !multiBinSeeker(entry.entry.entryOffs.lsb - 1, entry, reader, global::cueFile))
+				if (!reader.SeekToSector(entry.entry.entryOffs.lsb - 1) && !SeekToCueTrack(entry.entry.entryOffs.lsb - 1, entry, reader))
 					break;
 
 				reader.ReadBytesDA(sectorBuff, CD_SECTOR_SIZE, true);
@@ -753,181 +857,209 @@ void BruteForce(cd::IsoReader& reader, std::list<cd::IsoDirEntries::Entry>& entr
 		});
 }
 
-void ExtractFiles(cd::IsoReader& reader, const std::list<cd::IsoDirEntries::Entry>& files, const fs::path& rootPath)
+// Extracts a single file to its path under rootPath, the directory it is in must already exist
+void ExtractFile(cd::IsoReader& reader, const cd::IsoDirEntries::Entry& entry, const fs::path& rootPath, bool& printedDA)
 {
-	bool printedDA = false;
-    for (const auto& entry : files)
-	{
-        if (entry.subdir == nullptr) // Do not extract directories, they're already prepared
+	const fs::path outputPath = rootPath / entry.virtualPath / CleanIdentifier(entry.identifier);
+	bool changed = true;
+	if (entry.type == EntryType::EntryXA)
+	{
+		// Extract XA or STR file.
+		// For both XA and STR files, we need to extract the data 2336 bytes per sector.
+		// When rebuilding the bin using mkpsxiso, we mark the file with mixed.
+		// The source file will anyway be stored on our hard drive in raw form.
+		if (!param::QuietMode)
 		{
-			const fs::path outputPath = rootPath / entry.virtualPath / CleanIdentifier(entry.identifier);
-			if (entry.type == EntryType::EntryXA)
-			{
-				// Extract XA or STR file.
-				// For both XA and STR files, we need to extract the data 2336 bytes per sector.
-				// When rebuilding the bin using mkpsxiso, we mark the file with mixed.
-				// The source file will anyway be stored on our hard drive in raw form.
-				if (!param::QuietMode)
-				{
-					printf("    Extracting XA \"%s\"... ", outputPath.lexically_normal().string().c_str());
-				}
-				fflush(stdout);
+			printf("    Extracting XA \"%s\"... ", outputPath.lexically_normal().string().c_str());
+		}
+		fflush(stdout);
 
-				FILE* outFile = OpenFile(outputPath, "wb");
+		OutputFile outFile;
 
-				if (outFile == NULL || !reader.SeekToSector(entry.entry.entryOffs.lsb))
-				{
-					printf("\nERROR: Cannot create file \"%s\"\n", outputPath.filename().string().c_str());
-					exit(EXIT_FAILURE);
-				}
+		if (!outFile.Open(outputPath) || !reader.SeekToSector(entry.entry.entryOffs.lsb))
+		{
+			printf("\nERROR: Cannot create file \"%s\"\n", outputPath.filename().string().c_str());
+			exit(EXIT_FAILURE);
+		}
 
-				// this is the data to be read 2336 bytes per sector, both if the file is an STR or XA,
-				// because the STR contains audio.
-				size_t sectorsToRead = GetSizeInSectors(entry.entry.entrySize.lsb);
+		// this is the data to be read 2336 bytes per sector, both if the file is an STR or XA,
+		// because the STR contains audio.
+		size_t sectorsToRead = GetSizeInSectors(entry.entry.entrySize.lsb);
 
-				// Copy loop
-				{
-				constexpr size_t bufferSize = 64 * 1024; // Use a 64KiB buffer for better I/O performance
-				unsigned char copyBuff[bufferSize];
-				auto ptrReadFunc = !param::raw ? &cd::IsoReader::ReadBytesXA : &cd::IsoReader::ReadBytesDA;
-				size_t bytesLeft = (!param::raw ? XA_DATA_SIZE : CD_SECTOR_SIZE) * sectorsToRead;
-				while(bytesLeft > 0) {
+		// Copy loop
+		{
+		constexpr size_t bufferSize = 64 * 1024; // Use a 64KiB buffer for better I/O performance
+		unsigned char copyBuff[bufferSize];
+		auto ptrReadFunc = !param::raw ? &cd::IsoReader::ReadBytesXA : &cd::IsoReader::ReadBytesDA;
+		size_t bytesLeft = (!param::raw ? XA_DATA_SIZE : CD_SECTOR_SIZE) * sectorsToRead;
+		if (param::raw)
+			bytesLeft -= outFile.CopyFrom(reader, bytesLeft);
 
-					size_t bytesToRead = bytesLeft;
+		while(bytesLeft > 0) {
 
-					if (bytesToRead > bufferSize)
-						bytesToRead = bufferSize;
+			size_t bytesToRead = bytesLeft;
 
-					(reader.*ptrReadFunc)(copyBuff, bytesToRead, false);
+			if (bytesToRead > bufferSize)
+				bytesToRead = bufferSize;
 
-					fwrite(copyBuff, 1, bytesToRead, outFile);
+			(reader.*ptrReadFunc)(copyBuff, bytesToRead, false);
 
-					bytesLeft -= bytesToRead;
+			outFile.Write(copyBuff, bytesToRead);
 
-				}
-				}
+			bytesLeft -= bytesToRead;
+
+		}
+		}
 
-				fclose(outFile);
+		changed = outFile.Close();
+	}
+	else if (entry.type == EntryType::EntryDA)
+	{
+		// Extract CDDA file
+		if (!printedDA && !param::QuietMode)
+		{
+			printf("\n  Creating CDDA files...\n");
+			printedDA = true;
+		}
+		bool isInvalid = !global::cueFile.multiBIN
+			? !reader.SeekToSector(entry.entry.entryOffs.lsb)
+			: !SeekToCueTrack(entry.entry.entryOffs.lsb, entry, reader);
+        auto daOutPath = GetRealDAFilePath(outputPath);
+		OutputFile outFile;
+		const bool opened = outFile.Open(daOutPath);
+
+		if (isInvalid && !param::noWarns)
+		{
+			printf( "\nWARNING: The CDDA file \"%s\" is out of the iso file bounds.\n"
+					"\t This usually means that the game has audio tracks, and they are on separate files.\n", daOutPath.filename().string().c_str() );
+			if (global::cueFile.tracks.empty())
+			{
+				printf("\t Try using a .cue file, instead of an ISO image, to be able to access those files.\n");
 			}
-			else if (entry.type == EntryType::EntryDA)
+			printf( "\t DUMPSXISO will write the file as a dummy (silent) cdda file.\n"
+					"\t This is generally fine, when the real CDDA file is also a dummy file.\n"
+					"\t If it is not dummy, you WILL lose this audio data in the rebuilt iso... " );
+			if (param::QuietMode)
 			{
-				// Extract CDDA file
-				if (!printedDA && !param::QuietMode)
-				{
-					printf("\n  Creating CDDA files...\n");
-					printedDA = true;
-				}
-				bool isInvalid = !global::cueFile.multiBIN
-					? !reader.SeekToSector(entry.entry.entryOffs.lsb)
-					: !multiBinSeeker(entry.entry.entryOffs.lsb, entry, reader, global::cueFile);
-                auto daOutPath = GetRealDAFilePath(outputPath);
-				auto outFile = OpenScopedFile(daOutPath, "wb");
-
-				if (isInvalid && !param::noWarns)
-				{
-					printf( "\nWARNING: The CDDA file \"%s\" is out of the iso file bounds.\n"
-							"\t This usually means that the game has audio tracks, and they are on separate files.\n", daOutPath.filename().string().c_str() );
-					if (global::cueFile.tracks.empty())
-					{
-						printf("\t Try using a .cue file, instead of an ISO image, to be able to access those files.\n");
-					}
-					printf( "\t DUMPSXISO will write the file as a dummy (silent) cdda file.\n"
-							"\t This is generally fine, when the real CDDA file is also a dummy file.\n"
-							"\t If it is not dummy, you WILL lose this audio data in the rebuilt iso... " );
-					if (param::QuietMode)
-					{
-						printf("\n");
-					}
-				}
-				else if (!param::QuietMode)
-				{
-					printf("    Extracting audio \"%s\"... ", daOutPath.lexically_normal().string().c_str());
-				}
-				fflush(stdout);
+				printf("\n");
+			}
+		}
+		else if (!param::QuietMode)
+		{
+			printf("    Extracting audio \"%s\"... ", daOutPath.lexically_normal().string().c_str());
+		}
+		fflush(stdout);
 
-				if (!outFile) {
-					printf("\nERROR: Cannot create file \"%s\"\n", daOutPath.filename().string().c_str());
-					exit(EXIT_FAILURE);
-				}
+		if (!opened) {
+			printf("\nERROR: Cannot create file \"%s\"\n", daOutPath.filename().string().c_str());
+			exit(EXIT_FAILURE);
+		}
 
-				size_t sectorsToRead = GetSizeInSectors(entry.entry.entrySize.lsb);
-				size_t cddaSize = CD_SECTOR_SIZE * sectorsToRead;
+		size_t sectorsToRead = GetSizeInSectors(entry.entry.entrySize.lsb);
+		size_t cddaSize = CD_SECTOR_SIZE * sectorsToRead;
 
-				if(param::encodingFormat == EAF_WAV)
-				{
-					writeWaveFile(outFile.get(), reader, cddaSize, isInvalid);
-				}
+		if(param::encodingFormat == EAF_WAV)
+		{
+			writeWaveFile(outFile, reader, cddaSize, isInvalid);
+		}
 #ifndef MKPSXISO_NO_LIBFLAC
-				else if(param::encodingFormat == EAF_FLAC)
-				{
-					// libflac closes outFile
-					writeFLACFile(outFile.release(), reader, cddaSize, isInvalid);
-				}
-#endif
-				else
-				{
-					writePCMFile(outFile.get(), reader, cddaSize, isInvalid);
-				}
-
-				if (global::cueFile.multiBIN)
-				{
-					reader.Open(global::cueFile.tracks[0].filePath);
-				}
+		else if(param::encodingFormat == EAF_FLAC)
+		{
+			// libflac writes and closes a file of its own, which is compared with the existing one when updating
+			const fs::path encodedPath = fs::path(daOutPath) += ".tmp";
+			FILE* encodedFile = outFile.IsComparing() ? OpenFile(encodedPath, "wb") : outFile.Release();
+			if (encodedFile == nullptr)
+			{
+				printf("\nERROR: Cannot create file \"%s\"\n", encodedPath.filename().string().c_str());
+				exit(EXIT_FAILURE);
 			}
-			else if (entry.type == EntryType::EntryFile)
+			writeFLACFile(encodedFile, reader, cddaSize, isInvalid);
+			if (outFile.IsComparing())
 			{
-				// Extract regular file
-				if (!param::QuietMode)
-				{
-					printf("    Extracting \"%s\"... ", outputPath.lexically_normal().string().c_str());
-					fflush(stdout);
-				}
+				outFile.WriteFrom(encodedPath);
+				std::error_code ec;
+				fs::remove(encodedPath, ec);
+			}
+		}
+#endif
+		else
+		{
+			writePCMFile(outFile, reader, cddaSize, isInvalid);
+		}
+		changed = outFile.Close();
 
-				reader.SeekToSector(entry.entry.entryOffs.lsb);
+		if (global::cueFile.multiBIN)
+		{
+			reader.Open(global::cueFile.tracks[0].filePath);
+		}
+	}
+	else if (entry.type == EntryType::EntryFile)
+	{
+		// Extract regular file
+		if (!param::QuietMode)
+		{
+			printf("    Extracting \"%s\"... ", outputPath.lexically_normal().string().c_str());
+			fflush(stdout);
+		}
 
-				FILE* outFile = OpenFile(outputPath, "wb");
+		reader.SeekToSector(entry.entry.entryOffs.lsb);
 
-				if (outFile == NULL) {
-					printf("\nERROR: Cannot create file \"%s\"\n", outputPath.filename().string().c_str());
-					exit(EXIT_FAILURE);
-				}
+		OutputFile outFile;
 
-				{
-				constexpr size_t bufferSize = 64 * 1024; // Use a 64KiB buffer for better I/O performance
-				unsigned char copyBuff[bufferSize];
-				auto ptrReadFunc = !param::raw ? &cd::IsoReader::ReadBytes : &cd::IsoReader::ReadBytesDA;
-				size_t bytesLeft = !param::raw ? entry.entry.entrySize.lsb : CD_SECTOR_SIZE * GetSizeInSectors(entry.entry.entrySize.lsb);
-				while(bytesLeft > 0) {
+		if (!outFile.Open(outputPath)) {
+			printf("\nERROR: Cannot create file \"%s\"\n", outputPath.filename().string().c_str());
+			exit(EXIT_FAILURE);
+		}
 
-					size_t bytesToRead = bytesLeft;
+		{
+		constexpr size_t bufferSize = 64 * 1024; // Use a 64KiB buffer for better I/O performance
+		unsigned char copyBuff[bufferSize];
+		auto ptrReadFunc = !param::raw ? &cd::IsoReader::ReadBytes : &cd::IsoReader::ReadBytesDA;
+		size_t bytesLeft = !param::raw ? entry.entry.entrySize.lsb : CD_SECTOR_SIZE * GetSizeInSectors(entry.entry.entrySize.lsb);
+		if (param::raw)
+			bytesLeft -= outFile.CopyFrom(reader, bytesLeft);
 
-					if (bytesToRead > bufferSize)
-						bytesToRead = bufferSize;
+		while(bytesLeft > 0) {
 
-					(reader.*ptrReadFunc)(copyBuff, bytesToRead, false);
-					fwrite(copyBuff, 1, bytesToRead, outFile);
+			size_t bytesToRead = bytesLeft;
 
-					bytesLeft -= bytesToRead;
+			if (bytesToRead > bufferSize)
+				bytesToRead = bufferSize;
 
-				}
-				}
+			(reader.*ptrReadFunc)(copyBuff, bytesToRead, false);
+			outFile.Write(copyBuff, bytesToRead);
 
-				fclose(outFile);
-			}
-			else
-			{
-				if (!param::noWarns)
-				{
-					printf("WARNING: File %s is of invalid type.\n", entry.identifier.c_str());
-				}
-				continue;
-			}
-			if (!param::QuietMode)
-			{
-				printf("Done.\n");
-			}
-        }
-    }
+			bytesLeft -= bytesToRead;
+
+		}
+		}
+
+		changed = outFile.Close();
+	}
+	else
+	{
+		if (!param::noWarns)
+		{
+			printf("WARNING: File %s is of invalid type.\n", entry.identifier.c_str());
+		}
+		return;
+	}
+	if (!param::QuietMode)
+	{
+		printf(changed ? "Done.\n" : "Unchanged.\n");
+	}
+}
+
+void ExtractFiles(cd::IsoReader& reader, const std::list<cd::IsoDirEntries::Entry>& files, const fs::path& rootPath)
+{
+	bool printedDA = false;
+	for (const auto& entry : files)
+	{
+		if (entry.subdir == nullptr) // Do not extract directories, they're already prepared
+		{
+			ExtractFile(reader, entry, rootPath, printedDA);
+		}
+	}
 
 	// Update timestamps AFTER all files have been extracted
 	// else directories will have their timestamps discarded when files are being unpacked into them!
@@ -945,6 +1077,131 @@ void ExtractFiles(cd::IsoReader& reader, const std::list<cd::IsoDirEntries::Entr
 	}
 }
 
+// Extracts only the files matching the --extract paths. Only the directories which can hold matching
+// files are read, found through the path table, and every file is read with a direct seek to its LBA.
+void ExtractSelectedFiles(cd::IsoReader& reader, const cd::IsoPathTable& pathTable)
+{
+	struct Pattern
+	{
+		std::string dir;
+		std::string name;
+		const std::string* source;
+		bool matched = false;
+	};
+
+	std::vector<Pattern> patterns;
+	for (const std::string& path : param::extractPaths)
+	{
+		const std::string normalized = seeksim::NormalizeDiscPath(path);
+		const size_t slash = normalized.find_last_of('/');
+		if (slash == std::string::npos)
+		{
+			patterns.push_back({ std::string(), normalized, &path });
+		}
+		else
+		{
+			patterns.push_back({ normalized.substr(0, slash), normalized.substr(slash + 1), &path });
+		}
+	}
+
+	std::list<cd::IsoDirEntries::Entry> entries;
+	std::vector<const cd::IsoDirEntries::Entry*> selected;
+	for (size_t i = 0; i < pathTable.pathTableList.size(); i++)
+	{
+		// Paths are built as name / path, which leaves a trailing separator to drop
+		const fs::path dirPath = pathTable.GetFullDirPath(i);
+		std::string dirName = dirPath.generic_string();
+		if (!dirName.empty() && dirName.back() == '/')
+		{
+			dirName.pop_back();
+		}
+		if (std::none_of(patterns.begin(), patterns.end(), [&dirName](const Pattern& pattern)
+			{
+				return MatchWildcardICase(pattern.dir, dirName);
+			}))
+		{
+			continue;
+		}
+
+		// The first record of a directory describes the directory itself, including its size
+		const int lba = pathTable.pathTableList[i].entry.dirOffs;
+		cd::IsoDirEntries dirEntries{ListView(entries)};
+		dirEntries.ReadRootDir(&reader, lba);
+		if (dirEntries.dirEntryList.GetView().empty())
+		{
+			continue;
+		}
+		const uint32_t dirSectors = GetSizeInSectors(dirEntries.dirEntryList.GetView().front().get().entry.entrySize.lsb);
+		dirEntries.dirEntryList.ClearView();
+		dirEntries.ReadDirEntries(&reader, lba, dirSectors, *global::new_type);
+
+		for (auto& e : dirEntries.dirEntryList.GetView())
+		{
+			auto& entry = e.get();
+			if (entry.entry.flags & 0x2)
+			{
+				continue;
+			}
+
+			const std::string name = CleanIdentifier(entry.identifier);
+			bool matched = false;
+			for (Pattern& pattern : patterns)
+			{
+				if (MatchWildcardICase(pattern.dir, dirName) && MatchWildcardICase(pattern.name, name))
+				{
+					pattern.matched = matched = true;
+				}
+			}
+
+			if (matched)
+			{
+				entry.virtualPath = dirPath;
+				selected.push_back(&entry);
+			}
+		}
+	}
+
+	for (const Pattern& pattern : patterns)
+	{
+		if (!pattern.matched && !param::noWarns)
+		{
+			printf("WARNING: No files match \"%s\".\n", pattern.source->c_str());
+		}
+	}
+	if (selected.empty())
+	{
+		printf("ERROR: No files to extract.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (!param::QuietMode)
+	{
+		printf("\nExtracting files...\n");
+	}
+
+	bool printedDA = false;
+	for (const cd::IsoDirEntries::Entry* entry : selected)
+	{
+		const fs::path dirPath = param::outPath / entry->virtualPath;
+		std::error_code ec;
+		fs::create_directories(dirPath, ec);
+		if (ec)
+		{
+			printf("\nERROR: Cannot create directory \"%s\". %s\n", dirPath.lexically_normal().string().c_str(), ec.message().c_str());
+			exit(EXIT_FAILURE);
+		}
+
+		ExtractFile(reader, *entry, param::outPath, printedDA);
+
+		fs::path extractedPath(param::outPath / entry->virtualPath / CleanIdentifier(entry->identifier));
+		if (entry->type == EntryType::EntryDA)
+		{
+			extractedPath = GetRealDAFilePath(extractedPath);
+		}
+		UpdateTimestamps(extractedPath, entry->entry.entryDate);
+	}
+}
+
 tinyxml2::XMLElement* WriteXMLEntry(const cd::IsoDirEntries::Entry& entry, tinyxml2::XMLElement* dirElement, fs::path* currentVirtualPath,
 	const fs::path& sourcePath, EntryAttributeCounters& attributeCounters)
 {
@@ -1112,12 +1369,196 @@ void WriteXMLByDirectories(const cd::IsoDirEntries* directory, tinyxml2::XMLElem
 	}
 }
 
+static const char* GetEntryTypeName(EntryType type)
+{
+	switch (type)
+	{
+	case EntryType::EntryDir:
+		return "dir";
+	case EntryType::EntryXA:
+		return "mixed";
+	case EntryType::EntryDA:
+		return "da";
+	default:
+		return "data";
+	}
+}
+
+// Prints every entry found on the disc, either as a table or as a JSON array
+void ListEntries(const std::list<cd::IsoDirEntries::Entry>& entries)
+{
+	if (param::listJSON)
+	{
+		printf("[");
+	}
+	else
+	{
+		printf("       LBA       Size  Type   XA attr   GID   UID  File  Track  Path\n");
+	}
+
+	bool first = true;
+	for (const auto& entry : entries)
+	{
+		std::string path = '/' + (entry.virtualPath / CleanIdentifier(entry.identifier)).generic_string();
+		if (entry.type == EntryType::EntryDir && path.length() > 1)
+		{
+			path += '/';
+		}
+
+		if (!param::listJSON)
+		{
+			printf("%10u %10u  %-5s   0x%04X %5u %5u %5u  %5s  %s\n", entry.entry.entryOffs.lsb, entry.entry.entrySize.lsb, GetEntryTypeName(entry.type),
+				entry.extData.attributes, entry.extData.ownergroupid, entry.extData.owneruserid, entry.extData.filenum,
+				entry.trackid.empty() ? "-" : entry.trackid.c_str(), path.c_str());
+			continue;
+		}
+
+		printf(first ? "\n{\"path\":" : ",\n{\"path\":");
+		first = false;
+		xml::WriteJSONString(stdout, path.c_str());
+		printf(",\"type\":\"%s\",\"lba\":%u,\"size\":%u,\"sectors\":%u", GetEntryTypeName(entry.type),
+			entry.entry.entryOffs.lsb, entry.entry.entrySize.lsb, GetSizeInSectors(entry.entry.entrySize.lsb));
+		printf(",\"xa_attrib\":%u,\"xa_gid\":%u,\"xa_uid\":%u,\"xa_filenum\":%u", entry.extData.attributes,
+			entry.extData.ownergroupid, entry.extData.owneruserid, entry.extData.filenum);
+		if (!entry.trackid.empty())
+		{
+			printf(",\"trackid\":\"%s\"", entry.trackid.c_str());
+		}
+		printf("}");
+	}
+
+	if (param::listJSON)
+	{
+		printf("\n]\n");
+	}
+}
+
+void SimulateTrace(const std::list<cd::IsoDirEntries::Entry>& entries)
+{
+	const auto trace = seeksim::LoadTrace(*param::simulateTraceFile);
+	if (!trace)
+	{
+		printf("ERROR: Cannot read access trace \"%s\".\n", param::simulateTraceFile->lexically_normal().string().c_str());
+		exit(EXIT_FAILURE);
+	}
+
+	std::vector<seeksim::DiscFile> files;
+	for (const auto& entry : entries)
+	{
+		if (entry.type == EntryType::EntryDir || entry.type == EntryType::EntryDA || entry.type == EntryType::EntryDummy)
+		{
+			continue;
+		}
+		files.push_back({ seeksim::NormalizeDiscPath((entry.virtualPath / CleanIdentifier(entry.identifier)).generic_string()),
+			entry.entry.entryOffs.lsb, GetSizeInSectors(entry.entry.entrySize.lsb) });
+	}
+	seeksim::PrintTraceSimulation(*trace, files, param::driveModel);
+}
+
+// Writes a Logiqx DAT, the format of Redump, with the tracks of the image as one game and the files on the disc as another
+void WriteHashes(const std::list<cd::IsoDirEntries::Entry>& entries)
+{
+	std::vector<dat::File> files;
+	for (const auto& entry : entries)
+	{
+		if (entry.type != EntryType::EntryFile && entry.type != EntryType::EntryXA)
+		{
+			continue;
+		}
+
+		dat::File& file = files.emplace_back();
+		file.name = (entry.virtualPath / CleanIdentifier(entry.identifier)).generic_string();
+		std::replace(file.name.begin(), file.name.end(), '/', '\\');
+		file.lba = entry.entry.entryOffs.lsb;
+		file.xa = entry.type == EntryType::EntryXA;
+		file.size = file.xa ? static_cast<uint64_t>(GetSizeInSectors(entry.entry.entrySize.lsb)) * XA_DATA_SIZE : entry.entry.entrySize.lsb;
+	}
+
+	std::vector<dat::Rom> roms = dat::GetRoms(param::isoFile, global::cuePath, global::cueFile);
+	if (!param::QuietMode)
+	{
+		printf("Hashing %zu tracks and %zu files...\n", roms.size() - !global::cuePath.empty(), files.size());
+	}
+	if (!dat::HashImage(roms, files))
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	tinyxml2::XMLDocument xmldoc;
+	xmldoc.InsertEndChild(xmldoc.NewDeclaration());
+	xmldoc.InsertEndChild(xmldoc.NewUnknown("DOCTYPE datafile PUBLIC \"-//Logiqx//DTD ROM Management Datafile//EN\" \"http://www.logiqx.com/Dats/datafile.dtd\""));
+	tinyxml2::XMLElement* datafile = xmldoc.NewElement("datafile");
+	xmldoc.InsertEndChild(datafile);
+
+	const std::string gameName = (global::cuePath.empty() ? param::isoFile : global::cuePath).stem().string();
+	tinyxml2::XMLElement* header = datafile->InsertNewChildElement("header");
+	header->InsertNewChildElement("name")->SetText("dumpsxiso");
+	header->InsertNewChildElement("description")->SetText(gameName.c_str());
+	header->InsertNewChildElement("version")->SetText(VERSION);
+
+	auto addGame = [datafile](const std::string& name)
+		{
+			tinyxml2::XMLElement* game = datafile->InsertNewChildElement("game");
+			game->SetAttribute("name", name.c_str());
+			game->InsertNewChildElement("description")->SetText(name.c_str());
+			return game;
+		};
+	auto addRom = [](tinyxml2::XMLElement* game, const std::string& name, const hash::Digests& digests)
+		{
+			tinyxml2::XMLElement* rom = game->InsertNewChildElement("rom");
+			rom->SetAttribute("name", name.c_str());
+			rom->SetAttribute("size", std::to_string(digests.size).c_str());
+			rom->SetAttribute("crc", hash::ToHex(digests.crc32).c_str());
+			rom->SetAttribute("md5", hash::ToHex(digests.md5.data(), digests.md5.size()).c_str());
+			rom->SetAttribute("sha1", hash::ToHex(digests.sha1.data(), digests.sha1.size()).c_str());
+		};
+
+	tinyxml2::XMLElement* tracksGame = addGame(gameName);
+	for (const dat::Rom& rom : roms)
+	{
+		addRom(tracksGame, rom.name, rom.digests);
+	}
+	if (!files.empty())
+	{
+		tinyxml2::XMLElement* filesGame = addGame(gameName + " (Files)");
+		for (const dat::File& file : files)
+		{
+			addRom(filesGame, file.name, file.digests);
+		}
+	}
+
+	FILE* file = *param::hashFile == "-" ? stdout : OpenFile(*param::hashFile, "wb");
+	if (file == nullptr)
+	{
+		printf("ERROR: Cannot create DAT file \"%s\". %s\n", param::hashFile->lexically_normal().string().c_str(), strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	xmldoc.SaveFile(file);
+	if (file != stdout)
+	{
+		fclose(file);
+	}
+
+	if (!param::QuietMode)
+	{
+		printf("Wrote DAT file \"%s\".\n", param::hashFile->lexically_normal().string().c_str());
+	}
+}
+
 void ParseISO(cd::IsoReader& reader) {
 
     cd::ISO_DESCRIPTOR descriptor;
 	bool ps2 = false;
-	auto license = ReadLicense(reader);
-	const bool xa_edc = CheckEDCXA(reader);
+	const bool extracting = !param::list && !param::simulateTraceFile && !param::hashFile && param::extractPaths.empty();
+
+	// Checking for EDC in XA sectors may scan the whole disc, only do it when it is needed for the XML
+	std::unique_ptr<cd::ISO_LICENSE> license;
+	bool xa_edc = true;
+	if (extracting)
+	{
+		license = ReadLicense(reader);
+		xa_edc = CheckEDCXA(reader);
+	}
 	global::new_type = CheckISOver(reader, ps2);
 
     reader.SeekToSector(16);
@@ -1151,8 +1592,14 @@ void ParseISO(cd::IsoReader& reader) {
         return;
     }
 
-	// Prepare output directories
-	for(size_t i=0; i<numEntries; i++)
+	if (!param::extractPaths.empty())
+	{
+		ExtractSelectedFiles(reader, pathTable);
+		return;
+	}
+
+	// Prepare output directories, nothing is written when only listing files or simulating a trace
+	for(size_t i=0; i<numEntries && extracting; i++)
 	{
 		const fs::path dirPath = param::outPath / pathTable.GetFullDirPath(i);
 
@@ -1167,7 +1614,7 @@ void ParseISO(cd::IsoReader& reader) {
 
 	if (!param::QuietMode)
 	{
-		if (!param::noxml)
+		if (!param::noxml && extracting)
 		{
 			printf("\n    License file: \"%s\"\n", (param::outPath.lexically_normal() / "license_data.dat").string().c_str());
 		}
@@ -1188,6 +1635,12 @@ void ParseISO(cd::IsoReader& reader) {
 	// Process DA tracks and add them to the entries list
 	auto DAfiles = ParseDAfiles(reader, entries);
 
+	if (param::list)
+	{
+		ListEntries(entries);
+		return;
+	}
+
 	unsigned totalLenLBA = descriptor.volumeSize.lsb;
 	if (param::force)
 	{
@@ -1234,7 +1687,24 @@ void ParseISO(cd::IsoReader& reader) {
 			printf("    DA File \"%s\"\n", CleanIdentifier(entry->identifier).c_str());
 			tracknum++;
 		}
-		printf( "\nExtracting ISO...\n"
+		printf("\n");
+	}
+
+	if (param::simulateTraceFile)
+	{
+		SimulateTrace(entries);
+		return;
+	}
+
+	if (param::hashFile)
+	{
+		WriteHashes(entries);
+		return;
+	}
+
+	if (!param::QuietMode)
+	{
+		printf( "Extracting ISO...\n"
 				"  Creating files...\n" );
 	}
 
@@ -1367,7 +1837,14 @@ void ParseISO(cd::IsoReader& reader) {
 				}
 			}
 
-			xmldoc.SaveFile(file);
+			if (xml::IsManifestPath(param::xmlFile))
+			{
+				xml::WriteManifest(file, xmldoc);
+			}
+			else
+			{
+				xmldoc.SaveFile(file);
+			}
 			fclose(file);
 		}
 		else
@@ -1387,13 +1864,15 @@ int Main(int argc, char *argv[])
 {
 	static constexpr const char* HELP_TEXT =
 		"Usage: dumpsxiso [options <file>] <isofile>\n\n"
-		"  <isofile>\t\tFile name of the bin/cue file (supports any 2352 byte/sector images)\n\n"
+		"  <isofile>\t\tFile name of the bin/cue file (supports any 2352 byte/sector images)\n"
+		"\t\t\t(ECM and seekable zstd compressed images are read directly)\n\n"
 		"Options:\n"
 		"  -h|--help\t\tShows this help text\n"
 		"  -q|--quiet\t\tQuiet mode (suppress all but warnings and errors)\n"
 		"  -w|--warns\t\tSuppress all warnings (can be used along with -q)\n"
 		"  -x <path>\t\tOptional destination directory for extracted files (defaults to working dir)\n"
 		"  -s <file>\t\tOptional XML name/destination for MKPSXISO script (defaults to working dir)\n"
+		"\t\t\t(a .jsonl extension writes a JSON lines project manifest instead)\n"
 		"  -pt|--path-table\tGo through every known directory in order; helps on soft obfuscated games (like DMW3)\n"
 		"  -f|--force\t\tScans all unknown sectors for files; helps on heavy obfuscated games (like Xenogears)\n"
 		"  -e|--encode <codec>\tCodec to encode CDDA/DA audio; supports " SUPPORTED_CODEC_TEXT " (defaults to wave)\n"
@@ -1401,7 +1880,20 @@ int Main(int argc, char *argv[])
 		"  -n|--noxml\t\tDo not generate an XML file and license file\n"
 		"  -r|--raw\t\tDumps all files in raw format (forces --noxml option)\n"
 		"  -S|--sort-by-dir\tOutputs a \"pretty\" XML script where entries are grouped in directories\n"
-		"\t\t\t(instead of strictly following their original order on the disc)\n";
+		"\t\t\t(instead of strictly following their original order on the disc)\n"
+		"  --update\t\tCompare extracted files with the ones already in the destination directory\n"
+		"\t\t\tand only rewrite those which differ\n"
+		"  --extract <path>\tOnly extract files matching a path on the disc, such as \\DATA\\LEVEL*.BIN\n"
+		"\t\t\t(can be given more than once, * and ? wildcards are supported; no XML is written)\n"
+		"  --list\t\tList all files with their LBA, size, type and XA attributes instead of extracting\n"
+		"  --list-json\t\tSame as --list, but prints the list as JSON\n"
+		"  --simulate-trace <file>\n"
+		"\t\t\tReport simulated load times of an access trace instead of extracting files\n"
+		"  --drive <settings>\tDrive model for --simulate-trace, comma separated list of\n"
+		"\t\t\tspeed=<1|2>, seekmin=<ms>, seekmax=<ms> and latency=<ms>\n"
+		"\t\t\t(default speed=2,seekmin=25,seekmax=300,latency=40)\n"
+		"  --hash <file>\t\tWrite the size, CRC32, MD5 and SHA-1 of every track and file to a Redump\n"
+		"\t\t\tstyle DAT instead of extracting (- for stdout)\n";
 
 	static constexpr const char* VERSION_TEXT =
 		"DUMPSXISO " VERSION " - PlayStation ISO dumping tool\n"
@@ -1465,6 +1957,11 @@ int Main(int argc, char *argv[])
 				param::noWarns = true;
 				continue;
 			}
+			if (ParseArgument(args, "", "update"))
+			{
+				param::update = true;
+				continue;
+			}
 			if (ParseArgument(args, "S", "sort-by-dir"))
 			{
 				param::outputSortedByDir = true;
@@ -1504,6 +2001,46 @@ int Main(int argc, char *argv[])
 				printf("%s", EncodingCodecs[i].notcompiledmessage);
 				return EXIT_FAILURE;
 			}
+			if (auto extractPath = ParseStringArgument(args, "", "extract"); extractPath.has_value())
+			{
+				param::extractPaths.push_back(*extractPath);
+				continue;
+			}
+			if (ParseArgument(args, "", "list"))
+			{
+				param::list = true;
+				continue;
+			}
+			if (ParseArgument(args, "", "list-json"))
+			{
+				// Keep the output clean for tools reading it
+				param::list = param::listJSON = true;
+				param::QuietMode = true;
+				continue;
+			}
+			if (auto simulateTrace = ParseStringArgument(args, "", "simulate-trace"); simulateTrace.has_value())
+			{
+				param::simulateTraceFile = *simulateTrace;
+				continue;
+			}
+			if (auto hashFile = ParseStringArgument(args, "", "hash"); hashFile.has_value())
+			{
+				param::hashFile = *hashFile;
+				if (*hashFile == "-")
+				{
+					param::QuietMode = true;
+				}
+				continue;
+			}
+			if (auto drive = ParseStringArgument(args, "", "drive"); drive.has_value())
+			{
+				if (!seeksim::ParseDriveModel(*drive, param::driveModel))
+				{
+					printf("Invalid drive model: %s\n", drive->c_str());
+					return EXIT_FAILURE;
+				}
+				continue;
+			}
 
 			// If we reach this point, an unknown parameter was passed
 			printf("Unknown parameter: %s\n", *args);
@@ -1544,7 +2081,11 @@ int Main(int argc, char *argv[])
 
 	if (CompareICase(param::isoFile.extension().string(), ".cue"))
 	{
-		global::cueFile = parseCueFile(param::isoFile);
+		global::cuePath = param::isoFile;
+		if (!parseCueFile(param::isoFile, global::cueFile))
+		{
+			return EXIT_FAILURE;
+		}
 	}
 
 	cd::IsoReader reader;
@@ -1566,7 +2107,7 @@ int Main(int argc, char *argv[])
 		}
 	}
 
-	if (!param::QuietMode)
+	if (!param::QuietMode && !param::list && !param::simulateTraceFile && !param::hashFile)
 	{
 		printf("Output directory : \"%s\"\n\n", param::outPath.lexically_normal().string().c_str());
 	}
@@ -0,0 +1,312 @@
+#include "sectorsource.h"
+#include "ecm.h"
+#include "platform.h"
+#include "report.h"
+#include <algorithm>
+#include <climits>
+
+#ifdef MKPSXISO_ZSTD
+#include <zstd.h>
+#endif
+
+// Plain BIN files, read sequentially without seeking whenever possible
+class RawSectorSource final : public cd::SectorSource
+{
+public:
+	RawSectorSource(unique_file file, uint64_t size, fs::path path)
+		: m_file(std::move(file)), m_size(size), m_path(std::move(path))
+	{
+	}
+
+	uint64_t GetSize() const override
+	{
+		return m_size;
+	}
+
+	bool ReadSector(unsigned int sector, unsigned char* buffer) override
+	{
+		if (sector != m_nextSector && SeekFile(m_file.get(), static_cast<int64_t>(sector) * CD_SECTOR_SIZE, SEEK_SET) != 0)
+		{
+			m_nextSector = UINT_MAX;
+			return false;
+		}
+
+		const bool read = fread(buffer, CD_SECTOR_SIZE, 1, m_file.get()) == 1;
+		m_nextSector = read ? sector + 1 : UINT_MAX;
+		return read;
+	}
+
+	int64_t CopyBytes(uint64_t offset, uint64_t size, FILE* output) override
+	{
+		return offset < m_size ? CopyFileRange(m_file.get(), offset, output, std::min(size, m_size - offset)) : 0;
+	}
+
+	fs::path GetPlainFilePath() const override
+	{
+		return m_path;
+	}
+
+private:
+	unique_file m_file;
+	const uint64_t m_size;
+	const fs::path m_path;
+	unsigned int m_nextSector = UINT_MAX;
+};
+
+// ECM images, with the EDC and ECC data regenerated on the fly
+class EcmSectorSource final : public cd::SectorSource
+{
+public:
+	bool Open(unique_file file)
+	{
+		return m_reader.Open(std::move(file));
+	}
+
+	uint64_t GetSize() const override
+	{
+		return m_reader.GetSize();
+	}
+
+	bool ReadSector(unsigned int sector, unsigned char* buffer) override
+	{
+		return m_reader.Read(static_cast<uint64_t>(sector) * CD_SECTOR_SIZE, buffer, CD_SECTOR_SIZE) == CD_SECTOR_SIZE;
+	}
+
+private:
+	ecm::Reader m_reader;
+};
+
+// Files in the zstd seekable format: independent zstd frames followed by a seek table in a
+// skippable frame, which gives the compressed and decompressed size of every frame
+static constexpr uint32_t ZSTD_FRAME_MAGIC = 0xFD2FB528;
+static constexpr uint32_t ZSTD_SEEKABLE_MAGIC = 0x8F92EAB1;
+static constexpr uint32_t ZSTD_SEEK_TABLE_FRAME_MAGIC = 0x184D2A5E;
+
+static uint32_t ReadLE32(const unsigned char* data)
+{
+	return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+#ifdef MKPSXISO_ZSTD
+class ZstdSectorSource final : public cd::SectorSource
+{
+public:
+	~ZstdSectorSource() override
+	{
+		ZSTD_freeDCtx(m_context);
+	}
+
+	bool Open(unique_file file, uint64_t fileSize);
+
+	uint64_t GetSize() const override
+	{
+		return m_frames.empty() ? 0 : m_frames.back().offset + m_frames.back().size;
+	}
+
+	bool ReadSector(unsigned int sector, unsigned char* buffer) override;
+
+private:
+	// Decompressed frames are cached, as a sector is usually followed by a read of the next one
+	static constexpr size_t CACHE_SIZE = 4;
+	static constexpr uint32_t MAX_FRAME_SIZE = 64 * 1024 * 1024;
+
+	struct Frame
+	{
+		uint64_t offset;		// Offset of the decompressed data
+		uint64_t fileOffset;
+		uint32_t size;
+		uint32_t compressedSize;
+	};
+
+	struct CachedFrame
+	{
+		size_t frame = SIZE_MAX;
+		uint64_t lastUse = 0;
+		std::vector<unsigned char> data;
+	};
+
+	const std::vector<unsigned char>* GetFrame(size_t frame);
+
+	unique_file m_file;
+	ZSTD_DCtx* m_context = nullptr;
+	std::vector<Frame> m_frames;
+	CachedFrame m_cache[CACHE_SIZE];
+	std::vector<unsigned char> m_compressed;
+	uint64_t m_useCounter = 0;
+};
+
+bool ZstdSectorSource::Open(unique_file file, uint64_t fileSize)
+{
+	static constexpr size_t FOOTER_SIZE = 9;
+
+	m_file = std::move(file);
+	FILE* fp = m_file.get();
+
+	unsigned char footer[FOOTER_SIZE];
+	if (fileSize < FOOTER_SIZE + 8 || SeekFile(fp, fileSize - FOOTER_SIZE, SEEK_SET) != 0 || fread(footer, sizeof(footer), 1, fp) != 1 ||
+		ReadLE32(footer + 5) != ZSTD_SEEKABLE_MAGIC || (footer[4] & 0x7C) != 0)
+	{
+		return false;
+	}
+
+	const uint32_t frameCount = ReadLE32(footer);
+	// Bit 7 of the descriptor tells whether each frame has a checksum, bits 0-1 are unused and ignored
+	const size_t entrySize = (footer[4] & 0x80) != 0 ? 12 : 8;
+	const uint64_t tableSize = static_cast<uint64_t>(frameCount) * entrySize;
+	if (tableSize + FOOTER_SIZE + 8 > fileSize)
+	{
+		return false;
+	}
+
+	std::vector<unsigned char> table(8 + tableSize);
+	if (SeekFile(fp, fileSize - FOOTER_SIZE - tableSize - 8, SEEK_SET) != 0 || fread(table.data(), table.size(), 1, fp) != 1 ||
+		ReadLE32(table.data()) != ZSTD_SEEK_TABLE_FRAME_MAGIC || ReadLE32(table.data() + 4) != tableSize + FOOTER_SIZE)
+	{
+		return false;
+	}
+
+	uint64_t offset = 0, fileOffset = 0;
+	m_frames.reserve(frameCount);
+	for (const unsigned char* entry = table.data() + 8; entry != table.data() + table.size(); entry += entrySize)
+	{
+		const uint32_t compressedSize = ReadLE32(entry);
+		const uint32_t size = ReadLE32(entry + 4);
+		if (size > MAX_FRAME_SIZE)
+		{
+			return false;
+		}
+
+		m_frames.push_back({ offset, fileOffset, size, compressedSize });
+		offset += size;
+		fileOffset += compressedSize;
+	}
+
+	m_context = ZSTD_createDCtx();
+	return fileOffset + table.size() + FOOTER_SIZE <= fileSize && m_context != nullptr;
+}
+
+const std::vector<unsigned char>* ZstdSectorSource::GetFrame(size_t frame)
+{
+	CachedFrame* slot = &m_cache[0];
+	for (CachedFrame& cached : m_cache)
+	{
+		if (cached.frame == frame)
+		{
+			cached.lastUse = ++m_useCounter;
+			return &cached.data;
+		}
+		if (cached.lastUse < slot->lastUse)
+		{
+			slot = &cached;
+		}
+	}
+
+	// Replace the least recently used frame
+	const Frame& info = m_frames[frame];
+	m_compressed.resize(info.compressedSize);
+	slot->frame = SIZE_MAX;
+	slot->data.resize(info.size);
+	if (SeekFile(m_file.get(), info.fileOffset, SEEK_SET) != 0 || fread(m_compressed.data(), 1, m_compressed.size(), m_file.get()) != m_compressed.size())
+	{
+		return nullptr;
+	}
+
+	const size_t result = ZSTD_decompressDCtx(m_context, slot->data.data(), slot->data.size(), m_compressed.data(), m_compressed.size());
+	if (ZSTD_isError(result) || result != info.size)
+	{
+		return nullptr;
+	}
+
+	slot->frame = frame;
+	slot->lastUse = ++m_useCounter;
+	return &slot->data;
+}
+
+bool ZstdSectorSource::ReadSector(unsigned int sector, unsigned char* buffer)
+{
+	uint64_t offset = static_cast<uint64_t>(sector) * CD_SECTOR_SIZE;
+	if (offset + CD_SECTOR_SIZE > GetSize())
+	{
+		return false;
+	}
+
+	// Sectors may span frames, frames are not required to hold whole sectors
+	auto frame = std::upper_bound(m_frames.begin(), m_frames.end(), offset,
+		[](uint64_t offset, const Frame& frame) { return offset < frame.offset; }) - 1;
+	for (size_t remaining = CD_SECTOR_SIZE; remaining > 0; ++frame)
+	{
+		const std::vector<unsigned char>* data = GetFrame(frame - m_frames.begin());
+		if (data == nullptr)
+		{
+			return false;
+		}
+
+		const size_t start = static_cast<size_t>(offset - frame->offset);
+		const size_t toCopy = std::min(remaining, data->size() - start);
+		buffer = std::copy_n(data->begin() + start, toCopy, buffer);
+		offset += toCopy;
+		remaining -= toCopy;
+	}
+	return true;
+}
+#endif
+
+std::unique_ptr<cd::SectorSource> cd::OpenSectorSource(const fs::path& path)
+{
+	fs::path imagePath = path;
+	unique_file file = OpenScopedFile(imagePath, "rb");
+	for (const char* extension : { ".ecm", ".zst" })
+	{
+		if (file != nullptr)
+		{
+			break;
+		}
+		imagePath = fs::path(path) += extension;
+		file = OpenScopedFile(imagePath, "rb");
+	}
+
+	if (file == nullptr)
+	{
+		return nullptr;
+	}
+
+	if (ecm::IsEcmFile(file.get()))
+	{
+		auto source = std::make_unique<EcmSectorSource>();
+		if (!source->Open(std::move(file)))
+		{
+			report::Error("", "\"%s\" is not a valid ECM image.", imagePath.string().c_str());
+			return nullptr;
+		}
+		return source;
+	}
+
+	unsigned char magic[4];
+	const bool isZstd = SeekFile(file.get(), 0, SEEK_SET) == 0 && fread(magic, sizeof(magic), 1, file.get()) == 1 &&
+		ReadLE32(magic) == ZSTD_FRAME_MAGIC;
+
+	const int64_t fileSize = GetSize(imagePath);
+	if (isZstd)
+	{
+#ifdef MKPSXISO_ZSTD
+		auto source = std::make_unique<ZstdSectorSource>();
+		if (!source->Open(std::move(file), fileSize))
+		{
+			report::Error("", "\"%s\" is not a seekable zstd image, compress it with a seek table (e.g. using t2sz).", imagePath.string().c_str());
+			return nullptr;
+		}
+		return source;
+#else
+		report::Error("", "\"%s\" is compressed with zstd, which this build does not support.", imagePath.string().c_str());
+		return nullptr;
+#endif
+	}
+
+	return std::make_unique<RawSectorSource>(std::move(file), fileSize, imagePath);
+}
+
+int64_t cd::GetImageSize(const fs::path& path)
+{
+	std::unique_ptr<SectorSource> source = OpenSectorSource(path);
+	return source != nullptr ? static_cast<int64_t>(source->GetSize()) : -1;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "common.h"
+#include <memory>
+
+namespace cd {
+
+	// Source of the raw 2352 byte sectors of an image, hiding how the image is stored
+	class SectorSource
+	{
+	public:
+		virtual ~SectorSource() = default;
+
+		// Size of the image in bytes
+		virtual uint64_t GetSize() const = 0;
+
+		// Reads a whole sector, returns false past the end of the image or on read errors
+		virtual bool ReadSector(unsigned int sector, unsigned char* buffer) = 0;
+
+		// Copies bytes of the image to the current position of a file without reading them in, if the
+		// image is stored in a way that allows it. Returns the number of bytes copied, 0 if it cannot,
+		// or -1 if the file was left at an unknown position, see CopyFileRange().
+		virtual int64_t CopyBytes(uint64_t /*offset*/, uint64_t /*size*/, FILE* /*output*/)
+		{
+			return 0;
+		}
+
+		// Path of the image if it is stored as a plain file, which can be memory mapped; empty otherwise
+		virtual fs::path GetPlainFilePath() const
+		{
+			return {};
+		}
+	};
+
+	// Opens an image as a plain BIN file, an ECM file or a seekable zstd file (if built with zstd
+	// support), telling them apart by their contents. If the file does not exist, <file>.ecm and
+	// <file>.zst are tried instead, so cue sheets can keep referring to the uncompressed name.
+	//
+	// Returns: Null if no image can be opened, an error is printed for invalid compressed images.
+	std::unique_ptr<SectorSource> OpenSectorSource(const fs::path& path);
+
+	// Returns the uncompressed size of an image opened like OpenSectorSource() does, or -1
+	int64_t GetImageSize(const fs::path& path);
+
+}
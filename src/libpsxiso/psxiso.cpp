@@ -0,0 +1,732 @@
+#include "psxiso.h"
+#include "psxiso_c.h"
+#include "cdreader.h"
+#include "iso.h"
+#include "report.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <new>
+
+static cd::ISO_DATESTAMP GetVolumeDate(time_t buildTime)
+{
+	const tm imageTime = *localtime( &buildTime );
+
+	cd::ISO_DATESTAMP volumeDate;
+	volumeDate.year = imageTime.tm_year;
+	volumeDate.month = imageTime.tm_mon + 1;
+	volumeDate.day = imageTime.tm_mday;
+	volumeDate.hour = imageTime.tm_hour;
+	volumeDate.minute = imageTime.tm_min;
+	volumeDate.second = imageTime.tm_sec;
+	volumeDate.GMToffs = static_cast<signed char>(-SYSTEM_TIMEZONE / 60 / 15); // Seconds to 15-minute units
+	return volumeDate;
+}
+
+static bool SetError(std::string* error, std::string message)
+{
+	if (error != nullptr)
+	{
+		*error = std::move(message);
+	}
+	return false;
+}
+
+// Collects the errors the builder and reader report on their own, which the tools print
+class ErrorCapture
+{
+public:
+	ErrorCapture()
+		: m_handler([this](const std::string& message)
+			{
+				if (m_message.empty())
+				{
+					m_message = message;
+				}
+			})
+	{
+	}
+
+	// Adds the first reported error to the description of a failure
+	void AppendTo(std::string& error) const
+	{
+		if (!m_message.empty())
+		{
+			error = error.empty() ? m_message : error + ": " + m_message;
+		}
+	}
+
+private:
+	std::string m_message;
+	report::ScopedHandler m_handler;
+};
+
+static const char* OptionalString(const std::string& str)
+{
+	return !str.empty() ? str.c_str() : nullptr;
+}
+
+// Lays out a project and writes it to the output opened by createOutput, which receives the size of the image in sectors
+static bool LayOutAndWrite(const psxiso::Project& project, const psxiso::Settings& settings, std::string* error,
+	const std::function<bool(cd::IsoWriter&, unsigned int)>& createOutput)
+{
+	using namespace psxiso;
+
+	iso::Settings isoSettings;
+	isoSettings.BuildTime = settings.buildTime != 0 ? settings.buildTime : time(nullptr);
+	isoSettings.new_type = settings.newType;
+	isoSettings.noXA = settings.noXA;
+	isoSettings.QuietMode = settings.quiet;
+	isoSettings.noWarns = settings.noWarns;
+
+	const cd::ISO_DATESTAMP volumeDate = GetVolumeDate(isoSettings.BuildTime);
+
+	// Same format as the creation dates of XML projects
+	char dateBuffer[20];
+	snprintf(dateBuffer, sizeof(dateBuffer), "%04u%02hhu%02hhu%02hhu%02hhu%02hhu00%+hhd",
+			volumeDate.year + 1900, volumeDate.month, volumeDate.day,
+			volumeDate.hour, volumeDate.minute, volumeDate.second, volumeDate.GMToffs);
+
+	const Identifiers& ids = project.identifiers;
+	iso::IDENTIFIERS isoIdentifiers {};
+	isoIdentifiers.SystemID		= OptionalString(ids.systemID);
+	isoIdentifiers.VolumeID		= OptionalString(ids.volumeID);
+	isoIdentifiers.VolumeSet	= OptionalString(ids.volumeSet);
+	isoIdentifiers.Publisher	= OptionalString(ids.publisher);
+	isoIdentifiers.DataPreparer	= OptionalString(ids.dataPreparer);
+	isoIdentifiers.Application	= OptionalString(ids.application);
+	isoIdentifiers.Copyright	= OptionalString(ids.copyright);
+	isoIdentifiers.CreationDate	= dateBuffer;
+
+	const EntryAttributes attributes;
+	iso::EntryList entries;
+	iso::DIRENTRY& root = iso::DirTreeClass::CreateRootDirectory(entries, volumeDate, attributes, isoSettings);
+	iso::DirTreeClass* dirTree = root.subdir.get();
+
+	for (const ProjectFile& file : project.files)
+	{
+		if (file.type != FileType::Data && file.type != FileType::Mixed)
+		{
+			return SetError(error, "Unsupported type of file \"" + file.path + "\"");
+		}
+
+		const fs::path srcFile(file.source);
+
+		// Implicit directories take their date stamp from the folder of the first file put in them
+		iso::DirTreeClass* dir = dirTree;
+		std::string_view path(file.path);
+		size_t separator;
+		while ((separator = path.find_first_of("/\\")) != std::string_view::npos)
+		{
+			if (separator != 0)
+			{
+				const std::string name(path.substr(0, separator));
+				bool alreadyExists = false;
+				dir = dir->AddSubDirEntry(name.c_str(), srcFile.parent_path(), attributes, alreadyExists);
+				if (dir == nullptr)
+				{
+					return SetError(error, "Cannot add directory \"" + name + "\"");
+				}
+			}
+			path.remove_prefix(separator + 1);
+		}
+
+		if (path.empty())
+		{
+			return SetError(error, "Missing file name in \"" + file.path + "\"");
+		}
+
+		const std::string name(path);
+		if (!dir->AddFileEntry(name.c_str(), file.type == FileType::Mixed ? EntryType::EntryXA : EntryType::EntryFile, srcFile, attributes))
+		{
+			return SetError(error, "Cannot add file \"" + file.path + "\"");
+		}
+	}
+
+	// 16 license sectors + 2 header sectors
+	const int rootLBA = 18+(GetSizeInSectors(dirTree->CalculatePathTableLen(root))*4);
+
+	if (settings.dedup)
+	{
+		uint32_t savedSectors;
+		iso::DeduplicateFiles(entries, savedSectors);
+	}
+
+	dirTree->SortDirectoryEntries(isoSettings.new_type.value_or(false));
+	const int totalLenLBA = dirTree->CalculateTreeLBA(rootLBA);
+
+	cd::IsoWriter writer;
+	if (!createOutput(writer, totalLenLBA))
+	{
+		return false;
+	}
+
+	// System area and file system first, then the files in LBA order
+	if (!project.licenseFile.empty())
+	{
+		auto license = std::make_unique<cd::ISO_LICENSE>();
+		unique_file fp = OpenScopedFile(fs::path(project.licenseFile), "rb");
+		if (fp == nullptr || fread(license->data, sizeof(license->data), 1, fp.get()) != 1)
+		{
+			return SetError(error, "Cannot read license file \"" + project.licenseFile + "\"");
+		}
+		iso::WriteLicenseData(&writer, license->data, false);
+	}
+	else
+	{
+		auto appBlankSectors = writer.GetSectorViewM2F1(0, 16, cd::IsoWriter::EdcEccForm::Form2);
+		appBlankSectors->WriteBlankSectors(16);
+	}
+
+	iso::WriteDescriptor(&writer, isoIdentifiers, root, totalLenLBA);
+	dirTree->WriteDirectoryRecords(&writer, root, isoSettings.new_type.value_or(false) ? dirTree->GetDirCountTotal() : 0);
+
+	if (!dirTree->WriteFiles(&writer))
+	{
+		return SetError(error, "Cannot write the files of the image");
+	}
+
+	if (!writer.Close())
+	{
+		return SetError(error, "Cannot write the image to the output");
+	}
+	return true;
+}
+
+static bool WriteImage(const psxiso::Project& project, const psxiso::Settings& settings, std::string* error,
+	const std::function<bool(cd::IsoWriter&, unsigned int)>& createOutput)
+{
+	ErrorCapture capture;
+	if (LayOutAndWrite(project, settings, error, createOutput))
+	{
+		return true;
+	}
+
+	if (error != nullptr)
+	{
+		capture.AppendTo(*error);
+	}
+	return false;
+}
+
+bool psxiso::BuildImage(const Project& project, const std::string& imagePath, const Settings& settings, std::string* error)
+{
+	return WriteImage(project, settings, error, [&](cd::IsoWriter& writer, unsigned int sizeLBA)
+		{
+			cd::MappingOptions options;
+			options.windowLBA = static_cast<unsigned int>(static_cast<uint64_t>(settings.maxMappedMB) * 1024 * 1024 / CD_SECTOR_SIZE);
+			options.writeback = settings.writeback || settings.durable;
+			options.durable = settings.durable;
+			if (!writer.Create(fs::path(imagePath), sizeLBA, settings.xaEdc, options))
+			{
+				return SetError(error, "Cannot open or create output image file \"" + imagePath + "\"");
+			}
+			return true;
+		});
+}
+
+bool psxiso::BuildImage(const Project& project, std::vector<unsigned char>& image, const Settings& settings, std::string* error)
+{
+	return WriteImage(project, settings, error, [&](cd::IsoWriter& writer, unsigned int sizeLBA)
+		{
+			image.resize(static_cast<size_t>(sizeLBA) * CD_SECTOR_SIZE);
+			return writer.CreateInMemory(image.data(), sizeLBA, settings.xaEdc);
+		});
+}
+
+bool psxiso::BuildImage(const Project& project, FILE* stream, const Settings& settings, std::string* error)
+{
+	return WriteImage(project, settings, error, [&](cd::IsoWriter& writer, unsigned int sizeLBA)
+		{
+			return settings.ecm ? writer.CreateEcm(stream, sizeLBA, settings.xaEdc) : writer.CreateStream(stream, sizeLBA, settings.xaEdc);
+		});
+}
+
+struct psxiso::Image::State
+{
+	cd::IsoReader reader;
+	std::vector<ImageEntry> entries;
+	std::string error;
+};
+
+psxiso::Image::Image()
+	: m_state(std::make_unique<State>())
+{
+}
+
+psxiso::Image::~Image() = default;
+
+static psxiso::FileType GetFileType(EntryType type)
+{
+	switch (type)
+	{
+	case EntryType::EntryDir:
+		return psxiso::FileType::Directory;
+	case EntryType::EntryXA:
+	case EntryType::EntryXA_DO:
+		return psxiso::FileType::Mixed;
+	case EntryType::EntryDA:
+		return psxiso::FileType::Audio;
+	default:
+		return psxiso::FileType::Data;
+	}
+}
+
+static void ReadDirectory(cd::IsoReader& reader, ListView<cd::IsoDirEntries::Entry> view, int lba, int sectors,
+	const std::string& path, std::vector<psxiso::ImageEntry>& result, int depth)
+{
+	cd::IsoDirEntries dirEntries(std::move(view));
+	dirEntries.ReadDirEntries(&reader, lba, sectors, false);
+
+	for (auto& e : dirEntries.dirEntryList.GetView())
+	{
+		const auto& entry = e.get();
+
+		psxiso::ImageEntry& imageEntry = result.emplace_back();
+		imageEntry.path = path + CleanIdentifier(entry.identifier);
+		imageEntry.lba = entry.entry.entryOffs.lsb;
+		imageEntry.size = entry.entry.entrySize.lsb;
+		imageEntry.type = (entry.entry.flags & 0x2) ? psxiso::FileType::Directory : GetFileType(entry.type);
+
+		// Guard against directory records pointing back up the tree
+		if (imageEntry.type == psxiso::FileType::Directory && depth < 8)
+		{
+			ReadDirectory(reader, dirEntries.dirEntryList.NewView(), imageEntry.lba, GetSizeInSectors(imageEntry.size),
+				imageEntry.path + '/', result, depth + 1);
+		}
+	}
+}
+
+bool psxiso::Image::Open(const std::string& imagePath)
+{
+	m_state->entries.clear();
+	ErrorCapture capture;
+	if (!m_state->reader.Open(fs::path(imagePath)))
+	{
+		m_state->error = "Cannot open image \"" + imagePath + "\"";
+		capture.AppendTo(m_state->error);
+		return false;
+	}
+
+	cd::ISO_DESCRIPTOR descriptor;
+	if (!m_state->reader.SeekToSector(16) || m_state->reader.ReadBytes(&descriptor, F1_DATA_SIZE) != F1_DATA_SIZE ||
+		memcmp(descriptor.header.id, "CD001", 5) != 0)
+	{
+		m_state->error = "No ISO9660 file system in \"" + imagePath + "\"";
+		return false;
+	}
+
+	std::list<cd::IsoDirEntries::Entry> entries;
+	cd::IsoDirEntries rootDir{ListView(entries)};
+	rootDir.ReadRootDir(&m_state->reader, descriptor.rootDirRecord.entryOffs.lsb);
+	if (rootDir.dirEntryList.GetView().empty())
+	{
+		m_state->error = "Root directory is empty or invalid";
+		return false;
+	}
+
+	const auto& root = rootDir.dirEntryList.GetView().front().get();
+	ReadDirectory(m_state->reader, rootDir.dirEntryList.NewView(), root.entry.entryOffs.lsb, GetSizeInSectors(root.entry.entrySize.lsb),
+		std::string(), m_state->entries, 0);
+
+	std::stable_sort(m_state->entries.begin(), m_state->entries.end(), [](const ImageEntry& left, const ImageEntry& right)
+		{
+			return left.lba < right.lba;
+		});
+	return true;
+}
+
+const std::vector<psxiso::ImageEntry>& psxiso::Image::GetEntries() const
+{
+	return m_state->entries;
+}
+
+const psxiso::ImageEntry* psxiso::Image::Find(std::string_view path) const
+{
+	while (!path.empty() && (path.front() == '/' || path.front() == '\\'))
+	{
+		path.remove_prefix(1);
+	}
+	if (path.ends_with(";1"))
+	{
+		path.remove_suffix(2);
+	}
+
+	for (const ImageEntry& entry : m_state->entries)
+	{
+		if (entry.path.length() != path.length())
+		{
+			continue;
+		}
+		if (std::equal(path.begin(), path.end(), entry.path.begin(), [](char left, char right)
+			{
+				if (left == '\\') left = '/';
+				return std::toupper(static_cast<unsigned char>(left)) == std::toupper(static_cast<unsigned char>(right));
+			}))
+		{
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+bool psxiso::Image::ReadFile(const ImageEntry& entry, std::vector<unsigned char>& data)
+{
+	if (entry.type == FileType::Directory || entry.type == FileType::Audio)
+	{
+		m_state->error = "\"" + entry.path + "\" is not a data file";
+		return false;
+	}
+	if (!m_state->reader.SeekToSector(entry.lba))
+	{
+		m_state->error = "\"" + entry.path + "\" is outside of the image";
+		return false;
+	}
+
+	if (entry.type == FileType::Mixed)
+	{
+		data.resize(static_cast<size_t>(GetSizeInSectors(entry.size)) * XA_DATA_SIZE);
+		data.resize(m_state->reader.ReadBytesXA(data.data(), data.size()));
+	}
+	else
+	{
+		data.resize(entry.size);
+		data.resize(m_state->reader.ReadBytes(data.data(), data.size()));
+	}
+	return true;
+}
+
+const std::string& psxiso::Image::GetError() const
+{
+	return m_state->error;
+}
+
+// C interface
+
+struct psxiso_project
+{
+	psxiso::Project project;
+	psxiso::Settings settings;
+	std::string error;
+};
+
+struct psxiso_image
+{
+	psxiso::Image image;
+	std::string error;
+};
+
+// Stores an error message without letting an allocation failure escape to the caller
+static void SetErrorNoThrow(std::string* error, const char* message) noexcept
+{
+	if (error == nullptr)
+	{
+		return;
+	}
+	try
+	{
+		*error = message;
+	}
+	catch (...)
+	{
+		error->clear();
+	}
+}
+
+// No exception may propagate through the C interface, so every function body is run here and
+// an exception turns into the failure value, with its description stored in the handle
+template<typename Result, typename Function>
+static Result CatchExceptions(std::string* error, Result failure, Function&& function) noexcept
+{
+	try
+	{
+		return function();
+	}
+	catch (const std::bad_alloc&)
+	{
+		SetErrorNoThrow(error, "Out of memory");
+	}
+	catch (const std::exception& e)
+	{
+		SetErrorNoThrow(error, e.what());
+	}
+	catch (...)
+	{
+		SetErrorNoThrow(error, "Unknown error");
+	}
+	return failure;
+}
+
+static psxiso::FileType ToFileType(psxiso_file_type type)
+{
+	switch (type)
+	{
+	case PSXISO_FILE_MIXED:
+		return psxiso::FileType::Mixed;
+	case PSXISO_FILE_DIRECTORY:
+		return psxiso::FileType::Directory;
+	case PSXISO_FILE_AUDIO:
+		return psxiso::FileType::Audio;
+	default:
+		return psxiso::FileType::Data;
+	}
+}
+
+psxiso_project* psxiso_project_create(void)
+{
+	return CatchExceptions<psxiso_project*>(nullptr, nullptr, []
+		{
+			return new psxiso_project;
+		});
+}
+
+void psxiso_project_destroy(psxiso_project* project)
+{
+	delete project;
+}
+
+int psxiso_project_set_identifier(psxiso_project* project, psxiso_identifier id, const char* value)
+{
+	return CatchExceptions(&project->error, -1, [&]
+		{
+			psxiso::Identifiers& ids = project->project.identifiers;
+			std::string* identifier = nullptr;
+			switch (id)
+			{
+			case PSXISO_ID_SYSTEM:			identifier = &ids.systemID; break;
+			case PSXISO_ID_VOLUME:			identifier = &ids.volumeID; break;
+			case PSXISO_ID_VOLUME_SET:		identifier = &ids.volumeSet; break;
+			case PSXISO_ID_PUBLISHER:		identifier = &ids.publisher; break;
+			case PSXISO_ID_DATA_PREPARER:	identifier = &ids.dataPreparer; break;
+			case PSXISO_ID_APPLICATION:		identifier = &ids.application; break;
+			case PSXISO_ID_COPYRIGHT:		identifier = &ids.copyright; break;
+			}
+
+			if (identifier == nullptr)
+			{
+				project->error = "Unknown identifier";
+				return -1;
+			}
+			*identifier = value != nullptr ? value : "";
+			return 0;
+		});
+}
+
+int psxiso_project_set_license(psxiso_project* project, const char* licenseFile)
+{
+	return CatchExceptions(&project->error, -1, [&]
+		{
+			project->project.licenseFile = licenseFile != nullptr ? licenseFile : "";
+			return 0;
+		});
+}
+
+int psxiso_project_set_build_time(psxiso_project* project, int64_t buildTime)
+{
+	project->settings.buildTime = static_cast<time_t>(buildTime);
+	return 0;
+}
+
+int psxiso_project_add_file(psxiso_project* project, const char* path, const char* source, psxiso_file_type type)
+{
+	return CatchExceptions(&project->error, -1, [&]
+		{
+			if (path == nullptr || source == nullptr)
+			{
+				project->error = "Missing path or source of file";
+				return -1;
+			}
+			project->project.files.push_back({ path, source, ToFileType(type) });
+			return 0;
+		});
+}
+
+int psxiso_project_build(psxiso_project* project, const char* imagePath)
+{
+	return CatchExceptions(&project->error, -1, [&]
+		{
+			project->error.clear();
+			if (imagePath == nullptr)
+			{
+				project->error = "Missing image path";
+				return -1;
+			}
+			return psxiso::BuildImage(project->project, imagePath, project->settings, &project->error) ? 0 : -1;
+		});
+}
+
+int psxiso_project_build_memory(psxiso_project* project, void** data, size_t* size)
+{
+	// The image is written straight into the buffer handed to the caller, so it is only held once
+	void* buffer = nullptr;
+	size_t bufferSize = 0;
+	const int result = CatchExceptions(&project->error, -1, [&]
+		{
+			project->error.clear();
+			const bool built = WriteImage(project->project, project->settings, &project->error, [&](cd::IsoWriter& writer, unsigned int sizeLBA)
+				{
+					bufferSize = static_cast<size_t>(sizeLBA) * CD_SECTOR_SIZE;
+					buffer = malloc(std::max<size_t>(bufferSize, 1));
+					if (buffer == nullptr)
+					{
+						return SetError(&project->error, "Out of memory");
+					}
+					return writer.CreateInMemory(buffer, sizeLBA, project->settings.xaEdc);
+				});
+			return built ? 0 : -1;
+		});
+
+	if (result != 0)
+	{
+		free(buffer);
+		return -1;
+	}
+	*data = buffer;
+	*size = bufferSize;
+	return 0;
+}
+
+const char* psxiso_project_error(const psxiso_project* project)
+{
+	return project->error.c_str();
+}
+
+psxiso_image* psxiso_image_create(void)
+{
+	return CatchExceptions<psxiso_image*>(nullptr, nullptr, []
+		{
+			return new psxiso_image;
+		});
+}
+
+void psxiso_image_destroy(psxiso_image* image)
+{
+	delete image;
+}
+
+int psxiso_image_open(psxiso_image* image, const char* imagePath)
+{
+	return CatchExceptions(&image->error, -1, [&]
+		{
+			image->error.clear();
+			if (imagePath == nullptr)
+			{
+				image->error = "Missing image path";
+				return -1;
+			}
+			if (!image->image.Open(imagePath))
+			{
+				image->error = image->image.GetError();
+				return -1;
+			}
+			return 0;
+		});
+}
+
+// Returns nullptr if the index is past the entries of the image
+static const psxiso::ImageEntry* GetEntry(const psxiso_image* image, size_t index)
+{
+	const std::vector<psxiso::ImageEntry>& entries = image->image.GetEntries();
+	return index < entries.size() ? &entries[index] : nullptr;
+}
+
+size_t psxiso_image_entry_count(const psxiso_image* image)
+{
+	return image->image.GetEntries().size();
+}
+
+const char* psxiso_image_entry_path(const psxiso_image* image, size_t index)
+{
+	const psxiso::ImageEntry* entry = GetEntry(image, index);
+	return entry != nullptr ? entry->path.c_str() : nullptr;
+}
+
+uint32_t psxiso_image_entry_lba(const psxiso_image* image, size_t index)
+{
+	const psxiso::ImageEntry* entry = GetEntry(image, index);
+	return entry != nullptr ? entry->lba : 0;
+}
+
+uint32_t psxiso_image_entry_size(const psxiso_image* image, size_t index)
+{
+	const psxiso::ImageEntry* entry = GetEntry(image, index);
+	return entry != nullptr ? entry->size : 0;
+}
+
+psxiso_file_type psxiso_image_entry_type(const psxiso_image* image, size_t index)
+{
+	const psxiso::ImageEntry* entry = GetEntry(image, index);
+	if (entry == nullptr)
+	{
+		return PSXISO_FILE_INVALID;
+	}
+
+	switch (entry->type)
+	{
+	case psxiso::FileType::Mixed:
+		return PSXISO_FILE_MIXED;
+	case psxiso::FileType::Directory:
+		return PSXISO_FILE_DIRECTORY;
+	case psxiso::FileType::Audio:
+		return PSXISO_FILE_AUDIO;
+	default:
+		return PSXISO_FILE_DATA;
+	}
+}
+
+ptrdiff_t psxiso_image_find(const psxiso_image* image, const char* path)
+{
+	if (path == nullptr)
+	{
+		return -1;
+	}
+	return CatchExceptions<ptrdiff_t>(nullptr, -1, [&]
+		{
+			const psxiso::ImageEntry* entry = image->image.Find(path);
+			return entry != nullptr ? entry - image->image.GetEntries().data() : -1;
+		});
+}
+
+int psxiso_image_read_file(psxiso_image* image, size_t index, void** data, size_t* size)
+{
+	return CatchExceptions(&image->error, -1, [&]
+		{
+			image->error.clear();
+			const psxiso::ImageEntry* entry = GetEntry(image, index);
+			if (entry == nullptr)
+			{
+				image->error = "Entry index out of range";
+				return -1;
+			}
+
+			std::vector<unsigned char> contents;
+			if (!image->image.ReadFile(*entry, contents))
+			{
+				image->error = image->image.GetError();
+				return -1;
+			}
+
+			void* buffer = malloc(std::max<size_t>(contents.size(), 1));
+			if (buffer == nullptr)
+			{
+				image->error = "Out of memory";
+				return -1;
+			}
+			memcpy(buffer, contents.data(), contents.size());
+			*data = buffer;
+			*size = contents.size();
+			return 0;
+		});
+}
+
+const char* psxiso_image_error(const psxiso_image* image)
+{
+	return image->error.c_str();
+}
+
+void psxiso_free(void* data)
+{
+	free(data);
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Library interface to the image builder and reader used by mkpsxiso and dumpsxiso, for tools
+// which generate or inspect images without going through an XML project and a child process.
+// Only the standard library is exposed, paths are UTF-8 strings.
+namespace psxiso
+{
+
+/// Options of an image build, the same as the matching mkpsxiso command line options
+struct Settings
+{
+	time_t buildTime = 0;			/// Date stamp of the volume and all entries, the current time if 0
+	std::optional<bool> newType;	/// Layout of the newer mastering tool, see the new_type track attribute
+	bool noXA = false;				/// Plain ISO9660 without CD-XA extended attributes
+	bool xaEdc = true;				/// Calculate EDC of Mode 2 Form 2 sectors
+	bool quiet = true;				/// Suppress progress output, errors are returned rather than printed
+	bool noWarns = true;			/// Suppress warnings
+	bool ecm = false;				/// Write an ECM file instead of a BIN, only for stream builds
+	bool dedup = false;				/// Store files with identical contents once
+	unsigned int maxMappedMB = 0;	/// Most memory mapped at once when writing an image file, 0 for no limit
+	bool writeback = false;			/// Start writing an image file to disk while it is being built
+	bool durable = false;			/// Wait for an image file to reach the disk before returning
+};
+
+/// Volume identifiers, empty strings are left blank
+struct Identifiers
+{
+	std::string systemID = "PLAYSTATION";
+	std::string volumeID;
+	std::string volumeSet;
+	std::string publisher;
+	std::string dataPreparer;
+	std::string application = "PLAYSTATION";
+	std::string copyright;
+};
+
+enum class FileType
+{
+	Data,		/// Mode 2 Form 1 file, 2048 bytes per sector
+	Mixed,		/// XA or STR stream ripped at 2336 bytes per sector
+	Directory,
+	Audio,		/// CD-DA file, only reported when reading images
+};
+
+/// A file to put on the disc, directories on its path are created as needed
+struct ProjectFile
+{
+	std::string path;		/// Path on the disc with forward slashes, e.g. DATA/LEVEL1.BIN
+	std::string source;		/// Source file on the host
+	FileType type = FileType::Data;
+};
+
+struct Project
+{
+	Identifiers identifiers;
+	std::string licenseFile;	/// Optional license data to put in the first 16 sectors
+	std::vector<ProjectFile> files;
+};
+
+/** Builds a single track data image from a project. Files are laid out in the same order
+ *	mkpsxiso uses for an equivalent XML project.
+ *
+ *	project		- Files and identifiers of the image.
+ *	imagePath	- Path of the BIN file to write.
+ *	settings	- Build options.
+ *	error		- If not null, receives a description of the failure.
+ *
+ *	Returns: False if the image could not be built.
+ */
+bool BuildImage(const Project& project, const std::string& imagePath, const Settings& settings, std::string* error = nullptr);
+
+/** Builds an image in memory, without any disk I/O besides reading the source files.
+ *
+ *	image		- Receives the image, resized to fit it.
+ */
+bool BuildImage(const Project& project, std::vector<unsigned char>& image, const Settings& settings, std::string* error = nullptr);
+
+/** Builds an image and writes it sequentially to a stream, such as stdout or a pipe. Only the
+ *	file system and a window of sectors are kept in memory. Images are written as ECM files if
+ *	requested in the settings, Image::Open() reads those too.
+ *
+ *	stream		- Stream opened for binary writing, not closed.
+ */
+bool BuildImage(const Project& project, FILE* stream, const Settings& settings, std::string* error = nullptr);
+
+/// An entry of the file system of an image
+struct ImageEntry
+{
+	std::string path;		/// Path on the disc with forward slashes and without the ;1 version suffix
+	uint32_t lba = 0;
+	uint32_t size = 0;		/// Size of the entry as recorded in its directory record
+	FileType type = FileType::Data;
+};
+
+/// Read access to the file system of an image
+class Image
+{
+public:
+	Image();
+	~Image();
+
+	/** Opens an image and reads its directory tree.
+	 *
+	 *	Returns: False if the image cannot be opened or has no valid file system.
+	 */
+	bool Open(const std::string& imagePath);
+
+	/** Returns all entries in the image, sorted by LBA.
+	 */
+	const std::vector<ImageEntry>& GetEntries() const;
+
+	/** Looks up an entry by its path on the disc, case insensitively. The ;1 version suffix
+	 *	and a leading slash are optional.
+	 *
+	 *	Returns: The entry, or null if there is none.
+	 */
+	const ImageEntry* Find(std::string_view path) const;
+
+	/** Reads the contents of a file. Data files are read at 2048 bytes per sector, mixed
+	 *	files at 2336 bytes per sector like dumpsxiso extracts them.
+	 *
+	 *	Returns: False for directories, audio files and entries outside of the image.
+	 */
+	bool ReadFile(const ImageEntry& entry, std::vector<unsigned char>& data);
+
+	/** Returns a description of the last failure.
+	 */
+	const std::string& GetError() const;
+
+private:
+	struct State;
+	std::unique_ptr<State> m_state;
+};
+
+}
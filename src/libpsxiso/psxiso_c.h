@@ -0,0 +1,78 @@
+#ifndef PSXISO_C_H
+#define PSXISO_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* C interface to libpsxiso, for use from other languages through their FFI. All strings are
+ * UTF-8, functions returning int return 0 on success and -1 on failure, in which case the
+ * error can be retrieved from the handle. No function lets a C++ exception escape, and the
+ * create functions return NULL only when the handle cannot be allocated. */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct psxiso_project psxiso_project;
+typedef struct psxiso_image psxiso_image;
+
+typedef enum
+{
+	PSXISO_FILE_INVALID = -1,
+	PSXISO_FILE_DATA,
+	PSXISO_FILE_MIXED,
+	PSXISO_FILE_DIRECTORY,
+	PSXISO_FILE_AUDIO
+} psxiso_file_type;
+
+typedef enum
+{
+	PSXISO_ID_SYSTEM,
+	PSXISO_ID_VOLUME,
+	PSXISO_ID_VOLUME_SET,
+	PSXISO_ID_PUBLISHER,
+	PSXISO_ID_DATA_PREPARER,
+	PSXISO_ID_APPLICATION,
+	PSXISO_ID_COPYRIGHT
+} psxiso_identifier;
+
+/* Projects */
+psxiso_project* psxiso_project_create(void);
+void psxiso_project_destroy(psxiso_project* project);
+
+int psxiso_project_set_identifier(psxiso_project* project, psxiso_identifier id, const char* value);
+int psxiso_project_set_license(psxiso_project* project, const char* licenseFile);
+int psxiso_project_set_build_time(psxiso_project* project, int64_t buildTime);
+int psxiso_project_add_file(psxiso_project* project, const char* path, const char* source, psxiso_file_type type);
+
+/* Writes the project as a single track data image */
+int psxiso_project_build(psxiso_project* project, const char* imagePath);
+/* Builds the image in memory, to be released with psxiso_free */
+int psxiso_project_build_memory(psxiso_project* project, void** data, size_t* size);
+const char* psxiso_project_error(const psxiso_project* project);
+
+/* Images, the error of a failed psxiso_image_open is kept in the handle */
+psxiso_image* psxiso_image_create(void);
+void psxiso_image_destroy(psxiso_image* image);
+int psxiso_image_open(psxiso_image* image, const char* imagePath);
+
+/* An index past the entries returns NULL, 0 or PSXISO_FILE_INVALID */
+size_t psxiso_image_entry_count(const psxiso_image* image);
+const char* psxiso_image_entry_path(const psxiso_image* image, size_t index);
+uint32_t psxiso_image_entry_lba(const psxiso_image* image, size_t index);
+uint32_t psxiso_image_entry_size(const psxiso_image* image, size_t index);
+psxiso_file_type psxiso_image_entry_type(const psxiso_image* image, size_t index);
+
+/* Returns the index of an entry by its path on the disc, or -1 if there is none */
+ptrdiff_t psxiso_image_find(const psxiso_image* image, const char* path);
+
+/* Reads a file into a buffer allocated with malloc, to be released with psxiso_free */
+int psxiso_image_read_file(psxiso_image* image, size_t index, void** data, size_t* size);
+const char* psxiso_image_error(const psxiso_image* image);
+
+void psxiso_free(void* data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
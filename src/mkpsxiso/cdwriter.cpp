@@ -1,7 +1,11 @@
 #include "cdwriter.h"
 #include "common.h"
 #include "edcecc.h"
-#include "global.h"
+#include "platform.h"
+#include "profiler.h"
+#include "report.h"
+#include <array>
+#include <map>
 
 using namespace cd;
 
@@ -15,36 +19,619 @@ ISO_UINT_PAIR cd::SetPair32(unsigned int val) {
 	return { val, SwapBytes32(val) };
 }
 
-bool IsoWriter::Create(const fs::path& fileName, unsigned int sizeLBA)
+// ======================================================
+
+// Sectors are collected into batches, one batch is hashed while the next one is filled
+class IsoWriter::TrackHasher
+{
+public:
+	TrackHasher(std::vector<unsigned int> trackLBAs)
+		: m_trackLBAs(std::move(trackLBAs)), m_digesters(m_trackLBAs.size())
+	{
+		m_batch.reserve(static_cast<size_t>(BATCH_LBA) * CD_SECTOR_SIZE);
+	}
+
+	~TrackHasher()
+	{
+		if (m_job.valid())
+		{
+			m_job.wait();
+		}
+	}
+
+	// Next sector to be hashed
+	unsigned int GetLBA() const { return m_batchLBA + static_cast<unsigned int>(m_batch.size() / CD_SECTOR_SIZE); }
+
+	void Hash(const unsigned char* data, unsigned int count)
+	{
+		while (count > 0)
+		{
+			const unsigned int toCopy = std::min<unsigned int>(count, BATCH_LBA - static_cast<unsigned int>(m_batch.size() / CD_SECTOR_SIZE));
+			m_batch.insert(m_batch.end(), data, data + static_cast<size_t>(toCopy) * CD_SECTOR_SIZE);
+			data += static_cast<size_t>(toCopy) * CD_SECTOR_SIZE;
+			count -= toCopy;
+
+			if (m_batch.size() == static_cast<size_t>(BATCH_LBA) * CD_SECTOR_SIZE)
+			{
+				Flush();
+			}
+		}
+	}
+
+	std::vector<hash::Digests> Finish()
+	{
+		Flush();
+		if (m_job.valid())
+		{
+			m_job.get();
+		}
+
+		std::vector<hash::Digests> digests;
+		for (hash::Digester& digester : m_digesters)
+		{
+			digests.push_back(digester.Finish());
+		}
+		return digests;
+	}
+
+private:
+	static constexpr unsigned int BATCH_LBA = 4096;
+
+	void Flush()
+	{
+		if (m_batch.empty())
+		{
+			return;
+		}
+
+		if (m_job.valid())
+		{
+			m_job.get();
+		}
+		m_hashing.swap(m_batch);
+		m_batch.clear();
+
+		m_job = std::async(std::launch::async, [this, lba = m_batchLBA]() mutable
+			{
+				profiler::Scope scope("hash sectors");
+				const unsigned char* data = m_hashing.data();
+				unsigned int count = static_cast<unsigned int>(m_hashing.size() / CD_SECTOR_SIZE);
+				for (unsigned int sectors; count > 0; data += static_cast<size_t>(sectors) * CD_SECTOR_SIZE, count -= sectors, lba += sectors)
+				{
+					const size_t track = std::upper_bound(m_trackLBAs.begin() + 1, m_trackLBAs.end(), lba) - m_trackLBAs.begin() - 1;
+					const unsigned int trackEndLBA = track + 1 < m_trackLBAs.size() ? m_trackLBAs[track + 1] : UINT_MAX;
+					sectors = std::min(count, trackEndLBA - lba);
+					m_digesters[track].Update(data, static_cast<size_t>(sectors) * CD_SECTOR_SIZE);
+				}
+			});
+		m_batchLBA += static_cast<unsigned int>(m_hashing.size() / CD_SECTOR_SIZE);
+	}
+
+	const std::vector<unsigned int> m_trackLBAs;
+	std::vector<hash::Digester> m_digesters;
+	std::vector<unsigned char> m_batch;		// Sectors being collected, starting at m_batchLBA
+	std::vector<unsigned char> m_hashing;	// Sectors being hashed by m_job
+	unsigned int m_batchLBA = 0;
+	std::future<void> m_job;
+};
+
+// ======================================================
+
+class MappedRange final : public IsoWriter::OutputRange
+{
+public:
+	MappedRange(const MMappedFile& mmap, unsigned int offsetLBA, unsigned int sizeLBA, unsigned int windowLBA, bool writeback)
+		: m_mmap(mmap), m_windowLBA(offsetLBA), m_rangeEndLBA(offsetLBA + sizeLBA), m_writeback(writeback)
+		, m_view(MapWindow(mmap, offsetLBA, std::min(sizeLBA, windowLBA)))
+	{
+		m_buffer = m_view.GetBuffer();
+		m_windowSize = windowLBA;
+	}
+
+	void NextWindow() override
+	{
+		// Hand the dirty pages of the finished window over to writeback, instead of letting them pile up until the range is done
+		m_view.Evict();
+
+		const unsigned int nextWindowLBA = std::min(m_windowLBA + m_windowSize, m_rangeEndLBA);
+		if (m_writeback)
+		{
+			m_mmap.StartWriteback(static_cast<uint64_t>(m_windowLBA) * CD_SECTOR_SIZE, static_cast<uint64_t>(nextWindowLBA - m_windowLBA) * CD_SECTOR_SIZE);
+		}
+
+		m_windowLBA = nextWindowLBA;
+		m_view = MapWindow(m_mmap, m_windowLBA, std::min(m_rangeEndLBA - m_windowLBA, m_windowSize));
+		m_buffer = m_view.GetBuffer();
+	}
+
+private:
+	static MMappedFile::View MapWindow(const MMappedFile& mmap, unsigned int offsetLBA, unsigned int sizeLBA)
+	{
+		profiler::Scope scope("map view");
+		return mmap.GetView(static_cast<uint64_t>(offsetLBA) * CD_SECTOR_SIZE, static_cast<size_t>(sizeLBA) * CD_SECTOR_SIZE);
+	}
+
+	const MMappedFile& m_mmap;
+	unsigned int m_windowLBA;
+	const unsigned int m_rangeEndLBA;
+	const bool m_writeback;
+	MMappedFile::View m_view;
+};
+
+class MappedOutput final : public IsoWriter::Output
+{
+public:
+	MappedOutput(unsigned int sizeLBA, const MappingOptions& options)
+		: m_sizeLBA(sizeLBA), m_options(options)
+	{
+		if (m_options.windowLBA == 0)
+		{
+			m_options.windowLBA = UINT_MAX;
+		}
+	}
+
+	bool Create(const fs::path& fileName)
+	{
+		return m_mmap.Create(fileName, static_cast<uint64_t>(m_sizeLBA) * CD_SECTOR_SIZE);
+	}
+
+	bool Open(const fs::path& fileName)
+	{
+		return GetSize(fileName) == static_cast<int64_t>(m_sizeLBA) * CD_SECTOR_SIZE && m_mmap.OpenForWriting(fileName);
+	}
+
+	std::unique_ptr<IsoWriter::OutputRange> GetRange(unsigned int offsetLBA, unsigned int sizeLBA) override
+	{
+		return std::make_unique<MappedRange>(m_mmap, offsetLBA, sizeLBA, m_options.windowLBA, m_options.writeback);
+	}
+
+	void Commit(unsigned int lba) override
+	{
+		// Completed sectors are sent to disk in batches, so disk writes overlap with encoding the rest of the image
+		static constexpr unsigned int WRITEBACK_BATCH_LBA = 4096;
+
+		if (m_options.writeback && lba >= m_writebackLBA + WRITEBACK_BATCH_LBA)
+		{
+			StartWriteback(lba);
+		}
+
+		// Hashed while the pages are still cached, in batches as for writeback
+		if (m_hasher != nullptr && lba >= m_hasher->GetLBA() + WRITEBACK_BATCH_LBA)
+		{
+			HashSectors(lba);
+		}
+	}
+
+	bool Close() override
+	{
+		if (m_hasher != nullptr)
+		{
+			HashSectors(m_sizeLBA);
+		}
+		if (m_options.writeback)
+		{
+			StartWriteback(m_sizeLBA);
+		}
+		return !m_options.durable || m_mmap.Flush();
+	}
+
+private:
+	void StartWriteback(unsigned int lba)
+	{
+		m_mmap.StartWriteback(static_cast<uint64_t>(m_writebackLBA) * CD_SECTOR_SIZE, static_cast<uint64_t>(lba - m_writebackLBA) * CD_SECTOR_SIZE);
+		m_writebackLBA = lba;
+	}
+
+	void HashSectors(unsigned int lba)
+	{
+		for (unsigned int hashLBA = m_hasher->GetLBA(); hashLBA < lba; hashLBA = m_hasher->GetLBA())
+		{
+			const unsigned int sizeLBA = std::min(lba - hashLBA, m_options.windowLBA);
+			MMappedFile::View view = m_mmap.GetView(static_cast<uint64_t>(hashLBA) * CD_SECTOR_SIZE, static_cast<size_t>(sizeLBA) * CD_SECTOR_SIZE);
+			m_hasher->Hash(static_cast<const unsigned char*>(view.GetBuffer()), sizeLBA);
+		}
+	}
+
+	MMappedFile m_mmap;
+	const unsigned int m_sizeLBA;
+	MappingOptions m_options;
+	unsigned int m_writebackLBA = 0; // Sectors before it were already sent to disk
+};
+
+class MemoryRange final : public IsoWriter::OutputRange
+{
+public:
+	MemoryRange(void* buffer)
+	{
+		m_buffer = buffer;
+	}
+};
+
+class MemoryOutput final : public IsoWriter::Output
+{
+public:
+	MemoryOutput(void* buffer, unsigned int sizeLBA)
+		: m_buffer(static_cast<unsigned char*>(buffer)), m_sizeLBA(sizeLBA)
+	{
+		std::fill_n(m_buffer, static_cast<size_t>(sizeLBA) * CD_SECTOR_SIZE, 0);
+	}
+
+	std::unique_ptr<IsoWriter::OutputRange> GetRange(unsigned int offsetLBA, unsigned int /*sizeLBA*/) override
+	{
+		return std::make_unique<MemoryRange>(m_buffer + static_cast<size_t>(offsetLBA) * CD_SECTOR_SIZE);
+	}
+
+	void Commit(unsigned int lba) override
+	{
+		if (m_hasher != nullptr)
+		{
+			const unsigned int hashLBA = m_hasher->GetLBA();
+			lba = std::min(lba, m_sizeLBA);
+			if (lba > hashLBA)
+			{
+				m_hasher->Hash(m_buffer + static_cast<size_t>(hashLBA) * CD_SECTOR_SIZE, lba - hashLBA);
+			}
+		}
+	}
+
+	bool Close() override
+	{
+		Commit(m_sizeLBA);
+		return true;
+	}
+
+private:
+	unsigned char* m_buffer;
+	const unsigned int m_sizeLBA;
+};
+
+// Sends sectors out in LBA order, keeping the ones written ahead of the stream position in memory
+class StreamOutput final : public IsoWriter::Output
+{
+public:
+	StreamOutput(FILE* stream, unsigned int sizeLBA)
+		: m_stream(stream), m_sizeLBA(sizeLBA)
+	{
+	}
+
+	bool OpenEcm()
+	{
+		m_ecm = std::make_unique<ecm::Writer>();
+		return m_ecm->Open(m_stream);
+	}
+
+	std::unique_ptr<IsoWriter::OutputRange> GetRange(unsigned int offsetLBA, unsigned int sizeLBA) override;
+	void Commit(unsigned int lba) override;
+	bool Close() override;
+
+	// Fills a window of a range with the sectors written to it before, and zeroes for the others
+	void Load(unsigned char* data, unsigned int offsetLBA, unsigned int endLBA) const;
+	// Takes back the written sectors of a window
+	void Release(const unsigned char* data, const ecm::Type* types, unsigned int offsetLBA, unsigned int endLBA);
+
+private:
+	struct Sector
+	{
+		std::array<unsigned char, CD_SECTOR_SIZE> data;
+		ecm::Type type;
+	};
+
+	// Types may be null for raw sectors
+	void Write(const unsigned char* data, const ecm::Type* types, unsigned int count);
+	void WritePending();
+
+	FILE* m_stream;
+	const unsigned int m_sizeLBA;
+	unsigned int m_streamLBA = 0; // Next sector to be sent out
+	std::map<unsigned int, std::unique_ptr<Sector>> m_pending;
+	std::unique_ptr<ecm::Writer> m_ecm;
+	bool m_failed = false;
+};
+
+// Only one window of sectors is held at a time, each one is handed to the stream once it is finished
+class StreamRange final : public IsoWriter::OutputRange
+{
+public:
+	StreamRange(StreamOutput* output, unsigned int offsetLBA, unsigned int sizeLBA)
+		: m_output(output), m_data(std::make_unique<unsigned char[]>(static_cast<size_t>(std::min(sizeLBA, WINDOW_LBA)) * CD_SECTOR_SIZE))
+		, m_types(std::min(sizeLBA, WINDOW_LBA)), m_windowLBA(offsetLBA)
+	{
+		m_buffer = m_data.get();
+		m_offsetLBA = offsetLBA;
+		m_endLBA = offsetLBA + sizeLBA;
+		m_windowSize = WINDOW_LBA;
+		LoadWindow();
+	}
+
+	~StreamRange() override
+	{
+		// The view may have stopped short of the window, see SetEnd()
+		if (m_endLBA > m_windowLBA)
+		{
+			m_output->Release(m_data.get(), m_types.data(), m_windowLBA, GetWindowEnd());
+		}
+	}
+
+	void NextWindow() override
+	{
+		const unsigned int windowEndLBA = GetWindowEnd();
+		m_output->Release(m_data.get(), m_types.data(), m_windowLBA, windowEndLBA);
+
+		m_windowLBA = windowEndLBA;
+		LoadWindow();
+	}
+
+	void SetSectorType(const void* sector, ecm::Type type) override
+	{
+		m_types[(static_cast<const unsigned char*>(sector) - m_data.get()) / CD_SECTOR_SIZE] = type;
+	}
+
+private:
+	// Same size as the batches of the track hasher, a few megabytes
+	static constexpr unsigned int WINDOW_LBA = 4096;
+
+	unsigned int GetWindowEnd() const { return m_windowLBA + std::min(m_endLBA - m_windowLBA, WINDOW_LBA); }
+
+	void LoadWindow()
+	{
+		// Only sectors written by the view are handed back, so the types start out raw
+		std::fill(m_types.begin(), m_types.end(), ecm::Type::Raw);
+		m_output->Load(m_data.get(), m_windowLBA, GetWindowEnd());
+	}
+
+	StreamOutput* m_output;
+	std::unique_ptr<unsigned char[]> m_data;
+	std::vector<ecm::Type> m_types;
+	unsigned int m_windowLBA; // First sector of the buffer
+};
+
+std::unique_ptr<IsoWriter::OutputRange> StreamOutput::GetRange(unsigned int offsetLBA, unsigned int sizeLBA)
+{
+	if (offsetLBA < m_streamLBA && !m_failed)
+	{
+		report::Error("", "Sector %u written after it was already sent to the output stream.", offsetLBA);
+		m_failed = true;
+	}
+	return std::make_unique<StreamRange>(this, offsetLBA, sizeLBA);
+}
+
+void StreamOutput::Load(unsigned char* data, unsigned int offsetLBA, unsigned int endLBA) const
+{
+	for (unsigned int lba = offsetLBA; lba < endLBA; lba++, data += CD_SECTOR_SIZE)
+	{
+		if (auto it = m_pending.find(lba); it != m_pending.end())
+		{
+			std::copy(it->second->data.begin(), it->second->data.end(), data);
+		}
+		else
+		{
+			std::fill_n(data, CD_SECTOR_SIZE, 0);
+		}
+	}
+}
+
+void StreamOutput::Release(const unsigned char* data, const ecm::Type* types, unsigned int offsetLBA, unsigned int endLBA)
+{
+	// Sectors before the stream position were already reported in GetRange()
+	if (offsetLBA < m_streamLBA)
+	{
+		const unsigned int skipped = std::min(m_streamLBA, endLBA) - offsetLBA;
+		data += static_cast<size_t>(skipped) * CD_SECTOR_SIZE;
+		types += skipped;
+		offsetLBA += skipped;
+	}
+
+	// Send the range out straight away if it continues the stream
+	if (offsetLBA == m_streamLBA && m_pending.lower_bound(offsetLBA) == m_pending.lower_bound(endLBA))
+	{
+		Write(data, types, endLBA - offsetLBA);
+		m_streamLBA = endLBA;
+	}
+	else
+	{
+		for (unsigned int lba = offsetLBA; lba < endLBA; lba++, data += CD_SECTOR_SIZE)
+		{
+			auto& sector = m_pending[lba];
+			if (sector == nullptr)
+			{
+				sector = std::make_unique<Sector>();
+			}
+			std::copy_n(data, CD_SECTOR_SIZE, sector->data.begin());
+			sector->type = *types++;
+		}
+	}
+	WritePending();
+}
+
+void StreamOutput::Commit(unsigned int lba)
 {
-	const uint64_t sizeBytes = static_cast<uint64_t>(sizeLBA) * CD_SECTOR_SIZE;
+	static const std::array<unsigned char, CD_SECTOR_SIZE> BLANK_SECTOR {};
+
+	lba = std::min(lba, m_sizeLBA);
+	while (m_streamLBA < lba)
+	{
+		WritePending();
+		if (m_streamLBA >= lba)
+		{
+			break;
+		}
+
+		// Fill the gap up to the next written sector
+		auto next = m_pending.lower_bound(m_streamLBA);
+		const unsigned int gapEnd = next != m_pending.end() ? std::min(next->first, lba) : lba;
+		for (; m_streamLBA < gapEnd; m_streamLBA++)
+		{
+			Write(BLANK_SECTOR.data(), nullptr, 1);
+		}
+	}
+}
+
+bool StreamOutput::Close()
+{
+	Commit(m_sizeLBA);
+	if (m_ecm != nullptr && !m_ecm->Close())
+	{
+		m_failed = true;
+	}
+	if (fflush(m_stream) != 0 || ferror(m_stream))
+	{
+		m_failed = true;
+	}
+	return !m_failed;
+}
+
+void StreamOutput::Write(const unsigned char* data, const ecm::Type* types, unsigned int count)
+{
+	if (m_hasher != nullptr)
+	{
+		m_hasher->Hash(data, count);
+	}
+
+	if (m_failed)
+	{
+		return;
+	}
+
+	if (m_ecm != nullptr)
+	{
+		for (unsigned int i = 0; i < count; i++, data += CD_SECTOR_SIZE)
+		{
+			m_ecm->WriteSector(data, types != nullptr ? types[i] : ecm::Type::Raw);
+		}
+	}
+	else if (fwrite(data, CD_SECTOR_SIZE, count, m_stream) != count)
+	{
+		m_failed = true;
+	}
+}
+
+void StreamOutput::WritePending()
+{
+	for (auto it = m_pending.begin(); it != m_pending.end() && it->first == m_streamLBA; it = m_pending.erase(it))
+	{
+		Write(it->second->data.data(), &it->second->type, 1);
+		m_streamLBA++;
+	}
+}
+
+// ======================================================
+
+IsoWriter::IsoWriter() = default;
+IsoWriter::~IsoWriter() = default;
+
+ThreadPool* IsoWriter::GetThreadPool() const
+{
+	// Created on first use, writers of audio tracks never need one
+	if (m_threadPool == nullptr)
+	{
+		m_threadPool = std::make_unique<ThreadPool>(std::thread::hardware_concurrency());
+	}
+	return m_threadPool.get();
+}
+
+bool IsoWriter::Create(const fs::path& fileName, unsigned int sizeLBA, bool xaEdc, const MappingOptions& options)
+{
+	m_xaEdc = xaEdc;
+
+	auto output = std::make_unique<MappedOutput>(sizeLBA, options);
+	if (!output->Create(fileName))
+	{
+		return false;
+	}
+	m_output = std::move(output);
+	return true;
+}
+
+bool IsoWriter::Open(const fs::path& fileName, unsigned int sizeLBA, bool xaEdc, const MappingOptions& options)
+{
+	m_xaEdc = xaEdc;
+
+	auto output = std::make_unique<MappedOutput>(sizeLBA, options);
+	if (!output->Open(fileName))
+	{
+		return false;
+	}
+	m_output = std::move(output);
+	return true;
+}
+
+bool IsoWriter::CreateInMemory(void* buffer, unsigned int sizeLBA, bool xaEdc)
+{
+	m_xaEdc = xaEdc;
+
+	m_output = std::make_unique<MemoryOutput>(buffer, sizeLBA);
+	return true;
+}
+
+bool IsoWriter::CreateStream(FILE* stream, unsigned int sizeLBA, bool xaEdc)
+{
+	m_xaEdc = xaEdc;
+
+	m_output = std::make_unique<StreamOutput>(stream, sizeLBA);
+	return true;
+}
+
+bool IsoWriter::CreateEcm(FILE* stream, unsigned int sizeLBA, bool xaEdc)
+{
+	m_xaEdc = xaEdc;
+
+	auto output = std::make_unique<StreamOutput>(stream, sizeLBA);
+	if (!output->OpenEcm())
+	{
+		return false;
+	}
+	m_output = std::move(output);
+	return true;
+}
+
+void IsoWriter::Commit(unsigned int lba)
+{
+	m_output->Commit(lba);
+}
+
+void IsoWriter::EnableTrackHashes(std::vector<unsigned int> trackLBAs)
+{
+	if (trackLBAs.empty() || trackLBAs.front() != 0)
+	{
+		trackLBAs.insert(trackLBAs.begin(), 0);
+	}
 
-	m_threadPool = std::make_unique<ThreadPool>(std::thread::hardware_concurrency());
-	
-	m_mmap = std::make_unique<MMappedFile>();
-	return m_mmap->Create(fileName, sizeBytes);
+	m_trackHashes.clear();
+	m_hasher = std::make_unique<TrackHasher>(std::move(trackLBAs));
+	m_output->SetHasher(m_hasher.get());
 }
 
-void IsoWriter::Close()
+bool IsoWriter::Close()
 {
-	m_mmap.reset();
+	const bool result = m_output == nullptr || m_output->Close();
+	m_output.reset();
+	if (m_hasher != nullptr)
+	{
+		m_trackHashes = m_hasher->Finish();
+		m_hasher.reset();
+	}
+	return result;
 }
 
 // ======================================================
 
-IsoWriter::SectorView::SectorView(ThreadPool* threadPool, MMappedFile* mappedFile, unsigned int offsetLBA, unsigned int sizeLBA, EdcEccForm edcEccForm)
+IsoWriter::SectorView::SectorView(ThreadPool* threadPool, progress::Counters* progress, std::unique_ptr<OutputRange> range, unsigned int offsetLBA, unsigned int sizeLBA, EdcEccForm edcEccForm, bool xaEdc)
 	: m_threadPool(threadPool) 
-	, m_view(mappedFile->GetView(static_cast<uint64_t>(offsetLBA) * CD_SECTOR_SIZE, static_cast<size_t>(sizeLBA) * CD_SECTOR_SIZE))
+	, m_progress(progress)
+	, m_range(std::move(range))
 	, m_currentLBA(offsetLBA)
 	, m_endLBA(offsetLBA + sizeLBA)
 	, m_edcEccForm(edcEccForm)
+	, m_xaEdc(xaEdc)
 {
-	m_currentSector = m_view.GetBuffer();
+	m_currentSector = m_range->GetBuffer();
+	m_windowEndLBA = offsetLBA + std::min(sizeLBA, m_range->GetWindowSize());
 }
 
 IsoWriter::SectorView::~SectorView()
 {
 	WaitForChecksumJobs();
+	m_range->SetEnd(m_currentLBA);
 }
 
 static uint8_t ToBCD8(uint8_t num)
@@ -81,41 +668,124 @@ void IsoWriter::SectorView::PrepareSectorHeader() const
 	sector->mode = 2; // Mode 2
 }
 
-void IsoWriter::SectorView::CalculateForm1(const bool eccAddr)
+void IsoWriter::SectorView::AdvanceSector()
 {
-	SECTOR_M2F1* sector = static_cast<SECTOR_M2F1*>(m_currentSector);
+	if (m_progress != nullptr)
+	{
+		m_progress->writtenSectors.fetch_add(1, std::memory_order_relaxed);
+	}
 
-	m_checksumJobs.emplace_front(m_threadPool->enqueue([eccAddr](SECTOR_M2F1* sector)
-		{
-			// Encode EDC data
-			EDC_ECC_GEN.ComputeEdcBlock(sector->subHead, sizeof(sector->subHead) + F1_DATA_SIZE, sector->edc);
+	m_currentLBA++;
+	if (m_currentLBA == m_windowEndLBA && m_currentLBA < m_endLBA)
+	{
+		// Checksums are calculated in place, so they must be done before the window is unmapped
+		WaitForChecksumJobs();
+		m_range->NextWindow();
+		m_currentSector = m_range->GetBuffer();
+		m_windowEndLBA = m_currentLBA + std::min(m_endLBA - m_currentLBA, m_range->GetWindowSize());
+	}
+	else
+	{
+		m_currentSector = static_cast<unsigned char*>(m_currentSector) + CD_SECTOR_SIZE;
+	}
+}
+
+// Sectors are checksummed in batches, which keeps the cost of queuing a job small next to its work
+static constexpr size_t CHECKSUM_BATCH_SIZE = 64;
+
+static void ComputeForm1(SECTOR_M2F1* sector, const bool eccAddr)
+{
+	// Encode EDC data
+	EDC_ECC_GEN.ComputeEdcBlock(sector->subHead, sizeof(sector->subHead) + F1_DATA_SIZE, sector->edc);
+
+	// Compute ECC P code
+	static const unsigned char zeroaddress[4] = { 0, 0, 0, 0 };
+	EDC_ECC_GEN.ComputeEccBlock(eccAddr ? sector->addr : zeroaddress, sector->subHead, 86, 24, 2, 86, sector->ecc);
+	// Compute ECC Q code
+	EDC_ECC_GEN.ComputeEccBlock(eccAddr ? sector->addr : zeroaddress, sector->subHead, 52, 43, 86, 88, sector->ecc+172);
+}
 
-			// Compute ECC P code
-			static const unsigned char zeroaddress[4] = { 0, 0, 0, 0 };
-			EDC_ECC_GEN.ComputeEccBlock(eccAddr ? sector->addr : zeroaddress, sector->subHead, 86, 24, 2, 86, sector->ecc);
-			// Compute ECC Q code
-			EDC_ECC_GEN.ComputeEccBlock(eccAddr ? sector->addr : zeroaddress, sector->subHead, 52, 43, 86, 88, sector->ecc+172);
-		}, sector));
+static void ComputeForm2(SECTOR_M2F2* sector, const bool xaEdc)
+{
+	if (xaEdc)
+	{
+		EDC_ECC_GEN.ComputeEdcBlock(sector->subHead, sizeof(sector->subHead) + F2_DATA_SIZE, sector->edc);
+	}
+	else
+	{
+		memset(sector->edc, 0, sizeof(sector->edc));
+	}
+}
+
+void IsoWriter::SectorView::CalculateForm1(const bool eccAddr)
+{
+	// ECM decoders only regenerate the ECC calculated over a zeroed address
+	m_range->SetSectorType(m_currentSector, eccAddr ? ecm::Type::Raw : ecm::Type::Mode2Form1);
+	QueueChecksum(m_currentSector, eccAddr ? ChecksumType::Form1EccAddr : ChecksumType::Form1);
 }
 
 void IsoWriter::SectorView::CalculateForm2()
 {
-	SECTOR_M2F2* sector = static_cast<SECTOR_M2F2*>(m_currentSector);
-	m_checksumJobs.emplace_front(m_threadPool->enqueue([](SECTOR_M2F2* sector)
+	m_range->SetSectorType(m_currentSector, m_xaEdc ? ecm::Type::Mode2Form2 : ecm::Type::Raw);
+	QueueChecksum(m_currentSector, ChecksumType::Form2);
+}
+
+void IsoWriter::SectorView::QueueChecksum(void* sector, ChecksumType type)
+{
+	if (m_progress != nullptr)
 	{
-		if (global::xa_edc)
-		{
-			EDC_ECC_GEN.ComputeEdcBlock(sector->subHead, sizeof(sector->subHead) + F2_DATA_SIZE, sector->edc);
-		}
-		else
+		m_progress->queuedChecksums.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	m_pendingChecksums.push_back({ sector, type });
+	if (m_pendingChecksums.size() >= CHECKSUM_BATCH_SIZE)
+	{
+		FlushChecksums();
+	}
+}
+
+void IsoWriter::SectorView::FlushChecksums()
+{
+	if (m_pendingChecksums.empty())
+	{
+		return;
+	}
+
+	m_checksumJobs.emplace_front(m_threadPool->enqueue([batch = std::move(m_pendingChecksums), xaEdc = m_xaEdc, progress = m_progress]
 		{
-			memset(sector->edc, 0, sizeof(sector->edc));
-		}
-	}, sector));
+			profiler::Scope scope("checksum batch");
+			for (const PendingChecksum& checksum : batch)
+			{
+				if (checksum.type == ChecksumType::Form2)
+				{
+					ComputeForm2(static_cast<SECTOR_M2F2*>(checksum.sector), xaEdc);
+				}
+				else
+				{
+					ComputeForm1(static_cast<SECTOR_M2F1*>(checksum.sector), checksum.type == ChecksumType::Form1EccAddr);
+				}
+			}
+
+			if (progress != nullptr)
+			{
+				progress->queuedChecksums.fetch_sub(batch.size(), std::memory_order_relaxed);
+				progress->checksummedSectors.fetch_add(batch.size(), std::memory_order_relaxed);
+			}
+		}));
+
+	m_pendingChecksums.clear();
+	m_pendingChecksums.reserve(CHECKSUM_BATCH_SIZE);
 }
 
 void IsoWriter::SectorView::WaitForChecksumJobs()
 {
+	FlushChecksums();
+	if (m_checksumJobs.empty())
+	{
+		return;
+	}
+
+	profiler::Scope scope("wait for checksums");
 	for (auto& job : m_checksumJobs)
 	{
 		job.get();
@@ -143,15 +813,20 @@ public:
 
 	void WriteFile(FILE* file) override
 	{
-		SectorType* sector = static_cast<SectorType*>(m_currentSector);
 		const unsigned int lastLBA = m_endLBA - 1;
 
 		while (m_currentLBA < m_endLBA)
 		{
+			SectorType* sector = static_cast<SectorType*>(m_currentSector);
+
 			PrepareSectorHeader();
 			SetSubHeader(sector->subHead, m_currentLBA != lastLBA ? m_subHeader : IsoWriter::SubEOF);
 
 			const size_t bytesRead = fread(sector->data, 1, F1_DATA_SIZE, file);
+			if (m_payloadHasher != nullptr)
+			{
+				m_payloadHasher->Update(sector->data, bytesRead);
+			}
 			// Fill the remainder of the sector with zeroes if applicable
 			std::fill(std::begin(sector->data) + bytesRead, std::end(sector->data), 0);
 		
@@ -164,8 +839,7 @@ public:
 				CalculateForm2();
 			}
 
-			m_currentLBA++;
-			m_currentSector = ++sector;
+			AdvanceSector();
 		}
 	}
 
@@ -186,6 +860,10 @@ public:
 
 			const size_t memToCopy = std::min(GetSpaceInCurrentSector(), size);
 			std::copy_n(buf, memToCopy, sector->data + m_offsetInSector);
+			if (m_payloadHasher != nullptr)
+			{
+				m_payloadHasher->Update(buf, memToCopy);
+			}
 			
 			size -= memToCopy;
 			buf += memToCopy;
@@ -200,10 +878,10 @@ public:
 
 	void WriteBlankSectors(unsigned int count, const unsigned char submode, const bool eccAddr) override
 	{
-		SectorType* sector = static_cast<SectorType*>(m_currentSector);
-
 		while (m_currentLBA < m_endLBA && count > 0)
 		{
+			SectorType* sector = static_cast<SectorType*>(m_currentSector);
+
 			PrepareSectorHeader();
 			SetSubHeader(sector->subHead, submode << 16);
 
@@ -218,8 +896,7 @@ public:
 			}
 
 			count--;
-			m_currentLBA++;
-			m_currentSector = ++sector;
+			AdvanceSector();
 		}
 	}
 
@@ -244,8 +921,7 @@ public:
 		}
 
 		m_offsetInSector = 0;
-		m_currentLBA++;
-		m_currentSector = sector + 1;
+		AdvanceSector();
 	}
 
 	void SetSubheader(unsigned int subHead) override
@@ -266,7 +942,7 @@ private:
 
 auto IsoWriter::GetSectorViewM2F1(unsigned int offsetLBA, unsigned int sizeLBA, EdcEccForm edcEccForm) const -> std::unique_ptr<SectorView>
 {
-	return std::make_unique<SectorViewM2F1>(m_threadPool.get(), m_mmap.get(), offsetLBA, sizeLBA, edcEccForm);
+	return std::make_unique<SectorViewM2F1>(GetThreadPool(), m_progress, m_output->GetRange(offsetLBA, sizeLBA), offsetLBA, sizeLBA, edcEccForm, m_xaEdc);
 }
 
 class SectorViewM2F2 final : public IsoWriter::SectorView
@@ -287,13 +963,17 @@ public:
 
 	void WriteFile(FILE* file) override
 	{
-		SectorType* sector = static_cast<SectorType*>(m_currentSector);
-
 		while (m_currentLBA < m_endLBA)
 		{
+			SectorType* sector = static_cast<SectorType*>(m_currentSector);
+
 			PrepareSectorHeader();
 
 			const size_t bytesRead = fread(sector->subHead, 1, XA_DATA_SIZE, file);
+			if (m_payloadHasher != nullptr)
+			{
+				m_payloadHasher->Update(sector->subHead, bytesRead);
+			}
 			// Fill the remainder of the sector with zeroes if applicable
 			std::fill(std::begin(sector->subHead) + bytesRead, std::end(sector->edc), 0);
 		
@@ -323,8 +1003,7 @@ public:
 				}
 			}
 
-			m_currentLBA++;
-			m_currentSector = ++sector;
+			AdvanceSector();
 		}
 	}
 
@@ -343,6 +1022,10 @@ public:
 
 			const size_t memToCopy = std::min(GetSpaceInCurrentSector(), size);
 			std::copy_n(buf, memToCopy, sector->subHead + m_offsetInSector);
+			if (m_payloadHasher != nullptr)
+			{
+				m_payloadHasher->Update(buf, memToCopy);
+			}
 			
 			size -= memToCopy;
 			buf += memToCopy;
@@ -357,10 +1040,10 @@ public:
 
 	void WriteBlankSectors(unsigned int count, const unsigned char submode, const bool eccAddr) override
 	{
-		SectorType* sector = static_cast<SectorType*>(m_currentSector);
-
 		while (m_currentLBA < m_endLBA && count > 0)
 		{
+			SectorType* sector = static_cast<SectorType*>(m_currentSector);
+
 			PrepareSectorHeader();
 
 			std::fill(std::begin(sector->subHead), std::end(sector->edc), 0);
@@ -374,8 +1057,7 @@ public:
 			}
 
 			count--;
-			m_currentLBA++;
-			m_currentSector = ++sector;
+			AdvanceSector();
 		}
 	}
 
@@ -417,8 +1099,7 @@ public:
 		}
 
 		m_offsetInSector = 0;
-		m_currentLBA++;
-		m_currentSector = sector + 1;
+		AdvanceSector();
 	}
 
 	void SetSubheader(unsigned int subHead) override
@@ -429,29 +1110,60 @@ public:
 
 auto IsoWriter::GetSectorViewM2F2(unsigned int offsetLBA, unsigned int sizeLBA, EdcEccForm edcEccForm) const -> std::unique_ptr<SectorView>
 {
-	return std::make_unique<SectorViewM2F2>(m_threadPool.get(), m_mmap.get(), offsetLBA, sizeLBA, edcEccForm);
+	return std::make_unique<SectorViewM2F2>(GetThreadPool(), m_progress, m_output->GetRange(offsetLBA, sizeLBA), offsetLBA, sizeLBA, edcEccForm, m_xaEdc);
 }
 
 // ======================================================
 
-IsoWriter::RawSectorView::RawSectorView(MMappedFile* mappedFile, unsigned int offsetLBA, unsigned int sizeLBA)
-	: m_view(mappedFile->GetView(static_cast<uint64_t>(offsetLBA) * CD_SECTOR_SIZE, static_cast<size_t>(sizeLBA) * CD_SECTOR_SIZE))
-	, m_endLBA(sizeLBA)
+IsoWriter::RawSectorView::RawSectorView(progress::Counters* progress, std::unique_ptr<OutputRange> range, unsigned int sizeLBA)
+	: m_progress(progress)
+	, m_range(std::move(range))
+	, m_remainingBytes(static_cast<uint64_t>(sizeLBA) * CD_SECTOR_SIZE)
 {
+	m_windowBytes = static_cast<size_t>(std::min(sizeLBA, m_range->GetWindowSize())) * CD_SECTOR_SIZE;
 }
 
-void* IsoWriter::RawSectorView::GetRawBuffer() const
+void IsoWriter::RawSectorView::WriteMemory(const void* memory, size_t size)
 {
-	return m_view.GetBuffer();
+	const unsigned char* buf = static_cast<const unsigned char*>(memory);
+	size = static_cast<size_t>(std::min<uint64_t>(size, m_remainingBytes));
+
+	while (size > 0)
+	{
+		if (m_offsetInWindow == m_windowBytes)
+		{
+			m_range->NextWindow();
+			m_offsetInWindow = 0;
+		}
+
+		const size_t memToCopy = std::min(m_windowBytes - m_offsetInWindow, size);
+		std::copy_n(buf, memToCopy, static_cast<unsigned char*>(m_range->GetBuffer()) + m_offsetInWindow);
+
+		size -= memToCopy;
+		buf += memToCopy;
+		m_offsetInWindow += memToCopy;
+
+		// Count the sectors completed by this copy
+		if (m_progress != nullptr)
+		{
+			const uint64_t completedSectors = GetSizeInSectors(m_remainingBytes, CD_SECTOR_SIZE) - GetSizeInSectors(m_remainingBytes - memToCopy, CD_SECTOR_SIZE);
+			m_progress->writtenSectors.fetch_add(completedSectors, std::memory_order_relaxed);
+		}
+		m_remainingBytes -= memToCopy;
+	}
 }
 
 void IsoWriter::RawSectorView::WriteBlankSectors()
 {
-	char* buf = static_cast<char*>(m_view.GetBuffer());
-	std::fill_n(buf, static_cast<size_t>(m_endLBA) * CD_SECTOR_SIZE, 0);
+	static const std::array<unsigned char, CD_SECTOR_SIZE> BLANK_SECTOR {};
+
+	while (m_remainingBytes > 0)
+	{
+		WriteMemory(BLANK_SECTOR.data(), static_cast<size_t>(std::min<uint64_t>(m_remainingBytes, BLANK_SECTOR.size())));
+	}
 }
 
 auto IsoWriter::GetRawSectorView(unsigned int offsetLBA, unsigned int sizeLBA) const -> std::unique_ptr<RawSectorView>
 {
-	return std::make_unique<RawSectorView>(m_mmap.get(), offsetLBA, sizeLBA);
+	return std::make_unique<RawSectorView>(m_progress, m_output->GetRange(offsetLBA, sizeLBA), sizeLBA);
 }
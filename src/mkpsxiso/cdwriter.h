@@ -2,13 +2,26 @@
 #define _CDWRITER_H
 
 #include "cd.h"
+#include "ecm.h"
+#include "hash.h"
 #include "mmappedfile.h"
+#include "progress.h"
 #include <ThreadPool.h>
+#include <algorithm>
+#include <climits>
 #include <forward_list>
 
 namespace cd {
 using namespace progschj;
 
+/// Options of images written to a memory mapped file
+struct MappingOptions
+{
+	unsigned int windowLBA = 0;	/// Most sectors a view maps at once, views of more sectors slide a window over them. 0 maps every view whole.
+	bool writeback = false;		/// Start writing completed sectors back to disk while the build goes on
+	bool durable = false;		/// Wait for the image to reach the disk when closing it
+};
+
 class IsoWriter
 {
 public:
@@ -27,10 +40,65 @@ public:
 		SubEOF	= 0x00890000,
 	};
 
+	/// Hashes the raw sectors of each track in LBA order, see EnableTrackHashes()
+	class TrackHasher;
+
+	/// A range of sectors of the image, handed back to the output when destroyed
+	class OutputRange
+	{
+	public:
+		virtual ~OutputRange() = default;
+
+		/// Ranges may only map a window of their sectors at a time, the buffer starts at the first sector of the window
+		void* GetBuffer() const { return m_buffer; }
+		unsigned int GetWindowSize() const { return m_windowSize; }
+
+		/// Moves the window right past the current one, whose sectors must not be accessed anymore
+		virtual void NextWindow() {}
+
+		/// Records how the EDC and ECC data of a sector was calculated, for outputs which strip it
+		virtual void SetSectorType(const void* /*sector*/, ecm::Type /*type*/) {}
+
+		/// Views may span more sectors than they write, only sectors before lba are handed back
+		void SetEnd(unsigned int lba) { m_endLBA = std::min(m_endLBA, lba); }
+
+	protected:
+		void* m_buffer = nullptr;
+		unsigned int m_offsetLBA = 0;
+		unsigned int m_endLBA = 0;
+		unsigned int m_windowSize = UINT_MAX;
+	};
+
+	/// Destination of the image, a memory mapped file, a memory buffer or a sequential stream
+	class Output
+	{
+	public:
+		virtual ~Output() = default;
+
+		/** Returns a writable range of sectors. Sectors which were written before keep their contents,
+		 *	any others are zeroed.
+		 */
+		virtual std::unique_ptr<OutputRange> GetRange(unsigned int offsetLBA, unsigned int sizeLBA) = 0;
+
+		/** Declares that all sectors before lba are complete, see IsoWriter::Commit().
+		 */
+		virtual void Commit(unsigned int /*lba*/) {}
+
+		virtual bool Close() = 0;
+
+		/** Sectors are handed to the hasher in LBA order once they are complete, at the latest when
+		 *	the output is closed.
+		 */
+		void SetHasher(TrackHasher* hasher) { m_hasher = hasher; }
+
+	protected:
+		TrackHasher* m_hasher = nullptr;
+	};
+
 	class SectorView
 	{
 	public:
-		SectorView(ThreadPool* threadPool, MMappedFile* mappedFile, unsigned int offsetLBA, unsigned int sizeLBA, EdcEccForm edcEccForm);
+		SectorView(ThreadPool* threadPool, progress::Counters* progress, std::unique_ptr<OutputRange> range, unsigned int offsetLBA, unsigned int sizeLBA, EdcEccForm edcEccForm, bool xaEdc);
 		virtual ~SectorView();
 
 		virtual void WriteFile(FILE* file) = 0;
@@ -40,11 +108,17 @@ public:
 		virtual void NextSector() = 0;
 		virtual void SetSubheader(unsigned int subHead) = 0;
 
+		/// Hashes the data written with WriteFile() and WriteMemory(), which must outlive the view
+		void SetPayloadHasher(hash::Digester* hasher) { m_payloadHasher = hasher; }
+
 		void WaitForChecksumJobs();
 
 	protected:
 		void PrepareSectorHeader() const;
 
+		/// Moves on to the next sector, waiting for the checksums of the current window before leaving it
+		void AdvanceSector();
+
 		void CalculateForm1(const bool eccAddr = false);
 		void CalculateForm2();
 
@@ -55,38 +129,133 @@ public:
 
 		const unsigned int m_endLBA = 0;
 		const EdcEccForm m_edcEccForm = EdcEccForm::None;
+		const bool m_xaEdc = true;
+		hash::Digester* m_payloadHasher = nullptr;
 
 	private:
+		enum class ChecksumType : unsigned char
+		{
+			Form1,
+			Form1EccAddr,	/// ECC calculated over the sector address
+			Form2,
+		};
+
+		struct PendingChecksum
+		{
+			void* sector;
+			ChecksumType type;
+		};
+
+		void QueueChecksum(void* sector, ChecksumType type);
+
+		/// Hands the queued sectors to a checksum job
+		void FlushChecksums();
+
+		std::vector<PendingChecksum> m_pendingChecksums;
 		std::forward_list<std::future<void>> m_checksumJobs;
 		ThreadPool* m_threadPool;
-		MMappedFile::View m_view;
+		progress::Counters* m_progress;
+		std::unique_ptr<OutputRange> m_range;
+		unsigned int m_windowEndLBA = 0;
 	};
 
 	class RawSectorView
 	{
 	public:
-		RawSectorView(MMappedFile* mappedFile, unsigned int offsetLBA, unsigned int sizeLBA);
+		RawSectorView(progress::Counters* progress, std::unique_ptr<OutputRange> range, unsigned int sizeLBA);
+
+		/// Copies data to the sectors right after the previous writes
+		void WriteMemory(const void* memory, size_t size);
 
-		void* GetRawBuffer() const;
+		/// Fills all sectors not written yet with zeroes
 		void WriteBlankSectors();
 
 	private:
-		MMappedFile::View m_view;
-		unsigned int m_endLBA;
+		progress::Counters* m_progress;
+		std::unique_ptr<OutputRange> m_range;
+		size_t m_windowBytes;
+		size_t m_offsetInWindow = 0;
+		uint64_t m_remainingBytes;
 	};
 
-	IsoWriter() = default;
+	IsoWriter();
+	~IsoWriter();
 
-	bool Create(const fs::path& fileName, unsigned int sizeLBA);
-	void Close();
+	/** Creates the image file.
+	 *
+	 *	fileName	- Path of the image file.
+	 *	sizeLBA		- Size of the image in sectors.
+	 *	xaEdc		- Compute EDC of Form 2 sectors, some games expect it to be zero.
+	 *	options		- Memory usage and writeback of the mapped file.
+	 */
+	bool Create(const fs::path& fileName, unsigned int sizeLBA, bool xaEdc = true, const MappingOptions& options = {});
+
+	/** Opens an existing image file to write some of its sectors again, the others keep their
+	 *	contents. The file must be sizeLBA sectors long.
+	 */
+	bool Open(const fs::path& fileName, unsigned int sizeLBA, bool xaEdc = true, const MappingOptions& options = {});
+
+	/** Writes the image to a memory buffer instead of a file.
+	 *
+	 *	buffer		- Caller owned buffer of at least sizeLBA * CD_SECTOR_SIZE bytes.
+	 */
+	bool CreateInMemory(void* buffer, unsigned int sizeLBA, bool xaEdc = true);
+
+	/** Writes the image sequentially to a stream, such as stdout or a pipe. Sectors are buffered in
+	 *	memory until all sectors before them are complete, so views should be requested in LBA order
+	 *	and Commit() called as the writes progress. Sectors before a committed LBA cannot be written
+	 *	anymore.
+	 *
+	 *	stream		- Stream opened for binary writing, not closed by the writer.
+	 */
+	bool CreateStream(FILE* stream, unsigned int sizeLBA, bool xaEdc = true);
+
+	/** Writes the image sequentially to a stream as an ECM file, leaving out the EDC and ECC data
+	 *	of sectors which can be regenerated. The same ordering rules as for CreateStream() apply.
+	 */
+	bool CreateEcm(FILE* stream, unsigned int sizeLBA, bool xaEdc = true);
+
+	/** Declares that all sectors before lba have been written, so they can be sent out to a stream.
+	 *	Sectors which were not written are filled with zeroes. Does nothing for other outputs.
+	 */
+	void Commit(unsigned int lba);
+
+	/** Reports the sectors written and checksummed through this writer to a set of progress counters,
+	 *	which must outlive the writer. Null disables reporting.
+	 */
+	void SetProgress(progress::Counters* progress) { m_progress = progress; }
+
+	/** Hashes each track of the image over its raw sectors while the image is written. Sectors are
+	 *	hashed in LBA order as they are committed, on a thread of their own. Call this after creating
+	 *	the output and before writing to it.
+	 *
+	 *	trackLBAs	- First sector of each track in the output, in ascending order.
+	 */
+	void EnableTrackHashes(std::vector<unsigned int> trackLBAs);
+
+	/** Returns the size and hashes of each track, once the image was closed.
+	 */
+	const std::vector<hash::Digests>& GetTrackHashes() const { return m_trackHashes; }
+
+	/** Completes the image.
+	 *
+	 *	Returns: False if the image could not be written out.
+	 */
+	bool Close();
 
 	std::unique_ptr<SectorView> GetSectorViewM2F1(unsigned int offsetLBA, unsigned int sizeLBA, EdcEccForm edcEccForm) const;
 	std::unique_ptr<SectorView> GetSectorViewM2F2(unsigned int offsetLBA, unsigned int sizeLBA, EdcEccForm edcEccForm) const;
 	std::unique_ptr<RawSectorView> GetRawSectorView(unsigned int offsetLBA, unsigned int sizeLBA) const;
 
 private:
-	std::unique_ptr<MMappedFile> m_mmap;
-	std::unique_ptr<ThreadPool> m_threadPool;
+	ThreadPool* GetThreadPool() const;
+
+	std::unique_ptr<TrackHasher> m_hasher; // Outlives the output, which hands it sectors until it is closed
+	std::unique_ptr<Output> m_output;
+	std::vector<hash::Digests> m_trackHashes;
+	mutable std::unique_ptr<ThreadPool> m_threadPool;
+	progress::Counters* m_progress = nullptr;
+	bool m_xaEdc = true;
 };
 
 ISO_USHORT_PAIR SetPair16(unsigned short val);
@@ -0,0 +1,155 @@
+#include "depfile.h"
+#include "hash.h"
+#include <cinttypes>
+#include <fstream>
+#include <string>
+
+static constexpr const char* STAMP_SIGNATURE = "mkpsxiso-stamp " VERSION;
+static constexpr std::string_view STAMP_OUTPUT_PREFIX = "output ";
+
+// Make treats spaces as separators and # as a comment, both are escaped with a backslash
+static std::string EscapeMakePath(const fs::path& path)
+{
+	std::string escaped;
+	for (char c : path.generic_string())
+	{
+		if (c == ' ' || c == '#')
+		{
+			escaped += '\\';
+		}
+		else if (c == '$')
+		{
+			escaped += '$';
+		}
+		escaped += c;
+	}
+	return escaped;
+}
+
+bool deps::WriteDepfile(const fs::path& path, const std::vector<fs::path>& targets, const std::vector<fs::path>& files)
+{
+	unique_file file = OpenScopedFile(path, "w");
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < targets.size(); i++)
+	{
+		fprintf(file.get(), "%s%s", i != 0 ? " " : "", EscapeMakePath(targets[i]).c_str());
+	}
+	fprintf(file.get(), ":");
+	for (const fs::path& dependency : files)
+	{
+		fprintf(file.get(), " \\\n  %s", EscapeMakePath(dependency).c_str());
+	}
+	fprintf(file.get(), "\n");
+
+	for (const fs::path& dependency : files)
+	{
+		fprintf(file.get(), "\n%s:\n", EscapeMakePath(dependency).c_str());
+	}
+
+	return fflush(file.get()) == 0 && !ferror(file.get());
+}
+
+bool deps::WriteStamp(const fs::path& path, std::string_view options, const std::vector<fs::path>& files, const std::vector<fs::path>& outputs)
+{
+	// A stamp missing any output would count the build as up to date without it
+	std::vector<struct stat64> outputAttribs;
+	outputAttribs.reserve(outputs.size());
+	for (const fs::path& output : outputs)
+	{
+		const std::optional<struct stat64> attrib = Stat(output);
+		if (!attrib.has_value())
+		{
+			return false;
+		}
+		outputAttribs.push_back(*attrib);
+	}
+
+	unique_file file = OpenScopedFile(path, "w");
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	// A signature line and the options, then a line of size, modification time and path per output
+	// and a line of size, modification time, hash and path per file
+	fprintf(file.get(), "%s\n%.*s\n", STAMP_SIGNATURE, static_cast<int>(options.size()), options.data());
+	for (size_t i = 0; i < outputs.size(); i++)
+	{
+		fprintf(file.get(), "%.*s%" PRId64 " %" PRId64 " %s\n", static_cast<int>(STAMP_OUTPUT_PREFIX.size()), STAMP_OUTPUT_PREFIX.data(),
+			static_cast<int64_t>(outputAttribs[i].st_size), static_cast<int64_t>(outputAttribs[i].st_mtime), outputs[i].string().c_str());
+	}
+	for (const fs::path& dependency : files)
+	{
+		const std::optional<struct stat64> attrib = Stat(dependency);
+		const std::optional<uint64_t> hash = attrib ? hash::HashFile(dependency) : std::nullopt;
+		if (hash.has_value())
+		{
+			fprintf(file.get(), "%" PRId64 " %" PRId64 " %016" PRIx64 " %s\n", static_cast<int64_t>(attrib->st_size),
+				static_cast<int64_t>(attrib->st_mtime), *hash, dependency.string().c_str());
+		}
+		else
+		{
+			// Missing files are recorded too, so the build runs again once they show up
+			fprintf(file.get(), "-1 0 0 %s\n", dependency.string().c_str());
+		}
+	}
+
+	return fflush(file.get()) == 0 && !ferror(file.get());
+}
+
+std::optional<std::vector<fs::path>> deps::CheckStamp(const fs::path& path, std::string_view options)
+{
+	std::ifstream stamp(path.native());
+	std::string line;
+	if (!std::getline(stamp, line) || line != STAMP_SIGNATURE || !std::getline(stamp, line) || line != options)
+	{
+		return std::nullopt;
+	}
+
+	std::vector<fs::path> files;
+	while (std::getline(stamp, line))
+	{
+		int64_t size, mtime;
+		uint64_t hash;
+		int pathOffset = 0;
+		if (line.starts_with(STAMP_OUTPUT_PREFIX))
+		{
+			if (sscanf(line.c_str() + STAMP_OUTPUT_PREFIX.size(), "%" SCNd64 " %" SCNd64 " %n", &size, &mtime, &pathOffset) != 2 || pathOffset == 0)
+			{
+				return std::nullopt;
+			}
+
+			const std::optional<struct stat64> attrib = Stat(fs::path(line.substr(STAMP_OUTPUT_PREFIX.size() + pathOffset)));
+			if (!attrib.has_value() || attrib->st_size != size || attrib->st_mtime != mtime)
+			{
+				return std::nullopt;
+			}
+			continue;
+		}
+
+		if (sscanf(line.c_str(), "%" SCNd64 " %" SCNd64 " %" SCNx64 " %n", &size, &mtime, &hash, &pathOffset) != 3 || pathOffset == 0)
+		{
+			return std::nullopt;
+		}
+
+		const fs::path dependency = fs::path(line.substr(pathOffset));
+		const std::optional<struct stat64> attrib = Stat(dependency);
+		if (size < 0)
+		{
+			if (attrib.has_value())
+			{
+				return std::nullopt;
+			}
+		}
+		else if (!attrib.has_value() || attrib->st_size != size || (attrib->st_mtime != mtime && hash::HashFile(dependency) != hash))
+		{
+			return std::nullopt;
+		}
+		files.push_back(dependency);
+	}
+	return files;
+}
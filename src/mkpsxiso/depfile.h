@@ -0,0 +1,33 @@
+#ifndef _DEPFILE_H
+#define _DEPFILE_H
+
+#include "platform.h"
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace deps
+{
+	/** Writes a Makefile rule with the targets depending on the files, the format of depfiles which
+	 *	Make and Ninja read. Every file also gets an empty rule of its own, so Make does not fail once
+	 *	a file stops being a dependency and is deleted.
+	 */
+	bool WriteDepfile(const fs::path& path, const std::vector<fs::path>& targets, const std::vector<fs::path>& files);
+
+	/** Writes the stamp of a finished build, recording the options it ran with, the size,
+	 *	modification time and hash of every file it depends on, and the size and modification time
+	 *	of every file it wrote.
+	 */
+	bool WriteStamp(const fs::path& path, std::string_view options, const std::vector<fs::path>& files, const std::vector<fs::path>& outputs);
+
+	/** Checks a stamp written by WriteStamp(). Files with a new modification time are hashed, so a
+	 *	file which was saved again with the same contents does not count as changed. Outputs must
+	 *	still exist with the size and modification time they were written with.
+	 *
+	 *	Returns the files the build depends on if the options match and none of the files or outputs
+	 *	changed, or nothing if the build has to run again.
+	 */
+	std::optional<std::vector<fs::path>> CheckStamp(const fs::path& path, std::string_view options);
+};
+
+#endif // _DEPFILE_H
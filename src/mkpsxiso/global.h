@@ -1,16 +0,0 @@
-#ifndef _GLOBAL_H
-#define _GLOBAL_H
-
-#include <ctime>
-
-namespace global {
-
-	extern time_t	BuildTime;
-	extern bool		xa_edc;
-	extern bool		noWarns;
-	extern bool		QuietMode;
-	extern bool		noXA;
-	extern int		trackNum;
-};
-
-#endif // _GLOBAL_H
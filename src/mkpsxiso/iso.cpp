@@ -1,8 +1,15 @@
-#include "global.h"
 #include "iso.h"
+#include "hash.h"
+#include "profiler.h"
+#include "report.h"
 #include "xa.h"
+
+#define MA_NO_THREADING
+#define MA_NO_DEVICE_IO
+#define MINIAUDIO_IMPLEMENTATION
 #include "miniaudio_helpers.h"
 #include <fstream>
+#include <map>
 
 static const int MinimumOne(const int val)
 {
@@ -14,10 +21,10 @@ static const int RoundToEven(const int val)
 	return (val + 1) & -2;
 }
 
-static cd::ISO_DATESTAMP GetISODateStamp(time_t time, signed char GMToffs)
+static cd::ISO_DATESTAMP GetISODateStamp(time_t time, signed char GMToffs, const iso::Settings& settings)
 {
 	tm timestamp;
-	if (global::new_type.has_value()) {
+	if (settings.new_type.has_value()) {
 		timestamp = CustomLocalTime(&time);
 	}
 	else {
@@ -54,7 +61,7 @@ int iso::DirTreeClass::GetAudioSize(const fs::path& audioFile)
 	ma_uint64 expectedPCMFrames;
 	if(ma_decoder_get_length_in_pcm_frames(&decoder, &expectedPCMFrames) != MA_SUCCESS)
 	{
-		printf("\n    ERROR: corrupt file? unable to get_length_in_pcm_frames\n");
+		report::Error("\n    ", "corrupt file? unable to get_length_in_pcm_frames");
 		ma_decoder_uninit(&decoder);
 		return 0;
 	}
@@ -63,23 +70,247 @@ int iso::DirTreeClass::GetAudioSize(const fs::path& audioFile)
 	return GetSizeInSectors(expectedPCMFrames * 2 * (sizeof(int16_t)), CD_SECTOR_SIZE)*CD_SECTOR_SIZE;
 }
 
+iso::SourceInfo iso::ProbeSource(const fs::path& srcfile, bool probeXA, bool probeAudio, const SourceInfo* previous)
+{
+	SourceInfo info;
+	info.attrib = Stat(srcfile);
+	if ( !info.attrib )
+	{
+		return info;
+	}
+
+	// Probes only depend on the contents, so they hold for as long as the file is not modified
+	if ( previous != nullptr && previous->attrib && previous->attrib->st_size == info.attrib->st_size &&
+		previous->attrib->st_mtime == info.attrib->st_mtime )
+	{
+		info.validXAHeader = previous->validXAHeader;
+		info.audioSize = previous->audioSize;
+		info.probedXA = previous->probedXA;
+		info.probedAudio = previous->probedAudio;
+		probeXA &= !info.probedXA;
+		probeAudio &= !info.probedAudio;
+	}
+
+	if ( probeXA )
+	{
+		FILE* fp = OpenFile(srcfile, "rb");
+		if (fp != nullptr)
+		{
+			char buff[4];
+			if (fread(buff, 1, std::size(buff), fp) == std::size(buff))
+			{
+				info.validXAHeader = strncmp(buff, "RIFF", std::size(buff)) != 0;
+			}
+			fclose(fp);
+		}
+		info.probedXA = true;
+	}
+
+	if ( probeAudio )
+	{
+		info.audioSize = DirTreeClass::GetAudioSize(srcfile);
+		info.probedAudio = true;
+	}
+
+	return info;
+}
+
+void iso::SourceCache::Add(const fs::path& srcfile, bool probeXA, bool probeAudio)
+{
+	Source& source = m_sources[srcfile.native()];
+	source.path = srcfile;
+	source.probeXA |= probeXA;
+	source.probeAudio |= probeAudio;
+	source.added = true;
+}
+
+void iso::SourceCache::Prefetch()
+{
+	profiler::Scope scope("prefetch sources");
+
+	// Files no longer in the project must not stay watched or listed as dependencies
+	std::erase_if(m_sources, [](const auto& source) { return !source.second.added; });
+
+	// Metadata lookups are latency bound, so keep plenty of them in flight even on low core counts
+	progschj::ThreadPool threadPool(std::max(8u, std::thread::hardware_concurrency()));
+
+	std::vector<std::future<void>> jobs;
+	jobs.reserve(m_sources.size());
+	for (auto& [key, source] : m_sources)
+	{
+		jobs.emplace_back(threadPool.enqueue([&source = source]
+			{
+				profiler::Scope scope("probe source");
+				source.info = ProbeSource(source.path, source.probeXA, source.probeAudio, &source.info);
+				source.probeXA = source.probeAudio = source.added = false;
+			}));
+	}
+
+	for (auto& job : jobs)
+	{
+		job.get();
+	}
+}
+
+iso::SourceInfo iso::SourceCache::Get(const fs::path& srcfile, bool probeXA, bool probeAudio) const
+{
+	if ( auto it = m_sources.find(srcfile.native()); it != m_sources.end() )
+	{
+		const SourceInfo& info = it->second.info;
+		if ( (!probeXA || info.probedXA) && (!probeAudio || info.probedAudio) )
+		{
+			return info;
+		}
+	}
+	return ProbeSource(srcfile, probeXA, probeAudio);
+}
+
+std::vector<fs::path> iso::SourceCache::GetPaths() const
+{
+	std::vector<fs::path> paths;
+	paths.reserve(m_sources.size());
+	for (const auto& [key, source] : m_sources)
+	{
+		paths.push_back(source.path);
+	}
+	return paths;
+}
+
+static bool HaveSameContents(const fs::path& left, const fs::path& right)
+{
+	unique_file leftFile = OpenScopedFile(left, "rb");
+	unique_file rightFile = OpenScopedFile(right, "rb");
+	if ( leftFile == nullptr || rightFile == nullptr )
+	{
+		return false;
+	}
+
+	std::vector<unsigned char> leftBuffer(64 * 1024), rightBuffer(64 * 1024);
+	for (;;)
+	{
+		const size_t leftRead = fread(leftBuffer.data(), 1, leftBuffer.size(), leftFile.get());
+		const size_t rightRead = fread(rightBuffer.data(), 1, rightBuffer.size(), rightFile.get());
+		if ( leftRead != rightRead || !std::equal(leftBuffer.begin(), leftBuffer.begin() + leftRead, rightBuffer.begin()) )
+		{
+			return false;
+		}
+		if ( leftRead == 0 )
+		{
+			return !ferror(leftFile.get()) && !ferror(rightFile.get());
+		}
+	}
+}
+
+size_t iso::DeduplicateFiles(EntryList& entries, uint32_t& savedSectors)
+{
+	savedSectors = 0;
+
+	// Only files of the same type and size can share an extent, as the type decides how sectors are written
+	std::map<std::pair<EntryType, int64_t>, std::vector<DIRENTRY*>> candidates;
+	for ( DIRENTRY& entry : entries )
+	{
+		const bool isDataFile = entry.type == EntryType::EntryFile || entry.type == EntryType::EntryXA || entry.type == EntryType::EntryXA_DO;
+		if ( isDataFile && entry.subdir == nullptr && !entry.srcfile.empty() && entry.length > 0 && entry.flba == 0 )
+		{
+			candidates[{entry.type, entry.length}].push_back(&entry);
+		}
+	}
+
+	// Hash every source file with a possible duplicate once, source paths are interned so equal paths share their data
+	std::unordered_map<PathView, std::optional<uint64_t>> hashes;
+	for ( const auto& [key, files] : candidates )
+	{
+		if ( files.size() > 1 )
+		{
+			for ( const DIRENTRY* file : files )
+			{
+				hashes.try_emplace(file->srcfile);
+			}
+		}
+	}
+
+	{
+		progschj::ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()));
+
+		std::vector<std::future<void>> jobs;
+		jobs.reserve(hashes.size());
+		for ( auto& [srcfile, hash] : hashes )
+		{
+			jobs.emplace_back(threadPool.enqueue([srcfile = srcfile, &hash = hash]
+				{
+					profiler::Scope scope("hash file");
+					hash = hash::HashFile(fs::path(srcfile));
+				}));
+		}
+
+		for ( auto& job : jobs )
+		{
+			job.get();
+		}
+	}
+
+	size_t duplicates = 0;
+	for ( const auto& [key, files] : candidates )
+	{
+		if ( files.size() < 2 )
+		{
+			continue;
+		}
+
+		// Files are visited in disc order, so a duplicate always comes after the file it shares the extent of
+		std::unordered_map<uint64_t, std::vector<DIRENTRY*>> uniqueFiles;
+		for ( DIRENTRY* file : files )
+		{
+			const std::optional<uint64_t>& hash = hashes[file->srcfile];
+			if ( !hash )
+			{
+				continue;
+			}
+
+			std::vector<DIRENTRY*>& sameHash = uniqueFiles[*hash];
+			auto original = std::find_if(sameHash.begin(), sameHash.end(), [file](const DIRENTRY* other)
+				{
+					return other->srcfile.data() == file->srcfile.data() || HaveSameContents(other->GetSourcePath(), file->GetSourcePath());
+				});
+			if ( original == sameHash.end() )
+			{
+				sameHash.push_back(file);
+				continue;
+			}
+
+			file->sharedWith = *original;
+			savedSectors += GetSizeInSectors(file->length, file->type == EntryType::EntryXA ? XA_DATA_SIZE : F1_DATA_SIZE);
+			duplicates++;
+		}
+	}
+
+	return duplicates;
+}
+
 iso::DirTreeClass::DirTreeClass(EntryList& entries, DirTreeClass* parent, std::string name)
 	: name(name), entries(entries), parent(parent)
 {
+	if ( parent != nullptr )
+	{
+		sourceCache = parent->sourceCache;
+		settings = parent->settings;
+	}
 }
 
 iso::DirTreeClass::~DirTreeClass()
 {
 }
 
-iso::DIRENTRY& iso::DirTreeClass::CreateRootDirectory(EntryList& entries, const cd::ISO_DATESTAMP& volumeDate, const EntryAttributes& attributes)
+iso::DIRENTRY& iso::DirTreeClass::CreateRootDirectory(EntryList& entries, const cd::ISO_DATESTAMP& volumeDate, const EntryAttributes& attributes, const Settings& settings, const SourceCache* sourceCache)
 {
 	DIRENTRY entry {};
 
 	entry.type		= EntryType::EntryDir;
 	entry.subdir	= std::make_unique<DirTreeClass>(entries);
+	entry.subdir->sourceCache = sourceCache;
+	entry.subdir->settings = &settings;
 	entry.date		= volumeDate;
-	if (!global::new_type.value_or(false))
+	if (!settings.new_type.value_or(false))
 	{
 		entry.date.year = volumeDate.year % 0x64; // Root overflows dates past 1999 for games built with old(<2003) mastering tool
 	}
@@ -99,43 +330,24 @@ iso::DIRENTRY& iso::DirTreeClass::CreateRootDirectory(EntryList& entries, const
 
 bool iso::DirTreeClass::AddFileEntry(const char* id, EntryType type, const fs::path& srcfile, const EntryAttributes& attributes, const char *trackid)
 {
-	auto fileAttrib = Stat(srcfile);
+	const SourceInfo source = sourceCache != nullptr
+		? sourceCache->Get(srcfile, type == EntryType::EntryXA, type == EntryType::EntryDA)
+		: ProbeSource(srcfile, type == EntryType::EntryXA, type == EntryType::EntryDA);
+
+	const auto& fileAttrib = source.attrib;
     if ( !fileAttrib )
 	{
-		if ( !global::QuietMode )
-		{
-			printf("      ");
-		}
-
-		printf("ERROR: File not found: %s\n", srcfile.lexically_normal().string().c_str());
+		report::Error(settings->QuietMode ? "" : "      ", "File not found: %s", srcfile.lexically_normal().string().c_str());
 		return false;
     }
 
 	// Check if XA data is valid
 	if ( type == EntryType::EntryXA )
 	{
-		// Check header
-		bool validHeader = false;
-		FILE* fp = OpenFile(srcfile, "rb");
-		if (fp != nullptr)
-		{
-			char buff[4];
-			if (fread(buff, 1, std::size(buff), fp) == std::size(buff))
-			{
-				validHeader = strncmp(buff, "RIFF", std::size(buff)) != 0;
-			}
-			fclose(fp);
-		}
-
 		// Check if its a RIFF (WAV container)
-		if (!validHeader)
+		if (!source.validXAHeader)
 		{
-			if (!global::QuietMode)
-			{
-				printf("      ");
-			}
-
-			printf("ERROR: %s is a WAV or is not properly ripped.\n", srcfile.lexically_normal().string().c_str());
+			report::Error(settings->QuietMode ? "" : "      ", "%s is a WAV or is not properly ripped.", srcfile.lexically_normal().string().c_str());
 
 			return false;
 		}
@@ -149,12 +361,7 @@ bool iso::DirTreeClass::AddFileEntry(const char* id, EntryType type, const fs::p
 			}
 			else
 			{
-				if ( !global::QuietMode )
-				{
-					printf("      ");
-				}
-
-				printf("ERROR: %s is not a multiple of 2336 or 2048 bytes.\n",
+				report::Error(settings->QuietMode ? "" : "      ", "%s is not a multiple of 2336 or 2048 bytes.",
 					srcfile.lexically_normal().string().c_str());
 
 				return false;
@@ -174,31 +381,16 @@ bool iso::DirTreeClass::AddFileEntry(const char* id, EntryType type, const fs::p
 
 
 	// Check if file entry already exists
-    for ( const auto& e : entriesInDir )
+	if ( const auto it = entriesByName.find( temp_name ); it != entriesByName.end() && it->second->type == EntryType::EntryFile )
 	{
-		const DIRENTRY& entry = e.get();
-		if ( !entry.id.empty() )
-		{
-            if ( ( entry.type == EntryType::EntryFile )
-				&& ( CompareICase( entry.id, temp_name ) ) )
-			{
-				if (!global::QuietMode)
-				{
-					printf("      ");
-				}
-
-				printf("ERROR: Duplicate file entry: %s\n", id);
-
-				return false;
-            }
+		report::Error(settings->QuietMode ? "" : "      ", "Duplicate file entry: %s", id);
 
-		}
-
-    }
+		return false;
+	}
 
 	DIRENTRY entry {};
 
-	entry.id		= std::move(temp_name);
+	entry.id		= entries.InternName(temp_name);
 	entry.type		= type;
 	entry.subdir	= nullptr;
 	entry.HF		= attributes.HFLAG % 4;
@@ -211,15 +403,15 @@ bool iso::DirTreeClass::AddFileEntry(const char* id, EntryType type, const fs::p
 
 	if ( !srcfile.empty() )
 	{
-		entry.srcfile = srcfile;
+		entry.srcfile = entries.InternPath(srcfile);
 	}
 
 	if ( type == EntryType::EntryDA )
 	{
-		entry.length = GetAudioSize( srcfile );
+		entry.length = source.audioSize;
 		if(trackid == nullptr)
 		{
-			printf("ERROR: no trackid for DA track\n");
+			report::Error("", "no trackid for DA track");
 			return false;
 		}
 		entry.trackid = trackid;
@@ -229,15 +421,71 @@ bool iso::DirTreeClass::AddFileEntry(const char* id, EntryType type, const fs::p
 		entry.length = fileAttrib->st_size;
 	}
 
-    entry.date = GetISODateStamp( fileAttrib->st_mtime, attributes.GMTOffs );
+    entry.date = GetISODateStamp( fileAttrib->st_mtime, attributes.GMTOffs, *settings );
 
 	entries.emplace_back(std::move(entry));
 	entriesInDir.emplace_back(entries.back());
 
+	// Plain files take precedence in the index, as only they are checked for duplicates
+	DIRENTRY*& indexed = entriesByName[entries.back().id];
+	if ( indexed == nullptr || type == EntryType::EntryFile )
+	{
+		indexed = &entries.back();
+	}
+
 	return true;
 
 }
 
+bool iso::UpdateFileEntry(DIRENTRY& entry, const SourceInfo& source, const Settings& settings)
+{
+	if ( !source.attrib )
+	{
+		return false;
+	}
+
+	int64_t length = source.attrib->st_size;
+	switch ( entry.type )
+	{
+	case EntryType::EntryFile:
+		if ( GetSizeInSectors(length, F1_DATA_SIZE) != GetSizeInSectors(entry.length, F1_DATA_SIZE) )
+		{
+			return false;
+		}
+		break;
+
+	// XA files only keep their type if they keep being a multiple of the same sector size
+	case EntryType::EntryXA:
+		if ( !source.validXAHeader || length % XA_DATA_SIZE != 0 || length != entry.length )
+		{
+			return false;
+		}
+		break;
+
+	case EntryType::EntryXA_DO:
+		if ( !source.validXAHeader || length % XA_DATA_SIZE == 0 || length % F1_DATA_SIZE != 0 || length != entry.length )
+		{
+			return false;
+		}
+		break;
+
+	case EntryType::EntryDA:
+		length = source.audioSize;
+		if ( length != entry.length )
+		{
+			return false;
+		}
+		break;
+
+	default:
+		return false;
+	}
+
+	entry.length = length;
+	entry.date = GetISODateStamp( source.attrib->st_mtime, entry.date.GMToffs, settings );
+	return true;
+}
+
 void iso::DirTreeClass::AddDummyEntry(const unsigned int sectors, const unsigned char submode, const unsigned int flba, const bool eccAddr)
 {
 	DIRENTRY entry {};
@@ -260,24 +508,32 @@ iso::DirTreeClass* iso::DirTreeClass::AddSubDirEntry(const char* id, const fs::p
 	// a new directory to 'entries'.
 	// TODO: It's not possible now, but a warning should be issued if entry attributes are specified for the subsequent occurences
 	// of the directory. This check probably needs to be moved outside of the function.
-	for(auto& e : entriesInDir)
+	std::string temp_name;
+	if (id != nullptr)
 	{
-		const iso::DIRENTRY& entry = e.get();
-		if((entry.type == EntryType::EntryDir) && (entry.id == id))
+		temp_name = id;
+		for ( char& ch : temp_name )
+		{
+			ch = toupper( ch );
+		}
+
+		if ( const auto it = entriesByName.find( temp_name ); it != entriesByName.end() && it->second->type == EntryType::EntryDir )
 		{
 			alreadyExists = true;
-			return entry.subdir.get();
+			return it->second->subdir.get();
 		}
 	}
 
-	auto fileAttrib = Stat(srcDir);
+	auto fileAttrib = sourceCache != nullptr
+		? sourceCache->Get(srcDir, false, false).attrib
+		: Stat(srcDir);
 	if (!fileAttrib.has_value())
 	{
-		fileAttrib.emplace().st_mtime = global::BuildTime;
+		fileAttrib.emplace().st_mtime = settings->BuildTime;
 	
-		if ( id != nullptr && !global::noWarns )
+		if ( id != nullptr && !settings->noWarns )
 		{
-			if ( !global::QuietMode )
+			if ( !settings->QuietMode )
 			{
 				printf( "\n    " );
 			}
@@ -288,15 +544,7 @@ iso::DirTreeClass* iso::DirTreeClass::AddSubDirEntry(const char* id, const fs::p
 
 	DIRENTRY entry {};
 
-	if (id != nullptr)
-	{
-		entry.id = id;
-		for ( char& ch : entry.id )
-		{
-			ch = toupper( ch );
-		}
-	}
-
+	entry.id		= entries.InternName(temp_name);
 	entry.type		= EntryType::EntryDir;
 	entry.subdir	= std::make_unique<DirTreeClass>(entries, this);
 	entry.HF		= attributes.HFLAG % 4;
@@ -306,12 +554,16 @@ iso::DirTreeClass* iso::DirTreeClass::AddSubDirEntry(const char* id, const fs::p
 	entry.UID		= attributes.UID;
 	entry.order		= attributes.ORDER;
 	entry.flba		= attributes.FLBA;
-	entry.date		= GetISODateStamp( fileAttrib->st_mtime, attributes.GMTOffs );
+	entry.date		= GetISODateStamp( fileAttrib->st_mtime, attributes.GMTOffs, *settings );
 	entry.length	= 0; // Length is meaningless for directories
 
 	entries.emplace_back(std::move(entry));
 	entries.back().subdir->entry = &entries.back();
 	entriesInDir.emplace_back(entries.back());
+	if ( !entries.back().id.empty() )
+	{
+		entriesByName.try_emplace(entries.back().id, &entries.back());
+	}
 
 	return entries.back().subdir.get();
 }
@@ -329,11 +581,18 @@ void iso::DirTreeClass::PrintRecordPath()
 
 int iso::DirTreeClass::CalculateTreeLBA(int lba)
 {
-	int maxFlba = 0;
-	int sizeMax = 0;
+	// End of the furthest entry with a forced LBA
+	int maxFlbaEnd = 0;
 
 	for ( DIRENTRY& entry : entries )
 	{
+		// Duplicates take no space of their own, the entry they share the extent of always comes first
+		if ( entry.sharedWith != nullptr )
+		{
+			entry.lba = entry.sharedWith->lba;
+			continue;
+		}
+
 		// Set current LBA to directory record entry
 		entry.lba = (entry.flba)
 			? entry.flba
@@ -354,9 +613,8 @@ int iso::DirTreeClass::CalculateTreeLBA(int lba)
 			// Increment LBA by the size of file
 			if ( entry.type == EntryType::EntryXA )
 			{
-				if (entry.flba > maxFlba) {
-					maxFlba = entry.flba;
-					sizeMax = GetSizeInSectors(entry.length, XA_DATA_SIZE);
+				if (entry.flba) {
+					maxFlbaEnd = std::max<int>(maxFlbaEnd, entry.flba + GetSizeInSectors(entry.length, XA_DATA_SIZE));
 				}
 
 				lba += GetSizeInSectors(entry.length, XA_DATA_SIZE);
@@ -368,17 +626,16 @@ int iso::DirTreeClass::CalculateTreeLBA(int lba)
 			}
 			else
 			{	
-				if (entry.flba > maxFlba) {
-					maxFlba = entry.flba;
-					sizeMax = GetSizeInSectors(entry.length, F1_DATA_SIZE);
+				if (entry.flba) {
+					maxFlbaEnd = std::max<int>(maxFlbaEnd, entry.flba + GetSizeInSectors(entry.length, F1_DATA_SIZE));
 				}
 
 				lba += GetSizeInSectors(entry.length, F1_DATA_SIZE);
 			}
 		}
 	}
-	if (maxFlba)
-		return maxFlba + sizeMax;
+	if (maxFlbaEnd)
+		return maxFlbaEnd;
 
 	return lba;
 }
@@ -387,7 +644,7 @@ int iso::DirTreeClass::CalculateDirEntryLen() const
 {
 	int dirEntryLen = 68;
 
-	if ( !global::noXA )
+	if ( !settings->noXA )
 	{
 		dirEntryLen += 28;
 	}
@@ -405,7 +662,7 @@ int iso::DirTreeClass::CalculateDirEntryLen() const
 		dataLen += entry.id.length();
 		dataLen = RoundToEven(dataLen);
 
-		if ( !global::noXA )
+		if ( !settings->noXA )
 		{
 			dataLen += sizeof( cdxa::ISO_XA_ATTRIB );
 		}
@@ -472,7 +729,7 @@ bool iso::DirTreeClass::WriteDirEntries(cd::IsoWriter* writer, const DIRENTRY& d
 
 	//writer->SeekToSector( dir.lba );
 
-	auto writeOneEntry = [&sectorView](const DIRENTRY& entry, std::optional<bool> currentOrParent = std::nullopt) -> void
+	auto writeOneEntry = [&sectorView, this](const DIRENTRY& entry, std::optional<bool> currentOrParent = std::nullopt) -> void
 	{
 		std::byte buffer[128] {};
 
@@ -497,7 +754,7 @@ bool iso::DirTreeClass::WriteDirEntries(cd::IsoWriter* writer, const DIRENTRY& d
 		}
 		else if ( entry.type == EntryType::EntryDA )
 		{
-			if(entry.lba == iso::DA_FILE_PLACEHOLDER_LBA && !global::noWarns)
+			if(entry.lba == iso::DA_FILE_PLACEHOLDER_LBA && !settings->noWarns)
 			{
 				printf("\nWARNING: DA file still has placeholder value 0x%X... ", iso::DA_FILE_PLACEHOLDER_LBA);
 			}
@@ -522,7 +779,7 @@ bool iso::DirTreeClass::WriteDirEntries(cd::IsoWriter* writer, const DIRENTRY& d
 		if (!currentOrParent.has_value())
 		{
 			dirEntry->identifierLen = entry.id.length();
-			strncpy(identifierBuffer, entry.id.c_str(), entry.id.length());
+			memcpy(identifierBuffer, entry.id.data(), entry.id.length());
 		}
 		else
 		{
@@ -533,7 +790,7 @@ bool iso::DirTreeClass::WriteDirEntries(cd::IsoWriter* writer, const DIRENTRY& d
 		entryLength += dirEntry->identifierLen;
 		entryLength = RoundToEven(entryLength);
 
-		if ( !global::noXA )
+		if ( !settings->noXA )
 		{
 			auto xa = reinterpret_cast<cdxa::ISO_XA_ATTRIB*>(buffer+entryLength);
 
@@ -548,7 +805,7 @@ bool iso::DirTreeClass::WriteDirEntries(cd::IsoWriter* writer, const DIRENTRY& d
 			else if (entry.type == EntryType::EntryXA)
 			{
 				attributes |= entry.attribs != 0xFFu ? (entry.attribs << 8) : 0x3800;
-				xa->filenum = MinimumOne(fs::ifstream(entry.srcfile, std::ios::binary).get());
+				xa->filenum = MinimumOne(fs::ifstream(entry.GetSourcePath(), std::ios::binary).get());
 			}
 			else if (entry.type == EntryType::EntryDir)
 			{
@@ -592,6 +849,7 @@ bool iso::DirTreeClass::WriteDirEntries(cd::IsoWriter* writer, const DIRENTRY& d
 
 bool iso::DirTreeClass::WriteDirectoryRecords(cd::IsoWriter* writer, const DIRENTRY& root, int totalDirs)
 {
+	profiler::Scope scope("write directories");
 	if(!WriteDirEntries( writer, root, root, totalDirs ))
 	{
 		return false;
@@ -614,110 +872,149 @@ bool iso::DirTreeClass::WriteDirectoryRecords(cd::IsoWriter* writer, const DIREN
 	return true;
 }
 
-bool iso::DirTreeClass::WriteFiles(cd::IsoWriter* writer) const
+bool iso::DirTreeClass::WriteFiles(cd::IsoWriter* writer, FileHashes* fileHashes) const
 {
-	for ( const DIRENTRY& entry : entries )
+	profiler::Scope scope("write files");
+
+	// Go in LBA order, so sequential outputs can send every file out as soon as it is written
+	std::vector<std::reference_wrapper<const DIRENTRY>> sortedEntries(entries.begin(), entries.end());
+	std::stable_sort(sortedEntries.begin(), sortedEntries.end(), [](const auto& left, const auto& right)
+		{
+			return left.get().lba < right.get().lba;
+		});
+
+	for ( const DIRENTRY& entry : sortedEntries )
 	{
-		// Write files as regular data sectors
-		if ( entry.type == EntryType::EntryFile )
+		// The contents of duplicates are written along with the file they share the extent of
+		if ( entry.sharedWith != nullptr )
 		{
-			if ( !entry.srcfile.empty() )
-			{
-				if ( !global::QuietMode )
-				{
-					printf( "    Packing \"%s\"... ", entry.srcfile.lexically_normal().string().c_str() );
-					fflush(stdout);
-				}
+			continue;
+		}
 
-				FILE *fp = OpenFile( entry.srcfile, "rb" );
-				if (fp != nullptr)
-				{
-					auto sectorView = writer->GetSectorViewM2F1(entry.lba, GetSizeInSectors(entry.length), cd::IsoWriter::EdcEccForm::Form1);
-					sectorView->WriteFile(fp);
+		if ( entry.type != EntryType::EntryDir && entry.type != EntryType::EntryDA )
+		{
+			writer->Commit( entry.lba );
+		}
+		WriteFileEntry( writer, entry, fileHashes );
+	}
 
-					fclose(fp);
-				}
+	return true;
+}
 
-				if ( !global::QuietMode )
-				{
-					printf("Done.\n");
-				}
+void iso::DirTreeClass::WriteFileEntry(cd::IsoWriter* writer, const DIRENTRY& entry, FileHashes* fileHashes) const
+{
+	profiler::Scope scope("pack file", entry.id);
 
+	// Files are hashed while they are packed, so their data is only read once
+	auto packFile = [fileHashes](cd::IsoWriter::SectorView* sectorView, FILE* fp, const DIRENTRY& entry)
+		{
+			hash::Digester digester;
+			if ( fileHashes != nullptr )
+			{
+				sectorView->SetPayloadHasher( &digester );
 			}
+			sectorView->WriteFile( fp );
+			sectorView->SetPayloadHasher( nullptr );
 
-		// Write XA/STR video streams as Mode 2 Form 1 (video sectors) and Mode 2 Form 2 (XA audio sectors)
-		// Video sectors have EDC/ECC while XA does not
-		}
-		else if ( entry.type == EntryType::EntryXA )
+			if ( fileHashes != nullptr )
+			{
+				(*fileHashes)[&entry] = digester.Finish();
+			}
+		};
+
+	// Write files as regular data sectors
+	if ( entry.type == EntryType::EntryFile )
+	{
+		if ( !entry.srcfile.empty() )
 		{
-			if ( !global::QuietMode )
+			if ( !settings->QuietMode )
 			{
-				printf( "    Packing XA \"%s\"... ", entry.srcfile.lexically_normal().string().c_str() );
+				printf( "    Packing \"%s\"... ", entry.GetSourcePath().lexically_normal().string().c_str() );
 				fflush(stdout);
 			}
 
-			FILE *fp = OpenFile( entry.srcfile, "rb" );
+			FILE *fp = OpenFile( entry.GetSourcePath(), "rb" );
 			if (fp != nullptr)
 			{
-				auto sectorView = writer->GetSectorViewM2F2(entry.lba, GetSizeInSectors(entry.length, XA_DATA_SIZE), cd::IsoWriter::EdcEccForm::Autodetect);
-				sectorView->WriteFile(fp);
+				auto sectorView = writer->GetSectorViewM2F1(entry.lba, GetSizeInSectors(entry.length), cd::IsoWriter::EdcEccForm::Form1);
+				packFile(sectorView.get(), fp, entry);
 
-				fclose( fp );
-			}			
+				fclose(fp);
+			}
 
-			if (!global::QuietMode)
+			if ( !settings->QuietMode )
 			{
-				printf( "Done.\n" );
+				printf("Done.\n");
 			}
 
-		// Write data only STR streams as Mode 2 Form 1
 		}
-		else if ( entry.type == EntryType::EntryXA_DO )
-		{
-			if ( !entry.srcfile.empty() )
-			{
-				if ( !global::QuietMode )
-				{
-					printf( "    Packing XA-DO \"%s\"... ", entry.srcfile.lexically_normal().string().c_str() );
-					fflush(stdout);
-				}
 
-				FILE *fp = OpenFile( entry.srcfile, "rb" );
-				if (fp != nullptr)
-				{
-					auto sectorView = writer->GetSectorViewM2F1(entry.lba, GetSizeInSectors(entry.length), cd::IsoWriter::EdcEccForm::Form1);
-					sectorView->SetSubheader(cd::IsoWriter::SubSTR);
-					sectorView->WriteFile(fp);
+	// Write XA/STR video streams as Mode 2 Form 1 (video sectors) and Mode 2 Form 2 (XA audio sectors)
+	// Video sectors have EDC/ECC while XA does not
+	}
+	else if ( entry.type == EntryType::EntryXA )
+	{
+		if ( !settings->QuietMode )
+		{
+			printf( "    Packing XA \"%s\"... ", entry.GetSourcePath().lexically_normal().string().c_str() );
+			fflush(stdout);
+		}
 
-					fclose(fp);
-				}
+		FILE *fp = OpenFile( entry.GetSourcePath(), "rb" );
+		if (fp != nullptr)
+		{
+			auto sectorView = writer->GetSectorViewM2F2(entry.lba, GetSizeInSectors(entry.length, XA_DATA_SIZE), cd::IsoWriter::EdcEccForm::Autodetect);
+			packFile(sectorView.get(), fp, entry);
 
-				if ( !global::QuietMode )
-				{
-					printf("Done.\n");
-				}
+			fclose( fp );
+		}			
 
-			}
+		if (!settings->QuietMode)
+		{
+			printf( "Done.\n" );
 		}
-		// Write dummies as gaps without data
-		else if ( entry.type == EntryType::EntryDummy )
+
+	// Write data only STR streams as Mode 2 Form 1
+	}
+	else if ( entry.type == EntryType::EntryXA_DO )
+	{
+		if ( !entry.srcfile.empty() )
 		{
-			// TODO: HUGE HACK, will be removed once EntryDummy is unified with EntryFile again
-			const bool isForm2 = entry.attribs & 0x20;
+			if ( !settings->QuietMode )
+			{
+				printf( "    Packing XA-DO \"%s\"... ", entry.GetSourcePath().lexically_normal().string().c_str() );
+				fflush(stdout);
+			}
+
+			FILE *fp = OpenFile( entry.GetSourcePath(), "rb" );
+			if (fp != nullptr)
+			{
+				auto sectorView = writer->GetSectorViewM2F1(entry.lba, GetSizeInSectors(entry.length), cd::IsoWriter::EdcEccForm::Form1);
+				sectorView->SetSubheader(cd::IsoWriter::SubSTR);
+				packFile(sectorView.get(), fp, entry);
 
-			const uint32_t sizeInSectors = GetSizeInSectors(entry.length);
-			auto sectorView = writer->GetSectorViewM2F1(entry.lba, sizeInSectors, isForm2 ? cd::IsoWriter::EdcEccForm::Form2 : cd::IsoWriter::EdcEccForm::Form1);
+				fclose(fp);
+			}
+
+			if ( !settings->QuietMode )
+			{
+				printf("Done.\n");
+			}
 
-			sectorView->WriteBlankSectors(sizeInSectors, entry.attribs, entry.HF);
-		}
-		// Write DA files as audio tracks
-		else
-		{
-			continue;
 		}
 	}
+	// Write dummies as gaps without data
+	else if ( entry.type == EntryType::EntryDummy )
+	{
+		// TODO: HUGE HACK, will be removed once EntryDummy is unified with EntryFile again
+		const bool isForm2 = entry.attribs & 0x20;
 
-	return true;
+		const uint32_t sizeInSectors = GetSizeInSectors(entry.length);
+		auto sectorView = writer->GetSectorViewM2F1(entry.lba, sizeInSectors, isForm2 ? cd::IsoWriter::EdcEccForm::Form2 : cd::IsoWriter::EdcEccForm::Form1);
+
+		sectorView->WriteBlankSectors(sizeInSectors, entry.attribs, entry.HF);
+	}
+	// DA files are written as audio tracks
 }
 
 void iso::DirTreeClass::OutputHeaderListing(FILE* fp, int level) const
@@ -735,7 +1032,8 @@ void iso::DirTreeClass::OutputHeaderListing(FILE* fp, int level) const
 		const DIRENTRY& entry = e.get();
 		if ( !entry.id.empty() && entry.type != EntryType::EntryDir )
 		{
-			std::string temp_name = "LBA_" + entry.id;
+			std::string temp_name = "LBA_";
+			temp_name += entry.id;
 
 			for ( char& ch : temp_name )
 			{
@@ -786,7 +1084,7 @@ void iso::DirTreeClass::OutputLBAlisting(FILE* fp, int level) const
 		// Write size in byte units
 		fprintf(fp, "%-11s|", entry.type != EntryType::EntryDir ? std::to_string(entry.length).c_str() : "");
 		// Write source file path
-		fprintf(fp, "%s\n", entry.srcfile.lexically_normal().string().c_str());
+		fprintf(fp, "%s\n", entry.GetSourcePath().lexically_normal().string().c_str());
 	};
 
 	int maxlba = 0;
@@ -898,7 +1196,7 @@ std::unique_ptr<iso::PathTableClass> iso::DirTreeClass::GenPathTableSub(unsigned
 			if (entry.type == EntryType::EntryDir)
 			{
 				table->entries.emplace_back(PathEntryClass{
-					entry.id,
+					std::string(entry.id),
 					index++,
 					currentParentIndex,
 					entry.lba
@@ -986,6 +1284,7 @@ int iso::DirTreeClass::GetPathDepth(size_t* pathLength) const
 
 void iso::WriteLicenseData(cd::IsoWriter* writer, void* data, const bool& ps2)
 {
+	profiler::Scope scope("write license");
 	auto licenseSectors = writer->GetSectorViewM2F2(0, 12, cd::IsoWriter::EdcEccForm::Form1);
 	licenseSectors->WriteMemory(data, XA_DATA_SIZE * 12);
 
@@ -1023,6 +1322,9 @@ static void CopyStringPadWithSpaces(char (&dest)[N], const char* src, const bool
 
 void iso::WriteDescriptor(cd::IsoWriter* writer, const iso::IDENTIFIERS& id, const DIRENTRY& root, int imageLen)
 {
+	profiler::Scope scope("write descriptors");
+	const Settings& settings = *root.subdir->settings;
+
 	cd::ISO_DESCRIPTOR isoDescriptor {};
 
 	isoDescriptor.header.type = 1;
@@ -1059,7 +1361,7 @@ void iso::WriteDescriptor(cd::IsoWriter* writer, const iso::IDENTIFIERS& id, con
 	isoDescriptor.volumeEffectiveDate = isoDescriptor.volumeExpiryDate = GetUnspecifiedLongDate();
 	isoDescriptor.fileStructVersion = 1;
 
-	if ( !global::noXA )
+	if ( !settings.noXA )
 	{
 		strncpy( (char*)&isoDescriptor.appData[141], "CD-XA001", 8 );
 	}
@@ -1096,10 +1398,10 @@ void iso::WriteDescriptor(cd::IsoWriter* writer, const iso::IDENTIFIERS& id, con
 
 	// Write the descriptor
 	unsigned int currentHeaderLBA = 16;
-	const int ISOver = global::new_type.value_or(false);
+	const int ISOver = settings.new_type.value_or(false);
 
 	auto isoDescriptorSectors = writer->GetSectorViewM2F1(currentHeaderLBA, 2 + ISOver, cd::IsoWriter::EdcEccForm::Form1);
-	isoDescriptorSectors->SetSubheader(global::new_type.value_or(false) ? cd::IsoWriter::SubData : cd::IsoWriter::SubEOL);
+	isoDescriptorSectors->SetSubheader(settings.new_type.value_or(false) ? cd::IsoWriter::SubData : cd::IsoWriter::SubEOL);
 
 	isoDescriptorSectors->WriteMemory(&isoDescriptor, sizeof(isoDescriptor));
 
@@ -1176,3 +1478,75 @@ unsigned char* iso::PathTableClass::GenTableData(unsigned char* buff, bool msb)
 	return buff;
 
 }
+
+bool iso::PackFileAsCDDA(cd::IsoWriter::RawSectorView* view, const fs::path& audioFile, const Settings& settings)
+{
+	profiler::Scope scope("decode audio");
+
+	// open the decoder
+	ma_decoder decoder;
+	VirtualWavEx vw;
+	bool isLossy;
+	bool isPCM;
+	if(ma_redbook_decoder_init_path_by_ext(audioFile, &decoder, &vw, isLossy, isPCM) != MA_SUCCESS)
+	{
+		ma_decoder_uninit(&decoder);
+		return false;
+	}
+	else if (isPCM && !settings.QuietMode && !settings.noWarns)
+	{
+		printf("\n      WARNING: Guessing it's signed 16 bit stereo @ 44100 kHz pcm audio... ");
+	}
+
+	// note if there's some data converting going on
+	ma_format internalFormat;
+	ma_uint32 internalChannels;
+	ma_uint32 internalSampleRate;
+	if(ma_data_source_get_data_format(decoder.pBackend, &internalFormat, &internalChannels, &internalSampleRate, NULL, 0) != MA_SUCCESS)
+	{
+		report::Error("\n    ", "unable to get internal metadata for \"%s\"", audioFile.string().c_str());
+		ma_decoder_uninit(&decoder);
+		return false;
+	}
+	if(((internalFormat != ma_format_s16) || (internalChannels != 2) || (internalSampleRate != 44100) || isLossy) && !settings.QuietMode && !settings.noWarns)
+	{
+		printf("\n      WARNING: This is not Redbook audio, converting... ");
+	}
+
+	// get expected pcm frame count (if your file isn't redbook this can vary from the input file's amount)
+	// unfortunately it needs to decode the whole file to determine this for mp3
+	ma_uint64 expectedPCMFrames;
+	if(ma_decoder_get_length_in_pcm_frames(&decoder, &expectedPCMFrames) != MA_SUCCESS)
+	{
+		report::Error("\n    ", "corrupt file? unable to get_length_in_pcm_frames");
+		ma_decoder_uninit(&decoder);
+		return false;
+	}
+
+	// Decode a second of audio at a time, so neither the whole track nor its whole sector range has to be held in memory
+	static constexpr ma_uint64 CHUNK_FRAMES = 588 * 75;
+	static constexpr size_t BYTES_PER_FRAME = CD_SECTOR_SIZE / 588; // 16-bit stereo
+	std::vector<unsigned char> chunk(CHUNK_FRAMES * BYTES_PER_FRAME);
+
+	ma_uint64 framesRead = 0;
+	while(framesRead < expectedPCMFrames)
+	{
+		ma_uint64 chunkFramesRead;
+		ma_decoder_read_pcm_frames(&decoder, chunk.data(), std::min(CHUNK_FRAMES, expectedPCMFrames - framesRead), &chunkFramesRead);
+		if(chunkFramesRead == 0)
+		{
+			break;
+		}
+
+		view->WriteMemory(chunk.data(), static_cast<size_t>(chunkFramesRead) * BYTES_PER_FRAME);
+		framesRead += chunkFramesRead;
+	}
+	ma_decoder_uninit(&decoder);
+
+	if(framesRead != expectedPCMFrames)
+	{
+		report::Error("\n    ", "corrupt file? (framesRead != expectedPCMFrames)");
+		return false;
+	}
+	return true;
+}
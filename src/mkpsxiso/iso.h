@@ -3,7 +3,10 @@
 
 #include "cdwriter.h"
 #include "common.h"
-#include <list>
+#include "platform.h"
+#include "stablevector.h"
+#include "stringpool.h"
+#include <unordered_map>
 
 namespace iso
 {
@@ -20,14 +23,27 @@ namespace iso
 		const char* ModificationDate;
 	} IDENTIFIERS;
 
+	using PathView = std::basic_string_view<fs::path::value_type>;
+
+	/// Options of a single image build, shared by the entire directory tree
+	struct Settings
+	{
+		time_t	BuildTime = 0;			/// Date stamp of entries without one of their own
+		std::optional<bool> new_type;	/// Layout of the newer mastering tool, unset for date stamps compatible with <=v2.04 dumps
+		bool	noXA = false;			/// Plain ISO9660 without CD-XA extended attributes
+		bool	QuietMode = false;
+		bool	noWarns = false;
+	};
+
 	struct DIRENTRY
 	{
-		std::string		id;			/// Entry identifier (empty if invisible dummy)
+		std::string_view id;		/// Entry identifier (empty if invisible dummy), interned in EntryList
 		int64_t			length;		/// Length of file in bytes
 		int				lba;		/// File LBA (in sectors)
 		int 			flba;		/// Force LBA
+		DIRENTRY*		sharedWith;	/// Entry with identical contents whose extent is used instead (see DeduplicateFiles)
 
-		fs::path 		srcfile;	/// Filename with path to source file (empty if directory or dummy)
+		PathView 		srcfile;	/// Filename with path to source file (empty if directory or dummy), interned in EntryList
 		EntryType		type;		/// File type (0 - file, 1 - directory)
 		unsigned char	HF;			/// Hidden Flag
 		unsigned char	attribs;	/// XA attributes, 0xFF is not set
@@ -40,10 +56,83 @@ namespace iso
 		std::string		trackid;	/// only used for DA files
 		signed short	order;
 
+		fs::path GetSourcePath() const { return fs::path(srcfile); }
 	};
 
+	/// Size and hashes of the contents of the files packed into an image
+	using FileHashes = std::unordered_map<const DIRENTRY*, hash::Digests>;
+
 	// EntryList must have stable references!
-	using EntryList = std::list<DIRENTRY>;
+	// Entries live in chunks rather than individual nodes, and the strings they
+	// refer to are interned in pools owned by the list.
+	class EntryList : public StableVector<DIRENTRY>
+	{
+	public:
+		std::string_view InternName(std::string_view name) { return m_names.Intern(name); }
+		PathView InternPath(const fs::path& path) { return m_paths.Intern(path.native()); }
+
+	private:
+		StringPool m_names;
+		BasicStringPool<fs::path::value_type> m_paths;
+	};
+
+	/// Metadata of a source file, gathered ahead of tree construction or on demand
+	struct SourceInfo
+	{
+		std::optional<struct stat64> attrib;	/// Empty if the file could not be found
+		bool	validXAHeader	= false;		/// Only valid if probedXA is set
+		int		audioSize		= 0;			/// Only valid if probedAudio is set
+		bool	probedXA		= false;
+		bool	probedAudio		= false;
+	};
+
+	/** Stats a source file and runs the requested content probes on it.
+	 *
+	 *	srcfile		- Path to the source file.
+	 *	probeXA		- Check for a RIFF header, which XA sources must not have.
+	 *	probeAudio	- Get the size of the file once converted to CDDA sectors.
+	 *	previous	- Earlier metadata of the file, whose probes are reused if the file has the same
+	 *				  size and modification time, or null.
+	 */
+	SourceInfo ProbeSource(const fs::path& srcfile, bool probeXA, bool probeAudio, const SourceInfo* previous = nullptr);
+
+	class SourceCache
+	{
+	public:
+		/** Queues a source file to be probed by Prefetch(). Adding the same file several times merges
+		 *	the requested probes.
+		 */
+		void Add(const fs::path& srcfile, bool probeXA, bool probeAudio);
+
+		/** Stats and probes all queued source files concurrently. Files probed by an earlier call
+		 *	which have not changed since keep the results of their probes, files which were not
+		 *	added again since the earlier call are dropped.
+		 */
+		void Prefetch();
+
+		/** Returns the metadata of a source file, probing it on the spot if it was not prefetched
+		 *	with the requested probes.
+		 */
+		SourceInfo Get(const fs::path& srcfile, bool probeXA, bool probeAudio) const;
+
+		size_t GetCount() const { return m_sources.size(); }
+
+		/** Returns the paths of all source files added so far.
+		 */
+		std::vector<fs::path> GetPaths() const;
+
+	private:
+		struct Source
+		{
+			fs::path	path;
+			SourceInfo	info;
+			bool		probeXA		= false;	/// Probes requested since the last Prefetch()
+			bool		probeAudio	= false;
+			bool		added		= false;	/// Added since the last Prefetch()
+		};
+
+		std::unordered_map<fs::path::string_type, Source> m_sources;
+	};
 	
 	class PathEntryClass {
 	public:
@@ -72,6 +161,9 @@ namespace iso
 		DIRENTRY* entry = nullptr;
 
 		DirTreeClass* parent; // Non-owning
+
+		// Case insensitive index of the named entries in entriesInDir, for constant time duplicate lookups
+		std::unordered_map<std::string_view, DIRENTRY*, ICaseHash, ICaseEqual> entriesByName;
 		
 		/// Internal function for generating and writing directory records
 		bool WriteDirEntries(cd::IsoWriter* writer, const DIRENTRY& dir, const DIRENTRY& parentDir, const int totalDirs) const;
@@ -87,7 +179,10 @@ namespace iso
 		DirTreeClass(EntryList& entries, DirTreeClass* parent = nullptr, std::string name = "<root>");
 		~DirTreeClass();
 
-		static DIRENTRY& CreateRootDirectory(EntryList& entries, const cd::ISO_DATESTAMP& volumeDate, const EntryAttributes& attributes);
+		const SourceCache* sourceCache = nullptr; // Non-owning, shared by the entire tree
+		const Settings* settings = nullptr; // Non-owning, shared by the entire tree
+
+		static DIRENTRY& CreateRootDirectory(EntryList& entries, const cd::ISO_DATESTAMP& volumeDate, const EntryAttributes& attributes, const Settings& settings, const SourceCache* sourceCache = nullptr);
 
 		void PrintRecordPath();
 
@@ -150,9 +245,15 @@ namespace iso
 		/**	Writes the source files assigned to the directory entries to a CD image. Its recommended to execute
 		 *	this first before writing the actual file system.
 		 *
-		 *	*writer	- Pointer to a cd::IsoWriter class that is ready for writing.
+		 *	*writer		- Pointer to a cd::IsoWriter class that is ready for writing.
+		 *	*fileHashes	- Receives the hashes of the source data of every file as it is packed, or null.
 		 */
-		bool WriteFiles(cd::IsoWriter* writer) const;
+		bool WriteFiles(cd::IsoWriter* writer, FileHashes* fileHashes = nullptr) const;
+
+		/**	Writes the source file of a single entry to its extent, for writing a changed file into an
+		 *	image again. Directories and DA files are left alone.
+		 */
+		void WriteFileEntry(cd::IsoWriter* writer, const DIRENTRY& entry, FileHashes* fileHashes = nullptr) const;
 
 		/**	Writes the file system of the directory records to a CD image. Execute this after the source files
 		 *	have been written to the CD image.
@@ -174,10 +275,40 @@ namespace iso
 		void OutputLBAlisting(FILE* fp, int level) const;
 	};
 
+	/** Finds files with identical contents and points all but the first of them at the extent of the
+	 *	first, so their data is only written to the image once. Source files of the same type and size
+	 *	are hashed concurrently, matching hashes are then confirmed by comparing the files. Files with
+	 *	a forced LBA are left alone. Run this before CalculateTreeLBA().
+	 *
+	 *	entries			- All entries on the disc.
+	 *	savedSectors	- Receives the number of sectors no longer taken by the duplicates.
+	 *
+	 *	Returns: Number of files sharing the extent of another file.
+	 */
+	size_t DeduplicateFiles(EntryList& entries, uint32_t& savedSectors);
+
+	/** Takes the new size and date of a changed source file into its entry.
+	 *
+	 *	entry		- File, XA or DA entry of the source file.
+	 *	source		- Metadata of the changed file, probed for XA and audio like the entry was.
+	 *
+	 *	Returns: False, leaving the entry alone, if the file is missing or no longer takes the same
+	 *	number of sectors as the same type of entry, which means the layout has to be calculated again.
+	 */
+	bool UpdateFileEntry(DIRENTRY& entry, const SourceInfo& source, const Settings& settings);
+
 	void WriteLicenseData(cd::IsoWriter* writer, void* data, const bool& ps2);
 
 	void WriteDescriptor(cd::IsoWriter* writer, const IDENTIFIERS& id, const DIRENTRY& root, int imageLen);
 
+	/** Decodes an audio file to Redbook CD audio, a chunk at a time.
+	 *
+	 *	*view		- Destination of the decoded audio, at least GetAudioSize() bytes long.
+	 *	audioFile	- Path of a WAV, FLAC, MP3 or raw PCM file.
+	 *	settings	- Build settings, for the quiet and warning flags.
+	 */
+	bool PackFileAsCDDA(cd::IsoWriter::RawSectorView* view, const fs::path& audioFile, const Settings& settings);
+
 	const int DA_FILE_PLACEHOLDER_LBA = 0xDEADBEEF;
 
 };
@@ -0,0 +1,336 @@
+#include "layout.h"
+#include <algorithm>
+#include <map>
+
+static uint32_t GetEntrySectors(const iso::DIRENTRY& entry)
+{
+	if ( entry.subdir != nullptr )
+	{
+		return GetSizeInSectors(entry.subdir->CalculateDirEntryLen());
+	}
+	if ( entry.type == EntryType::EntryXA )
+	{
+		return GetSizeInSectors(entry.length, XA_DATA_SIZE);
+	}
+	return GetSizeInSectors(entry.length, F1_DATA_SIZE);
+}
+
+static bool IsPlacedFile(const iso::DIRENTRY& entry)
+{
+	// DA files only link to audio tracks and duplicates share the extent of another file,
+	// neither take space of their own in the file system
+	return entry.subdir == nullptr && entry.type != EntryType::EntryDA && entry.sharedWith == nullptr;
+}
+
+static void CollectFilePaths(const iso::DirTreeClass* dirTree, const std::string& prefix, std::unordered_map<std::string, iso::DIRENTRY*>& paths)
+{
+	for ( const auto& e : dirTree->entriesInDir )
+	{
+		iso::DIRENTRY& entry = e.get();
+		if ( entry.id.empty() )
+		{
+			continue;
+		}
+
+		if ( entry.subdir != nullptr )
+		{
+			CollectFilePaths(entry.subdir.get(), prefix + std::string(entry.id) + '/', paths);
+		}
+		else if ( IsPlacedFile(entry) )
+		{
+			paths.emplace(seeksim::NormalizeDiscPath(prefix + std::string(entry.id)), &entry);
+		}
+		else if ( entry.sharedWith != nullptr )
+		{
+			// Reads of a duplicate go to the file it shares the extent of
+			paths.emplace(seeksim::NormalizeDiscPath(prefix + std::string(entry.id)), entry.sharedWith);
+		}
+	}
+}
+
+// Resolves trace reads to the sequence of files they access, merging consecutive reads of the same file
+static std::vector<iso::DIRENTRY*> ResolveTrace(iso::DirTreeClass* dirTree, const std::vector<seeksim::TraceRead>& trace, size_t& unresolved)
+{
+	std::unordered_map<std::string, iso::DIRENTRY*> paths;
+	CollectFilePaths(dirTree, std::string(), paths);
+
+	std::vector<iso::DIRENTRY*> filesByLBA;
+	for ( iso::DIRENTRY& entry : dirTree->entries )
+	{
+		if ( IsPlacedFile(entry) )
+		{
+			filesByLBA.push_back(&entry);
+		}
+	}
+	std::sort(filesByLBA.begin(), filesByLBA.end(), [](const iso::DIRENTRY* left, const iso::DIRENTRY* right)
+		{
+			return left->lba < right->lba;
+		});
+
+	std::vector<iso::DIRENTRY*> accesses;
+	unresolved = 0;
+	for ( const seeksim::TraceRead& read : trace )
+	{
+		iso::DIRENTRY* file = nullptr;
+		if ( !read.path.empty() )
+		{
+			if ( auto it = paths.find(read.path); it != paths.end() )
+			{
+				file = it->second;
+			}
+		}
+		else
+		{
+			auto it = std::upper_bound(filesByLBA.begin(), filesByLBA.end(), read.lba, [](uint32_t lba, const iso::DIRENTRY* entry)
+				{
+					return static_cast<int64_t>(lba) < entry->lba;
+				});
+			if ( it != filesByLBA.begin() )
+			{
+				iso::DIRENTRY* candidate = *std::prev(it);
+				if ( read.lba < candidate->lba + GetEntrySectors(*candidate) )
+				{
+					file = candidate;
+				}
+			}
+		}
+
+		if ( file == nullptr )
+		{
+			unresolved++;
+			continue;
+		}
+		if ( accesses.empty() || accesses.back() != file )
+		{
+			accesses.push_back(file);
+		}
+	}
+	return accesses;
+}
+
+// Orders files so the ones most often read one after another end up next to each other.
+// This is the chain merging of Pettis and Hansen's code positioning, applied to files.
+static std::vector<iso::DIRENTRY*> OrderTracedFiles(const std::vector<iso::DIRENTRY*>& accesses)
+{
+	// Index files by their first access
+	std::vector<iso::DIRENTRY*> files;
+	std::unordered_map<const iso::DIRENTRY*, size_t> fileIndices;
+	for ( iso::DIRENTRY* file : accesses )
+	{
+		if ( fileIndices.try_emplace(file, files.size()).second )
+		{
+			files.push_back(file);
+		}
+	}
+
+	struct Transition
+	{
+		size_t first, second;
+		unsigned int weight;
+	};
+
+	std::vector<Transition> transitions;
+	std::map<std::pair<size_t, size_t>, size_t> transitionIndices;
+	for ( size_t i = 1; i < accesses.size(); i++ )
+	{
+		const size_t from = fileIndices[accesses[i - 1]];
+		const size_t to = fileIndices[accesses[i]];
+		auto [it, inserted] = transitionIndices.try_emplace(std::minmax(from, to), transitions.size());
+		if ( inserted )
+		{
+			transitions.push_back({from, to, 0});
+		}
+		transitions[it->second].weight++;
+	}
+
+	// Heaviest transitions first, ties in order of appearance
+	std::stable_sort(transitions.begin(), transitions.end(), [](const Transition& left, const Transition& right)
+		{
+			return left.weight > right.weight;
+		});
+
+	std::vector<std::vector<size_t>> chains(files.size());
+	std::vector<size_t> chainOf(files.size());
+	for ( size_t i = 0; i < files.size(); i++ )
+	{
+		chains[i].push_back(i);
+		chainOf[i] = i;
+	}
+
+	for ( const Transition& transition : transitions )
+	{
+		const size_t firstChain = chainOf[transition.first];
+		const size_t secondChain = chainOf[transition.second];
+		if ( firstChain == secondChain )
+		{
+			continue;
+		}
+
+		// Chains can only be joined at their ends
+		std::vector<size_t>& first = chains[firstChain];
+		std::vector<size_t>& second = chains[secondChain];
+		if ( ( first.front() != transition.first && first.back() != transition.first ) ||
+			( second.front() != transition.second && second.back() != transition.second ) )
+		{
+			continue;
+		}
+
+		if ( first.back() != transition.first )
+		{
+			std::reverse(first.begin(), first.end());
+		}
+		if ( second.front() != transition.second )
+		{
+			std::reverse(second.begin(), second.end());
+		}
+
+		for ( size_t file : second )
+		{
+			chainOf[file] = firstChain;
+		}
+		first.insert(first.end(), second.begin(), second.end());
+		second.clear();
+	}
+
+	// Lay chains out in the order they are first accessed
+	std::vector<std::vector<size_t>*> orderedChains;
+	for ( auto& chain : chains )
+	{
+		if ( !chain.empty() )
+		{
+			orderedChains.push_back(&chain);
+		}
+	}
+	std::sort(orderedChains.begin(), orderedChains.end(), [](const std::vector<size_t>* left, const std::vector<size_t>* right)
+		{
+			return *std::min_element(left->begin(), left->end()) < *std::min_element(right->begin(), right->end());
+		});
+
+	std::vector<iso::DIRENTRY*> result;
+	result.reserve(files.size());
+	for ( const std::vector<size_t>* chain : orderedChains )
+	{
+		for ( size_t file : *chain )
+		{
+			result.push_back(files[file]);
+		}
+	}
+	return result;
+}
+
+static uint64_t GetTraceSeekDistance(const std::vector<iso::DIRENTRY*>& accesses, bool planned)
+{
+	std::vector<seeksim::Extent> reads;
+	reads.reserve(accesses.size());
+	for ( const iso::DIRENTRY* file : accesses )
+	{
+		reads.push_back({ static_cast<uint32_t>(planned ? file->flba : file->lba), GetEntrySectors(*file) });
+	}
+	return seeksim::GetSeekDistance(reads);
+}
+
+bool iso::PlanLayout(DirTreeClass* dirTree, const std::vector<seeksim::TraceRead>& trace, unsigned int xaAlignment)
+{
+	const Settings& settings = *dirTree->settings;
+
+	EntryList& entries = dirTree->entries;
+
+	for ( const DIRENTRY& entry : entries )
+	{
+		if ( entry.flba != 0 )
+		{
+			if ( !settings.noWarns )
+			{
+				printf( "      WARNING: Entries with a forced LBA found, keeping the default layout.\n" );
+			}
+			return false;
+		}
+	}
+
+	size_t unresolved;
+	const std::vector<DIRENTRY*> accesses = ResolveTrace(dirTree, trace, unresolved);
+	if ( unresolved != 0 && !settings.noWarns )
+	{
+		printf( "      WARNING: %zu trace reads do not match any file.\n", unresolved );
+	}
+	if ( accesses.empty() )
+	{
+		if ( !settings.noWarns )
+		{
+			printf( "      WARNING: No files accessed by the trace, keeping the default layout.\n" );
+		}
+		return false;
+	}
+
+	// Directory records stay first, so the root directory does not move
+	int lba = entries.front().lba;
+	auto place = [&lba, xaAlignment](DIRENTRY& entry)
+	{
+		if ( xaAlignment > 1 && entry.type == EntryType::EntryXA )
+		{
+			lba = ((lba + xaAlignment - 1) / xaAlignment) * xaAlignment;
+		}
+		entry.flba = lba;
+		lba += GetEntrySectors(entry);
+	};
+
+	for ( DIRENTRY& entry : entries )
+	{
+		if ( entry.subdir != nullptr )
+		{
+			place(entry);
+		}
+	}
+	for ( DIRENTRY* file : OrderTracedFiles(accesses) )
+	{
+		place(*file);
+	}
+	for ( DIRENTRY& entry : entries )
+	{
+		if ( entry.flba == 0 && IsPlacedFile(entry) )
+		{
+			place(entry);
+		}
+	}
+
+	const uint64_t defaultDistance = GetTraceSeekDistance(accesses, false);
+	const uint64_t plannedDistance = GetTraceSeekDistance(accesses, true);
+	if ( !settings.QuietMode )
+	{
+		printf( "      Trace seek distance: %llu sectors by default, %llu sectors planned\n",
+			static_cast<unsigned long long>(defaultDistance), static_cast<unsigned long long>(plannedDistance) );
+	}
+
+	if ( plannedDistance >= defaultDistance )
+	{
+		for ( DIRENTRY& entry : entries )
+		{
+			entry.flba = 0;
+		}
+		if ( !settings.QuietMode )
+		{
+			printf( "      Planned layout is no better, keeping the default layout.\n" );
+		}
+		return false;
+	}
+
+	return true;
+}
+
+std::vector<seeksim::DiscFile> iso::GetDiscFiles(const DirTreeClass* dirTree)
+{
+	std::unordered_map<std::string, iso::DIRENTRY*> paths;
+	CollectFilePaths(dirTree, std::string(), paths);
+
+	std::vector<seeksim::DiscFile> files;
+	files.reserve(paths.size());
+	for ( const auto& [path, entry] : paths )
+	{
+		files.push_back({ path, static_cast<uint32_t>(entry->lba), GetEntrySectors(*entry) });
+	}
+	std::sort(files.begin(), files.end(), [](const seeksim::DiscFile& left, const seeksim::DiscFile& right)
+		{
+			return left.lba < right.lba;
+		});
+	return files;
+}
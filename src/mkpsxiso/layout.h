@@ -0,0 +1,28 @@
+#ifndef _LAYOUT_H
+#define _LAYOUT_H
+
+#include "iso.h"
+#include "seeksim.h"
+
+namespace iso
+{
+	/** Plans the placement of files on the disc to minimize seeking over an access trace, and applies it
+	 *	by setting the forced LBA of every entry. Directory records are kept first, followed by the traced
+	 *	files grouped by how often they are read one after another, followed by the remaining files.
+	 *	CalculateTreeLBA() must have been run before for the default layout, and run again afterwards.
+	 *
+	 *	dirTree		- Root directory of the file system.
+	 *	trace		- Access trace. Sector reads are matched against the default layout.
+	 *	xaAlignment	- If above 1, XA files are placed at multiples of this many sectors.
+	 *
+	 *	Returns: True if the planned layout was applied, false if the default layout was kept.
+	 */
+	bool PlanLayout(DirTreeClass* dirTree, const std::vector<seeksim::TraceRead>& trace, unsigned int xaAlignment);
+
+	/** Lists the files which take space on the disc with their normalized paths and locations, for
+	 *	simulating access traces. CalculateTreeLBA() must have been run before.
+	 */
+	std::vector<seeksim::DiscFile> GetDiscFiles(const DirTreeClass* dirTree);
+};
+
+#endif // _LAYOUT_H
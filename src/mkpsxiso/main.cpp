@@ -1,10 +1,34 @@
 #include "iso.h"		// ISO file system generator module
+#include "layout.h"
 #include "xml.h"
-
-#define MA_NO_THREADING
-#define MA_NO_DEVICE_IO
-#define MINIAUDIO_IMPLEMENTATION
-#include "miniaudio_helpers.h"
+#include "manifest.h"
+#include "depfile.h"
+#include "profiler.h"
+#include "watch.h"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <deque>
+#include <future>
+
+// An image built in watch mode, kept along with its layout so a changed file which still fits in
+// its extent is written into the image in place instead of building the image again
+struct BuiltImage
+{
+	fs::path imagePath;
+	unsigned int sizeLBA = 0; // Of the image file, without the audio tracks of their own
+	bool xaEdc = true;
+	int totalDirs = 0;
+	iso::Settings settings; // Shared by the directory tree
+	iso::EntryList entries; // Directory tree, starting with the root
+	std::vector<cdtrack> audioTracks;
+	bool hasTrackFiles = false; // The audio tracks are not part of the image file
+
+	// Kept for writing the stamp again with --skip-if-up-to-date
+	fs::path stampPath;
+	std::vector<fs::path> projectFiles;
+	std::vector<fs::path> outputs;
+};
 
 namespace global
 {
@@ -16,11 +40,31 @@ namespace global
 	bool	Overwrite	= false;
 	bool	NoIsoGen 	= false;
 	bool	noXA		= false;
+	bool	StreamXML	= false;
+	bool	EcmOutput	= false;
+	bool	SplitTracks	= false;
+	bool	Dedup		= false;
+	bool	Writeback	= false;
+	bool	Durable		= false;
+	bool	Progress	= false;
+	bool	Watch		= false;
+	bool	SkipIfUpToDate = false;
 	int		trackNum	= 1;
 
 	std::optional<bool> new_type;
 	std::optional<std::string> volid_override;
 	std::optional<fs::path> cuefile;
+	std::optional<fs::path> traceFile;
+	unsigned int traceAlignment = 0;
+	std::optional<fs::path> simulateTraceFile;
+	unsigned int maxMappedMB = 0; // Most memory an image view maps at once, 0 for no limit
+	std::optional<fs::path> progressJsonFile;
+	std::optional<fs::path> traceEventsFile;
+	std::optional<fs::path> depFile;
+	std::optional<fs::path> hashManifestFile;
+	std::string buildOptions; // Command line arguments, a build is only up to date if they stay the same
+	seeksim::DriveModel driveModel;
+	unique_file imageStream; // Original stdout, when writing the image there
 	fs::path XMLscript;
 	fs::path LBAfile;
 	fs::path LBAheaderFile;
@@ -28,13 +72,153 @@ namespace global
 	fs::path RebuildXMLScript;
 
 	tinyxml2::XMLDocument xmlIdFile;
+	std::deque<iso::SourceCache> sourceCaches; // One per project, kept between rebuilds in watch mode
+	std::vector<std::unique_ptr<BuiltImage>> builtImages; // Every image of the last build in watch mode, or none
+};
+
+
+// Directory tree of a project loaded in streaming mode, parsed straight from the XML file when needed
+struct StreamedTree
+{
+	uint64_t offset = 0;
+	int line = 0;
+
+	// Sources of the entries in the tree and whether they are XA files, for prefetching
+	std::vector<std::pair<std::string, bool>> sources;
+
+	// Track IDs assigned to DA files using the source syntax, by the offset of their element
+	std::unordered_map<uint64_t, std::string> daTrackIds;
+};
+
+struct StreamedProject
+{
+	std::unique_ptr<xml::EventReader> reader;
+	std::unordered_map<const tinyxml2::XMLElement*, StreamedTree> trees;
+};
+
+// Sizes and hashes of the tracks and files of an image, for --hash-manifest
+struct HashedImage
+{
+	fs::path name;
+	std::vector<std::pair<std::string, hash::Digests>> items; // Tracks by file name, then files by path in the image
 };
 
+// The BIN file of an audio track, when every track is written to its own file
+struct TrackFile
+{
+	fs::path name;
+	unsigned int lba; // Start of the track on the disc, including its pregap
+};
+
+static bool LoadStreamedProject(const fs::path& xmlPath, tinyxml2::XMLDocument& xmlFile, StreamedProject& project);
+static bool ParseStreamedDirectory(iso::DirTreeClass* rootDir, xml::EventReader& reader, const StreamedTree& streamedTree, const fs::path& xmlPath, const EntryAttributes& defaultAttributes, const tinyxml2::XMLElement* projectElement);
+bool ParseDirectory(iso::DirTreeClass* dirTree, const tinyxml2::XMLElement* parentElement, const fs::path& xmlPath, const EntryAttributes& parentAttribs, const tinyxml2::XMLElement* projectElement);
+int ParseISOfileSystem(const tinyxml2::XMLElement* trackElement, const fs::path& xmlPath, iso::EntryList& entries, iso::IDENTIFIERS& isoIdentifiers, int& totalLen, const iso::Settings& settings, iso::SourceCache& sourceCache, StreamedProject* streamedProject);
+static int BuildProjects(bool OutputOverride);
+static int WatchProjects(bool OutputOverride);
+static bool PatchImages(const fs::path& changed);
+
+// Names track files like Redump sets do, "<image> (Track N).bin"
+static fs::path GetTrackFileName(const fs::path& imageName, int track, int trackCount)
+{
+	if ( trackCount <= 1 )
+	{
+		return imageName;
+	}
+
+	char suffix[16];
+	snprintf( suffix, sizeof(suffix), trackCount >= 10 ? " (Track %02d)" : " (Track %d)", track );
+
+	fs::path name = imageName.parent_path() / imageName.stem();
+	name += suffix;
+	name += imageName.extension();
+	return name;
+}
+
+// Name of the file actually written for an image or track file
+static fs::path GetOutputPath(fs::path name)
+{
+	if ( global::EcmOutput && global::imageStream == nullptr )
+	{
+		name += ".ecm";
+	}
+	return name;
+}
+
+// Creates the writer of an image or track file, as a BIN file, an ECM file or on stdout
+static bool CreateWriter(cd::IsoWriter& writer, const fs::path& path, unsigned int sizeLBA, unique_file& ecmFile, progress::Counters* progress)
+{
+	writer.SetProgress( progress );
+	if ( global::EcmOutput )
+	{
+		if ( global::imageStream == nullptr )
+		{
+			ecmFile = OpenScopedFile( path, "wb" );
+		}
+		FILE* stream = global::imageStream != nullptr ? global::imageStream.get() : ecmFile.get();
+		return stream != nullptr && writer.CreateEcm( stream, sizeLBA, global::xa_edc );
+	}
 
-bool ParseDirectory(iso::DirTreeClass* dirTree, const tinyxml2::XMLElement* parentElement, const fs::path& xmlPath, const EntryAttributes& parentAttribs);
-int ParseISOfileSystem(const tinyxml2::XMLElement* trackElement, const fs::path& xmlPath, iso::EntryList& entries, iso::IDENTIFIERS& isoIdentifiers, int& totalLen);
+	if ( global::imageStream != nullptr )
+	{
+		return writer.CreateStream( global::imageStream.get(), sizeLBA, global::xa_edc );
+	}
 
-bool PackFileAsCDDA(void* buffer, const fs::path& audioFile);
+	cd::MappingOptions options;
+	options.windowLBA = static_cast<unsigned int>(static_cast<uint64_t>(global::maxMappedMB) * 1024 * 1024 / CD_SECTOR_SIZE);
+	options.writeback = global::Writeback || global::Durable;
+	options.durable = global::Durable;
+	return writer.Create( path, sizeLBA, global::xa_edc, options );
+}
+
+static bool CloseWriter(cd::IsoWriter& writer, unique_file& ecmFile)
+{
+	bool closed = writer.Close();
+	if ( ecmFile != nullptr )
+	{
+		if ( global::Durable && !SyncFile( ecmFile.get() ) )
+		{
+			closed = false;
+		}
+		if ( fclose( ecmFile.release() ) != 0 )
+		{
+			closed = false;
+		}
+	}
+	return closed;
+}
+
+// Writes an audio track or pregap at the given LBA of the writer's output
+static void WriteAudioTrack(cd::IsoWriter& writer, const cdtrack& track, unsigned int lba, const iso::Settings& settings, bool verbose)
+{
+	profiler::Scope scope("write audio track", track.source);
+	const uint32_t sizeInSectors = GetSizeInSectors(track.size, CD_SECTOR_SIZE);
+	writer.Commit(lba);
+	auto sectorView = writer.GetRawSectorView(lba, sizeInSectors);
+
+	if (!track.source.empty())
+	{
+		// Pack the audio file
+		if ( verbose )
+		{
+			printf( "    Packing audio \"%s\"... ", track.source.c_str() );
+			fflush(stdout);
+		}
+
+		if ( iso::PackFileAsCDDA( sectorView.get(), track.source, settings ) )
+		{
+			if ( verbose )
+			{
+				printf( "Done.\n" );
+			}
+		}
+	}
+	else
+	{
+		// Write pregap
+		sectorView->WriteBlankSectors();
+	}
+}
 
 bool UpdateDAFilesWithLBA(iso::EntryList& entries, const char *trackid, const unsigned lba)
 {
@@ -63,13 +247,34 @@ int Main(int argc, char* argv[])
 {
 	static constexpr const char* HELP_TEXT =
 		"Usage: mkpsxiso [options <file>] <xmlfile>\n\n"
-		"  <xmlfile>\t\tFile name of disc image project in XML document format\n\n"
+		"  <xmlfile>\t\tFile name of disc image project in XML document format\n"
+		"\t\t\t(or a project manifest in JSON lines format, with a .jsonl extension)\n\n"
 		"Options:\n"
 		"  -h|--help\t\tShows this help text\n"
 		"  -q|--quiet\t\tQuiet mode (suppress all but warnings and errors)\n"
 		"  -w|--warns\t\tSuppress all warnings (can be used along with -q)\n"
 		"  -l|--label\t\tSpecify volume ID (overrides volume element)\n"
 		"  -o|--output <file>\tSpecify output file (overrides image_name attribute)\n"
+		"\t\t\t(- writes the image to stdout, messages then go to stderr)\n"
+		"  -ecm\t\t\tWrite the image as <file>.ecm with regenerable EDC/ECC data left out\n"
+		"  -split\t\tWrite every track to its own BIN file, named <file> (Track N).bin\n"
+		"  --max-mapped-mb <n>\tMap at most n MB of the image at once while writing it, to bound memory\n"
+		"\t\t\tusage of large files and audio tracks (default maps each file whole)\n"
+		"  --writeback\t\tStart writing finished parts of the image to disk while building the rest\n"
+		"  --durable\t\tWait for the image to reach the disk before exiting (implies --writeback)\n"
+		"  --progress\t\tShow a status line with throughput and ETA on stderr (best used with -q)\n"
+		"  --progress-json <file>\n"
+		"\t\t\tWrite progress as a JSON object per line every second (- for stderr)\n"
+		"  --trace-events <file>\n"
+		"\t\t\tRecord the build and its worker tasks as a Chrome trace (chrome://tracing, Perfetto)\n"
+		"  --depfile <file>\tWrite the files the images are built from as a Makefile rule, for Make and Ninja\n"
+		"  --hash-manifest <file>\n"
+		"\t\t\tWrite the size, CRC32, MD5 and SHA-1 of every track and file, hashed while the\n"
+		"\t\t\timage is written, with tracks named like Redump sets\n"
+		"  --skip-if-up-to-date\tSkip building images whose files did not change since the last build,\n"
+		"\t\t\tas recorded in <image>.stamp\n"
+		"  --watch\t\tKeep running and rebuild whenever the project or one of its files changes\n"
+		"  -dedup\t\tStore files with identical contents once, their entries share one extent\n"
 		"  -c|--cuefile <file>\tSpecify cue sheet file (overrides cue_sheet attribute)\n"
 		"  -y\t\t\tAlways overwrite ISO image files\n"
 		"  -lba <file>\t\tGenerate a log of file LBA locations in disc image\n"
@@ -77,7 +282,17 @@ int Main(int argc, char* argv[])
 		"  -rebuildxml\t\tRebuild the XML using our newest schema\n"
 		"  -noisogen\t\tDo not generate ISO, but calculate file LBA locations (for use with -lba or -lbahead)\n"
 		"  -noxa\t\t\tDo not generate CD-XA extended file attributes (plain ISO9660)\n"
-		"\t\t\t(XA data can still be included but not recommended)\n";
+		"\t\t\t(XA data can still be included but not recommended)\n"
+		"  -trace <file>\t\tPlan the file layout to minimize seeking for an access trace\n"
+		"\t\t\t(a list of file paths, or LBA reads with optional sector counts)\n"
+		"  -tracealign <n>\tAlign XA files to multiples of n sectors when planning a layout\n"
+		"  --simulate-trace <file>\n"
+		"\t\t\tReport simulated load times of an access trace instead of generating ISO\n"
+		"  --drive <settings>\tDrive model for --simulate-trace, comma separated list of\n"
+		"\t\t\tspeed=<1|2>, seekmin=<ms>, seekmax=<ms> and latency=<ms>\n"
+		"\t\t\t(default speed=2,seekmin=25,seekmax=300,latency=40)\n"
+		"  -stream\t\tRead directory trees straight from the XML instead of loading it whole\n"
+		"\t\t\t(reduces memory usage of very large projects, ignored with -rebuildxml)\n";
 
 	static constexpr const char* VERSION_TEXT =
 		"MKPSXISO " VERSION " - PlayStation ISO Image Maker\n"
@@ -131,6 +346,71 @@ int Main(int argc, char* argv[])
 				global::noXA = true;
 				continue;
 			}
+			if (ParseArgument(args, "stream"))
+			{
+				global::StreamXML = true;
+				continue;
+			}
+			if (ParseArgument(args, "ecm"))
+			{
+				global::EcmOutput = true;
+				continue;
+			}
+			if (ParseArgument(args, "split"))
+			{
+				global::SplitTracks = true;
+				continue;
+			}
+			if (ParseArgument(args, "dedup"))
+			{
+				global::Dedup = true;
+				continue;
+			}
+			if (ParseArgument(args, "", "writeback"))
+			{
+				global::Writeback = true;
+				continue;
+			}
+			if (ParseArgument(args, "", "durable"))
+			{
+				global::Durable = true;
+				continue;
+			}
+			if (auto progressJson = ParseStringArgument(args, "", "progress-json"); progressJson.has_value())
+			{
+				global::progressJsonFile = *progressJson;
+				continue;
+			}
+			if (ParseArgument(args, "", "progress"))
+			{
+				global::Progress = true;
+				continue;
+			}
+			if (auto depFile = ParseStringArgument(args, "", "depfile"); depFile.has_value())
+			{
+				global::depFile = *depFile;
+				continue;
+			}
+			if (auto hashManifest = ParseStringArgument(args, "", "hash-manifest"); hashManifest.has_value())
+			{
+				global::hashManifestFile = *hashManifest;
+				continue;
+			}
+			if (ParseArgument(args, "", "skip-if-up-to-date"))
+			{
+				global::SkipIfUpToDate = true;
+				continue;
+			}
+			if (ParseArgument(args, "", "watch"))
+			{
+				global::Watch = true;
+				continue;
+			}
+			if (auto traceEvents = ParseStringArgument(args, "", "trace-events"); traceEvents.has_value())
+			{
+				global::traceEventsFile = *traceEvents;
+				continue;
+			}
 			if (auto lbaHead = ParsePathArgument(args, "lbahead"); lbaHead.has_value())
 			{
 				if (CompareICase(lbaHead->extension().string(), ".xml"))
@@ -170,6 +450,48 @@ int Main(int argc, char* argv[])
 				global::RebuildXMLScript = *newxmlfile;
 				continue;
 			}
+			if (auto traceFile = ParseStringArgument(args, "trace"); traceFile.has_value())
+			{
+				global::traceFile = *traceFile;
+				continue;
+			}
+			if (auto alignment = ParseStringArgument(args, "tracealign"); alignment.has_value())
+			{
+				char* end = nullptr;
+				global::traceAlignment = strtoul(alignment->c_str(), &end, 10);
+				if (*end != '\0' || global::traceAlignment == 0)
+				{
+					printf("Invalid sector alignment: %s\n", alignment->c_str());
+					return EXIT_FAILURE;
+				}
+				continue;
+			}
+			if (auto maxMapped = ParseStringArgument(args, "", "max-mapped-mb"); maxMapped.has_value())
+			{
+				char* end = nullptr;
+				global::maxMappedMB = strtoul(maxMapped->c_str(), &end, 10);
+				if (*end != '\0' || global::maxMappedMB == 0 || global::maxMappedMB > 1024 * 1024)
+				{
+					printf("Invalid mapping size: %s\n", maxMapped->c_str());
+					return EXIT_FAILURE;
+				}
+				continue;
+			}
+			if (auto simulateTrace = ParseStringArgument(args, "", "simulate-trace"); simulateTrace.has_value())
+			{
+				global::simulateTraceFile = *simulateTrace;
+				global::NoIsoGen = true;
+				continue;
+			}
+			if (auto drive = ParseStringArgument(args, "", "drive"); drive.has_value())
+			{
+				if (!seeksim::ParseDriveModel(*drive, global::driveModel))
+				{
+					printf("Invalid drive model: %s\n", drive->c_str());
+					return EXIT_FAILURE;
+				}
+				continue;
+			}
 			if (auto label = ParseStringArgument(args, "l", "label"); label.has_value())
 			{
 				global::volid_override = label;
@@ -199,6 +521,33 @@ int Main(int argc, char* argv[])
 		return EXIT_FAILURE;
 	}
 
+	if ( global::traceEventsFile.has_value() )
+	{
+		profiler::Enable();
+	}
+
+	// Keep stdout for the image and print everything else to stderr
+	if ( global::ImageName == "-" && !global::NoIsoGen )
+	{
+		if ( global::SplitTracks )
+		{
+			printf( "ERROR: -split cannot be used when writing the image to stdout.\n" );
+			return EXIT_FAILURE;
+		}
+		if ( global::Watch )
+		{
+			printf( "ERROR: --watch cannot be used when writing the image to stdout.\n" );
+			return EXIT_FAILURE;
+		}
+
+		global::imageStream.reset( DetachStandardOutput() );
+		if ( global::imageStream == nullptr )
+		{
+			printf( "ERROR: Cannot write the image to stdout.\n" );
+			return EXIT_FAILURE;
+		}
+	}
+
 	if ( !global::QuietMode )
 	{
 		printf(VERSION_TEXT);
@@ -214,16 +563,302 @@ int Main(int argc, char* argv[])
 		global::LBAheaderFile = global::XMLscript.stem() += "_LBA.h";
 	}
 
+	for ( char** args = argv + 1; *args != nullptr; args++ )
+	{
+		global::buildOptions += args != argv + 1 ? " " : "";
+		global::buildOptions += *args;
+	}
+
+	return global::Watch ? WatchProjects( OutputOverride ) : BuildProjects( OutputOverride );
+}
+
+// Lists the hashes of the files in a directory and its subdirectories, by their path in the image
+static void CollectFileHashes(const iso::DirTreeClass& dirTree, const std::string& path, const iso::FileHashes& fileHashes, HashedImage& image)
+{
+	for ( const iso::DIRENTRY& entry : dirTree.entriesInDir )
+	{
+		if ( entry.type == EntryType::EntryDir )
+		{
+			CollectFileHashes( *entry.subdir, path + std::string( entry.id ) + "/", fileHashes, image );
+			continue;
+		}
+
+		// Duplicates have the contents of the file whose extent they share
+		if ( auto it = fileHashes.find( entry.sharedWith != nullptr ? entry.sharedWith : &entry ); it != fileHashes.end() )
+		{
+			image.items.emplace_back( path + CleanIdentifier( entry.id ), it->second );
+		}
+	}
+}
+
+// Writes a tab separated line of size, CRC32, MD5, SHA-1 and name for every track and file
+static bool WriteHashManifest(const fs::path& path, const std::vector<HashedImage>& images)
+{
+	unique_file file = OpenScopedFile( path, "w" );
+	if ( file == nullptr )
+	{
+		return false;
+	}
+
+	fprintf( file.get(), "# mkpsxiso " VERSION " hash manifest\n# size\tcrc32\tmd5\tsha1\tname\n" );
+	for ( const HashedImage& image : images )
+	{
+		fprintf( file.get(), "\n# Image \"%s\"\n", image.name.filename().string().c_str() );
+		for ( const auto& [name, digests] : image.items )
+		{
+			fprintf( file.get(), "%" PRIu64 "\t%s\t%s\t%s\t%s\n", digests.size, hash::ToHex( digests.crc32 ).c_str(),
+				hash::ToHex( digests.md5.data(), digests.md5.size() ).c_str(), hash::ToHex( digests.sha1.data(), digests.sha1.size() ).c_str(), name.c_str() );
+		}
+	}
+	return fflush( file.get() ) == 0 && !ferror( file.get() );
+}
+
+static bool WriteTraceEvents()
+{
+	if ( global::traceEventsFile.has_value() && !profiler::WriteTrace( *global::traceEventsFile ) )
+	{
+		printf( "ERROR: Cannot write trace events to \"%s\".\n", global::traceEventsFile->string().c_str() );
+		return false;
+	}
+	return true;
+}
+
+static int WatchProjects(bool OutputOverride)
+{
+	// Names the project may set are picked up again on every build
+	const fs::path imageName = global::ImageName;
+	const std::optional<fs::path> cuefile = global::cuefile;
+	const std::optional<bool> newType = global::new_type;
+
+	watch::FileWatcher watcher;
+	bool rebuild = true;
+	for (;;)
+	{
+		if ( rebuild )
+		{
+			// Images are only patched on top of a complete build
+			if ( BuildProjects( OutputOverride ) != EXIT_SUCCESS )
+			{
+				global::builtImages.clear();
+			}
+
+			// The image is ours from now on, so it gets rebuilt without asking
+			global::Overwrite = true;
+			global::ImageName = imageName;
+			global::cuefile = cuefile;
+			global::new_type = newType;
+
+			watcher.Clear();
+			watcher.Add( global::XMLscript );
+			for ( const iso::SourceCache& sourceCache : global::sourceCaches )
+			{
+				for ( const fs::path& path : sourceCache.GetPaths() )
+				{
+					watcher.Add( path );
+				}
+			}
+		}
+
+		if ( !global::QuietMode )
+		{
+			printf( "\nWatching %zu files for changes, press Ctrl+C to stop.\n", watcher.GetCount() );
+		}
+
+		const fs::path changed = watcher.Wait();
+		rebuild = !PatchImages( changed );
+		if ( rebuild && !global::QuietMode )
+		{
+			printf( "\n\"%s\" changed, rebuilding...\n\n", changed.lexically_proximate( fs::current_path() ).string().c_str() );
+		}
+	}
+}
+
+// Compares paths as the file watcher reports them
+static bool IsSamePath(const fs::path& path, const fs::path& absolutePath)
+{
+	std::error_code ec;
+	return fs::absolute( path, ec ).lexically_normal() == absolutePath;
+}
+
+// Writes a changed file into the images built from it, when it takes the same number of sectors as
+// before. Returns false without writing anything if the images have to be built again instead.
+static bool PatchImages(const fs::path& changed)
+{
+	struct Patch
+	{
+		BuiltImage* image;
+		std::vector<iso::DIRENTRY*> files;
+		std::vector<cdtrack*> tracks;
+	};
+
+	// Every image is checked before any of them is written
+	std::vector<Patch> patches;
+	for ( const std::unique_ptr<BuiltImage>& image : global::builtImages )
+	{
+		Patch& patch = patches.emplace_back( Patch{ image.get() } );
+		for ( iso::DIRENTRY& entry : image->entries )
+		{
+			if ( !entry.srcfile.empty() && IsSamePath( entry.GetSourcePath(), changed ) )
+			{
+				patch.files.push_back( &entry );
+			}
+		}
+		for ( cdtrack& track : image->audioTracks )
+		{
+			if ( !track.source.empty() && IsSamePath( track.source, changed ) )
+			{
+				patch.tracks.push_back( &track );
+			}
+		}
+
+		if ( patch.files.empty() && patch.tracks.empty() )
+		{
+			patches.pop_back();
+			continue;
+		}
+		if ( !patch.tracks.empty() && image->hasTrackFiles )
+		{
+			return false;
+		}
+
+		// Deduplicated files no longer have the same contents as the files sharing their extent
+		for ( const iso::DIRENTRY& entry : image->entries )
+		{
+			if ( entry.sharedWith != nullptr && ( std::find( patch.files.begin(), patch.files.end(), entry.sharedWith ) != patch.files.end() ||
+				std::find( patch.files.begin(), patch.files.end(), &entry ) != patch.files.end() ) )
+			{
+				return false;
+			}
+		}
+
+		const bool probeXA = std::any_of( patch.files.begin(), patch.files.end(), [](const iso::DIRENTRY* entry)
+			{
+				return entry->type == EntryType::EntryXA || entry->type == EntryType::EntryXA_DO;
+			} );
+		const bool probeAudio = !patch.tracks.empty() || std::any_of( patch.files.begin(), patch.files.end(), [](const iso::DIRENTRY* entry)
+			{
+				return entry->type == EntryType::EntryDA;
+			} );
+		const iso::SourceInfo source = iso::ProbeSource( changed, probeXA, probeAudio );
+
+		for ( iso::DIRENTRY* entry : patch.files )
+		{
+			if ( !iso::UpdateFileEntry( *entry, source, image->settings ) )
+			{
+				return false;
+			}
+		}
+		for ( const cdtrack* track : patch.tracks )
+		{
+			if ( !source.attrib || GetSizeInSectors( source.audioSize, CD_SECTOR_SIZE ) != GetSizeInSectors( track->size, CD_SECTOR_SIZE ) )
+			{
+				return false;
+			}
+		}
+	}
+
+	if ( patches.empty() )
+	{
+		return false;
+	}
+
+	if ( !global::QuietMode )
+	{
+		printf( "\n\"%s\" changed, writing it into the image in place...\n\n", changed.lexically_proximate( fs::current_path() ).string().c_str() );
+	}
+
+	for ( const Patch& patch : patches )
+	{
+		BuiltImage& image = *patch.image;
+		if ( !global::QuietMode )
+		{
+			printf( "Updating ISO image: \"%s\"\n", image.imagePath.lexically_normal().string().c_str() );
+		}
+
+		cd::IsoWriter writer;
+		cd::MappingOptions options;
+		options.windowLBA = static_cast<unsigned int>(static_cast<uint64_t>(global::maxMappedMB) * 1024 * 1024 / CD_SECTOR_SIZE);
+		options.writeback = global::Writeback || global::Durable;
+		options.durable = global::Durable;
+		if ( !writer.Open( image.imagePath, image.sizeLBA, image.xaEdc, options ) )
+		{
+			printf( "ERROR: Cannot open the image file to update it.\n" );
+			return false;
+		}
+
+		// Files take their new size and date in the directory records, which keep their layout
+		iso::DIRENTRY& root = image.entries.front();
+		for ( const iso::DIRENTRY* entry : patch.files )
+		{
+			root.subdir->WriteFileEntry( &writer, *entry );
+		}
+		if ( !patch.files.empty() )
+		{
+			root.subdir->WriteDirectoryRecords( &writer, root, image.totalDirs );
+		}
+		for ( cdtrack* track : patch.tracks )
+		{
+			WriteAudioTrack( writer, *track, track->lba, image.settings, !global::QuietMode );
+		}
+
+		if ( !writer.Close() )
+		{
+			printf( "ERROR: Cannot write output image file.\n" );
+			return false;
+		}
+
+		if ( !image.stampPath.empty() && !deps::WriteStamp( image.stampPath, global::buildOptions, image.projectFiles, image.outputs ) && !global::noWarns )
+		{
+			printf( "WARNING: Cannot write stamp file \"%s\".\n", image.stampPath.lexically_normal().string().c_str() );
+		}
+	}
+
+	if ( !global::QuietMode )
+	{
+		printf( "\nISO image updated successfully.\n" );
+	}
+	return true;
+}
+
+static int BuildProjects(bool OutputOverride)
+{
 	tzset(); // Initializes the time-related environment variables
 	// Get current time to be used as date stamps for all directories
 	time( &global::BuildTime );
 
+	// Images can only be updated in place when they are plain BIN files, which nothing else is derived from
+	global::builtImages.clear();
+	bool keepImages = global::Watch && !global::NoIsoGen && !global::EcmOutput && global::imageStream == nullptr &&
+		!global::hashManifestFile && global::LBAfile.empty() && global::LBAheaderFile.empty();
+
 	// Load XML file
 	tinyxml2::XMLDocument xmlFile;
+	std::unique_ptr<StreamedProject> streamedProject;
+	const auto loadStart = std::chrono::steady_clock::now();
+
+	// Manifests are always streamed, while rebuilding the XML needs the whole document
+	const bool isManifest = xml::IsManifestPath(global::XMLscript);
+	if ( isManifest && !global::RebuildXMLScript.empty() )
+	{
+		printf( "ERROR: -rebuildxml cannot be used with a project manifest.\n" );
+		return EXIT_FAILURE;
+	}
+
+	if ( ( global::StreamXML || isManifest ) && global::RebuildXMLScript.empty() )
+	{
+		streamedProject = std::make_unique<StreamedProject>();
+		if ( !LoadStreamedProject(global::XMLscript, xmlFile, *streamedProject) )
+		{
+			return EXIT_FAILURE;
+		}
+		global::XMLscript = fs::relative(global::XMLscript);
+	}
+	else
 	{
 		tinyxml2::XMLError error;
 		if (FILE* file = OpenFile(global::XMLscript, "rb"); file != nullptr)
 		{
+			profiler::Scope scope("load project");
 			global::XMLscript = fs::relative(global::XMLscript);
 			error = xmlFile.LoadFile(file);
 			fclose(file);
@@ -256,8 +891,15 @@ int Main(int argc, char* argv[])
 		}
     }
 
+	if ( !global::QuietMode )
+	{
+		const std::chrono::duration<double> loadTime = std::chrono::steady_clock::now() - loadStart;
+		printf( "Loaded XML project in %.3f seconds%s.\n\n", loadTime.count(), streamedProject ? " (streaming mode)" : "" );
+	}
+
 	// Fix XML tree to our current spec
 	// convert DA file source syntax to DA file trackid syntax
+	// (in streaming mode this is done while loading, as directory trees are not part of the document)
 	unsigned trackindex = 2;
 	for(tinyxml2::XMLElement *modifyProject = xmlFile.FirstChildElement(xml::elem::ISO_PROJECT);
 		modifyProject != nullptr;
@@ -361,6 +1003,12 @@ int Main(int argc, char* argv[])
 
     int imagesCount = 0;
 
+	// Outputs and the files they are built from, for --depfile
+	std::vector<fs::path> depTargets;
+	std::vector<fs::path> dependencies;
+
+	std::vector<HashedImage> hashedImages;
+
 	// Build loop for XML scripts with multiple <iso_project> elements
 	while ( projectElement != nullptr )
 	{
@@ -395,9 +1043,45 @@ int Main(int argc, char* argv[])
 			}
 		}
 
+		int trackCount = 0;
+		for ( const tinyxml2::XMLElement* trackElement = projectElement->FirstChildElement(xml::elem::TRACK);
+			trackElement != nullptr; trackElement = trackElement->NextSiblingElement(xml::elem::TRACK) )
+		{
+			trackCount++;
+		}
+
+		// The cue sheet keeps referring to the BIN file an ECM image decodes to
+		const fs::path dataTrackName = global::SplitTracks ? GetTrackFileName( global::ImageName, 1, trackCount ) : global::ImageName;
+		const fs::path imagePath = GetOutputPath( dataTrackName );
+
+		// Images are left alone if nothing they are built from changed since the stamp was written
+		const fs::path stampPath = fs::path( imagePath ) += ".stamp";
+		if ( global::SkipIfUpToDate && !global::NoIsoGen && GetSize( imagePath ) >= 0 )
+		{
+			if ( auto files = deps::CheckStamp( stampPath, global::buildOptions ); files.has_value() )
+			{
+				if ( !global::QuietMode )
+				{
+					printf( "ISO image \"%s\" is up to date.\n", imagePath.lexically_normal().string().c_str() );
+				}
+
+				depTargets.push_back( imagePath );
+				dependencies.insert( dependencies.end(), files->begin(), files->end() );
+				keepImages = false;
+				projectElement = projectElement->NextSiblingElement(xml::elem::ISO_PROJECT);
+				continue;
+			}
+		}
+		if ( global::SkipIfUpToDate && !global::NoIsoGen )
+		{
+			// A build which fails half way must not be taken as up to date by an earlier stamp
+			std::error_code ec;
+			fs::remove( stampPath, ec );
+		}
+
 		if ( !global::QuietMode )
 		{
-			printf( "Building ISO Image: \"%s\"", global::ImageName.lexically_normal().string().c_str() );
+			printf( "Building ISO Image: \"%s\"", imagePath.lexically_normal().string().c_str() );
 
 			if ( global::cuefile )
 			{
@@ -409,9 +1093,9 @@ int Main(int argc, char* argv[])
 
 		global::noXA = projectElement->BoolAttribute( xml::attrib::NO_XA );
 
-		if ( !global::Overwrite && !global::NoIsoGen && !global::noWarns)
+		if ( !global::Overwrite && !global::NoIsoGen && !global::noWarns && global::imageStream == nullptr )
 		{
-			if ( GetSize( global::ImageName ) >= 0 )
+			if ( GetSize( imagePath ) >= 0 )
 			{
 				printf( "WARNING: ISO image already exists, overwrite? <y/n> " );
 				char key;
@@ -472,16 +1156,23 @@ int Main(int argc, char* argv[])
 					return EXIT_FAILURE;
 				}
 
-				fprintf(cuefp.get(), "FILE \"%s\" BINARY\n", global::ImageName.filename().string().c_str());
+				fprintf(cuefp.get(), "FILE \"%s\" BINARY\n", dataTrackName.filename().string().c_str());
 			}
 		}
 
 		global::trackNum = 1;
-		iso::EntryList entries;
+		auto builtImage = std::make_unique<BuiltImage>();
+		iso::Settings& settings = builtImage->settings;
+		iso::EntryList& entries = builtImage->entries;
 		iso::IDENTIFIERS isoIdentifiers {};
+		iso::SourceCache& sourceCache = static_cast<size_t>(imagesCount) <= global::sourceCaches.size()
+			? global::sourceCaches[imagesCount - 1] : global::sourceCaches.emplace_back();
 		int totalLenLBA = 0;
 
 		std::vector<cdtrack> audioTracks;
+		std::vector<TrackFile> audioTrackFiles;
+		std::vector<unsigned int> trackLBAs; // Start of every track, including its pregap
+		unsigned int indexBaseLBA = 0; // INDEX times in the cue sheet are relative to the start of the current file
 		iso::EntryList unrefTracks;
 
 		const tinyxml2::XMLElement* dataTrack = nullptr;
@@ -514,6 +1205,7 @@ int Main(int argc, char* argv[])
 				printf( "  Track #%d %s:\n", global::trackNum,
 					track_type );
 			}
+			trackLBAs.push_back( totalLenLBA );
 
 			// Generate ISO file system for data track
 			if ( CompareICase( "data", track_type ) )
@@ -544,7 +1236,13 @@ int Main(int argc, char* argv[])
 					return EXIT_FAILURE;
 				}
 
-				if ( !ParseISOfileSystem( trackElement, global::XMLscript.parent_path(), entries, isoIdentifiers, totalLenLBA ) )
+				settings.BuildTime	= global::BuildTime;
+				settings.new_type	= global::new_type;
+				settings.noXA		= global::noXA;
+				settings.QuietMode	= global::QuietMode;
+				settings.noWarns	= global::noWarns;
+
+				if ( !ParseISOfileSystem( trackElement, global::XMLscript.parent_path(), entries, isoIdentifiers, totalLenLBA, settings, sourceCache, streamedProject.get() ) )
 				{
 					return EXIT_FAILURE;
 				}
@@ -590,6 +1288,15 @@ int Main(int argc, char* argv[])
 				else
 				{
 					fs::path trackSource = (global::XMLscript.parent_path() / trackRelativeSource);
+					if ( global::SplitTracks )
+					{
+						const TrackFile& trackFile = audioTrackFiles.emplace_back( TrackFile{ GetTrackFileName( global::ImageName, global::trackNum, trackCount ), static_cast<unsigned int>(totalLenLBA) } );
+						indexBaseLBA = trackFile.lba;
+						if ( cuefp )
+						{
+							fprintf( cuefp.get(), "FILE \"%s\" BINARY\n", trackFile.name.filename().string().c_str() );
+						}
+					}
 					if ( cuefp )
 					{
 						fprintf( cuefp.get(), "  TRACK %02d AUDIO\n", global::trackNum );
@@ -621,7 +1328,7 @@ int Main(int argc, char* argv[])
 					{
 						if ( cuefp )
 						{
-							fprintf( cuefp.get(), "    INDEX 00 %s\n", SectorsToTimecode(totalLenLBA).c_str());
+							fprintf( cuefp.get(), "    INDEX 00 %s\n", SectorsToTimecode(totalLenLBA - indexBaseLBA).c_str());
 						}
 
 						audioTracks.emplace_back(totalLenLBA, pregapSectors * CD_SECTOR_SIZE);
@@ -630,10 +1337,10 @@ int Main(int argc, char* argv[])
 
 					if ( cuefp )
 					{
-						fprintf( cuefp.get(), "    INDEX 01 %s\n", SectorsToTimecode(totalLenLBA).c_str());
+						fprintf( cuefp.get(), "    INDEX 01 %s\n", SectorsToTimecode(totalLenLBA - indexBaseLBA).c_str());
 					}
 
-					const unsigned int audioSize = iso::DirTreeClass::GetAudioSize(trackSource);
+					const unsigned int audioSize = sourceCache.Get(trackSource, false, true).audioSize;
 					audioTracks.emplace_back(totalLenLBA, audioSize, trackSource.string());
 
 					const char *trackid = trackElement->Attribute(xml::attrib::TRACK_ID);
@@ -647,10 +1354,10 @@ int Main(int argc, char* argv[])
 					else
 					{
 						auto& entry = unrefTracks.emplace_back();
-						entry.id = trackSource.stem().string() + ";1";
+						entry.id = unrefTracks.InternName(trackSource.stem().string() + ";1");
 						entry.length = audioSize;
 						entry.lba = totalLenLBA;
-						entry.srcfile = trackSource;
+						entry.srcfile = unrefTracks.InternPath(trackSource);
 						entry.type = EntryType::EntryDA;
 						if (!global::QuietMode)
 						{
@@ -780,10 +1487,76 @@ int Main(int argc, char* argv[])
 
 		if ( !global::NoIsoGen )
 		{
+			// Progress is only counted when it is reported
+			progress::Counters progressCounters;
+			progressCounters.totalSectors = totalLenLBA;
+
+			unique_file progressJson;
+			if ( global::progressJsonFile && *global::progressJsonFile != "-" )
+			{
+				progressJson = OpenScopedFile( *global::progressJsonFile, "w" );
+				if ( progressJson == nullptr )
+				{
+					printf( "ERROR: Cannot create progress file \"%s\".\n", global::progressJsonFile->lexically_normal().string().c_str() );
+					return EXIT_FAILURE;
+				}
+			}
+
+			std::optional<progress::Reporter> progressReporter;
+			if ( global::Progress || global::progressJsonFile )
+			{
+				FILE* jsonLines = global::progressJsonFile ? ( progressJson != nullptr ? progressJson.get() : stderr ) : nullptr;
+				progressReporter.emplace( progressCounters, global::Progress ? stderr : nullptr, jsonLines );
+			}
+			progress::Counters* buildProgress = progressReporter ? &progressCounters : nullptr;
+
+			// Audio tracks with files of their own are written while the data track is being written
+			const unsigned int imageLenLBA = audioTrackFiles.empty() ? totalLenLBA : audioTrackFiles.front().lba;
+			std::vector<std::future<bool>> audioTrackJobs;
+			std::vector<hash::Digests> trackFileHashes( audioTrackFiles.size() );
+			for ( size_t i = 0; i < audioTrackFiles.size(); i++ )
+			{
+				audioTrackJobs.push_back( std::async( std::launch::async, [&, i]
+					{
+						const TrackFile& trackFile = audioTrackFiles[i];
+						profiler::Scope scope("write track file", trackFile.name.string());
+						const unsigned int endLBA = i + 1 < audioTrackFiles.size() ? audioTrackFiles[i + 1].lba : totalLenLBA;
+
+						cd::IsoWriter trackWriter;
+						unique_file trackEcmFile;
+						if ( !CreateWriter( trackWriter, GetOutputPath( trackFile.name ), endLBA - trackFile.lba, trackEcmFile, buildProgress ) )
+						{
+							return false;
+						}
+						if ( global::hashManifestFile )
+						{
+							trackWriter.EnableTrackHashes( { 0 } );
+						}
+
+						for ( const cdtrack& track : audioTracks )
+						{
+							if ( track.lba >= trackFile.lba && track.lba < endLBA )
+							{
+								WriteAudioTrack( trackWriter, track, track.lba - trackFile.lba, settings, false );
+							}
+						}
+						if ( !CloseWriter( trackWriter, trackEcmFile ) )
+						{
+							return false;
+						}
+						if ( global::hashManifestFile )
+						{
+							trackFileHashes[i] = trackWriter.GetTrackHashes().front();
+						}
+						return true;
+					} ) );
+			}
+
 			// Create ISO image for writing
 			cd::IsoWriter writer;
+			unique_file ecmFile;
 
-			if ( !writer.Create(global::ImageName, totalLenLBA ) ) {
+			if ( !CreateWriter( writer, imagePath, imageLenLBA, ecmFile, buildProgress ) ) {
 
 				if ( !global::QuietMode )
 				{
@@ -795,57 +1568,24 @@ int Main(int argc, char* argv[])
 
 			}
 
-
-			// Write the file system
-			if ( !global::QuietMode )
+			// Tracks with files of their own are hashed by their writers
+			if ( global::hashManifestFile )
 			{
-				printf( "Writing ISO...\n"
-						"  Writing files...\n" );
+				std::vector<unsigned int> imageTrackLBAs;
+				std::copy_if( trackLBAs.begin(), trackLBAs.end(), std::back_inserter( imageTrackLBAs ), [imageLenLBA](unsigned int lba) { return lba < imageLenLBA; } );
+				writer.EnableTrackHashes( std::move( imageTrackLBAs ) );
 			}
 
-			// Copy the files into the disc image
-			dirTree->WriteFiles( &writer );
-
-			if ( !global::QuietMode && !audioTracks.empty() )
+			// The image is written in LBA order, starting with the system area and the file system
+			if ( !global::QuietMode )
 			{
-				printf("\n  Writing CDDA tracks...\n");
+				printf( "Writing ISO...\n" );
 			}
 
-			// Write out the audio tracks
-			for (const cdtrack& track : audioTracks)
+			if ( buildProgress != nullptr )
 			{
-				const uint32_t sizeInSectors = GetSizeInSectors(track.size, CD_SECTOR_SIZE);
-				auto sectorView = writer.GetRawSectorView(track.lba, sizeInSectors);
-
-				if (!track.source.empty())
-				{
-					// Pack the audio file
-					if ( !global::QuietMode )
-					{
-						printf( "    Packing audio \"%s\"... ", track.source.c_str() );
-						fflush(stdout);
-					}
-
-					if ( PackFileAsCDDA( sectorView->GetRawBuffer(), track.source ) )
-					{
-						if ( !global::QuietMode )
-						{
-							printf( "Done.\n" );
-						}
-					}
-				}
-				else
-				{
-					// Write pregap
-					sectorView->WriteBlankSectors();
-				}
-			}
-
-			if ( !global::QuietMode )
-			{
-				printf( "\n" );
+				buildProgress->phase = "system area";
 			}
-						
 
 			// Write license data
 			const tinyxml2::XMLElement* licenseElement = dataTrack->FirstChildElement(xml::elem::LICENSE);
@@ -886,31 +1626,174 @@ int Main(int argc, char* argv[])
 				printf( "  Writing directories... " );
 			}
 
-			// Write directory entries
+			// Write file system descriptors and directory entries
+			if ( buildProgress != nullptr )
+			{
+				buildProgress->phase = "directories";
+			}
+			iso::WriteDescriptor( &writer, isoIdentifiers, root, totalLenLBA );
 			dirTree->WriteDirectoryRecords( &writer, root, global::new_type.value_or(false) ? dirTree->GetDirCountTotal() : 0 );
 
-			// Write file system descriptors to finish the image
-	        iso::WriteDescriptor( &writer, isoIdentifiers, root, totalLenLBA );
-
 			if ( !global::QuietMode )
 			{
-				printf( "Ok.\n\n" );
+				printf( "Ok.\n"
+						"  Writing files...\n" );
+			}
+
+			// Copy the files into the disc image
+			if ( buildProgress != nullptr )
+			{
+				buildProgress->phase = "files";
+			}
+			iso::FileHashes fileHashes;
+			dirTree->WriteFiles( &writer, global::hashManifestFile ? &fileHashes : nullptr );
+
+			if ( !global::QuietMode && !audioTracks.empty() )
+			{
+				printf("\n  Writing CDDA tracks...\n");
+			}
+
+			// Write out the audio tracks, unless they have files of their own
+			if ( buildProgress != nullptr && !audioTracks.empty() )
+			{
+				buildProgress->phase = "audio";
+			}
+			if ( audioTrackFiles.empty() )
+			{
+				for (const cdtrack& track : audioTracks)
+				{
+					WriteAudioTrack( writer, track, track.lba, settings, !global::QuietMode );
+				}
 			}
 
 			// Close both ISO writer and CUE sheet
-			writer.Close();
+			const bool closed = CloseWriter( writer, ecmFile );
 			cuefp.reset();
 
-			if ( !global::QuietMode )
+			bool tracksWritten = true;
+			for ( size_t i = 0; i < audioTrackJobs.size(); i++ )
+			{
+				const fs::path trackPath = GetOutputPath( audioTrackFiles[i].name );
+				if ( !audioTrackJobs[i].get() )
+				{
+					printf( "ERROR: Cannot write track file \"%s\".\n", trackPath.lexically_normal().string().c_str() );
+					tracksWritten = false;
+				}
+				else if ( !global::QuietMode )
+				{
+					printf( "    Wrote \"%s\"\n", trackPath.lexically_normal().string().c_str() );
+				}
+			}
+
+			if ( !global::QuietMode )
+			{
+				printf( "\n" );
+			}
+
+			if ( !closed )
+			{
+				printf( "ERROR: Cannot write output image file.\n" );
+				return EXIT_FAILURE;
+			}
+			if ( !tracksWritten )
+			{
+				return EXIT_FAILURE;
+			}
+
+			if ( global::hashManifestFile )
+			{
+				HashedImage& hashedImage = hashedImages.emplace_back();
+				hashedImage.name = imagePath;
+
+				std::vector<hash::Digests> trackHashes = writer.GetTrackHashes();
+				trackHashes.insert( trackHashes.end(), trackFileHashes.begin(), trackFileHashes.end() );
+				for ( size_t i = 0; i < trackHashes.size(); i++ )
+				{
+					const fs::path trackName = GetTrackFileName( global::ImageName, static_cast<int>(i + 1), trackCount );
+					hashedImage.items.emplace_back( trackName.filename().string(), trackHashes[i] );
+				}
+				CollectFileHashes( *dirTree, "/", fileHashes, hashedImage );
+			}
+
+			builtImage->imagePath = imagePath;
+			builtImage->sizeLBA = imageLenLBA;
+			builtImage->xaEdc = global::xa_edc;
+			builtImage->totalDirs = global::new_type.value_or(false) ? dirTree->GetDirCountTotal() : 0;
+			builtImage->audioTracks = std::move( audioTracks );
+			builtImage->hasTrackFiles = !audioTrackFiles.empty();
+
+			if ( !global::QuietMode )
+			{
+				printf( "ISO image generated successfully.\n" );
+				printf( "Total image size: %d bytes (%d sectors)\n",
+					(CD_SECTOR_SIZE*totalLenLBA), totalLenLBA );
+			}
+		}
+		else
+		{
+			printf( "Skipped generating ISO image.\n" );
+		}
+
+		if ( global::depFile || global::SkipIfUpToDate )
+		{
+			std::vector<fs::path> projectFiles = sourceCache.GetPaths();
+			projectFiles.push_back( global::XMLscript );
+			if ( global::traceFile )
+			{
+				projectFiles.push_back( *global::traceFile );
+			}
+			std::sort( projectFiles.begin(), projectFiles.end() );
+
+			// Every file the build wrote, so the image is rebuilt if any of them is deleted or modified
+			std::vector<fs::path> outputs;
+			if ( global::imageStream == nullptr )
+			{
+				outputs.push_back( imagePath );
+				for ( const TrackFile& trackFile : audioTrackFiles )
+				{
+					outputs.push_back( GetOutputPath( trackFile.name ) );
+				}
+			}
+			if ( global::cuefile )
+			{
+				outputs.push_back( *global::cuefile );
+			}
+			for ( const fs::path* listing : { &global::LBAfile, &global::LBAheaderFile } )
+			{
+				if ( !listing->empty() )
+				{
+					outputs.push_back( *listing );
+				}
+			}
+
+			if ( global::SkipIfUpToDate && !global::NoIsoGen && !deps::WriteStamp( stampPath, global::buildOptions, projectFiles, outputs ) && !global::noWarns )
+			{
+				printf( "WARNING: Cannot write stamp file \"%s\".\n", stampPath.lexically_normal().string().c_str() );
+			}
+			if ( global::SkipIfUpToDate )
+			{
+				builtImage->stampPath = stampPath;
+				builtImage->projectFiles = projectFiles;
+				builtImage->outputs = outputs;
+			}
+
+			if ( !global::NoIsoGen )
 			{
-				printf( "ISO image generated successfully.\n" );
-				printf( "Total image size: %d bytes (%d sectors)\n",
-					(CD_SECTOR_SIZE*totalLenLBA), totalLenLBA );
+				depTargets.push_back( imagePath );
+			}
+			for ( const fs::path* listing : { &global::LBAfile, &global::LBAheaderFile } )
+			{
+				if ( !listing->empty() )
+				{
+					depTargets.push_back( *listing );
+				}
 			}
+			dependencies.insert( dependencies.end(), projectFiles.begin(), projectFiles.end() );
 		}
-		else
+
+		if ( keepImages )
 		{
-			printf( "Skipped generating ISO image.\n" );
+			global::builtImages.push_back( std::move( builtImage ) );
 		}
 
 		// Check for next <iso_project> element
@@ -918,10 +1801,43 @@ int Main(int argc, char* argv[])
 
 	}
 
+	if ( !keepImages )
+	{
+		global::builtImages.clear();
+	}
+
+	if ( global::depFile )
+	{
+		for ( std::vector<fs::path>* paths : { &depTargets, &dependencies } )
+		{
+			std::sort( paths->begin(), paths->end() );
+			paths->erase( std::unique( paths->begin(), paths->end() ), paths->end() );
+		}
+
+		if ( !deps::WriteDepfile( *global::depFile, depTargets, dependencies ) )
+		{
+			printf( "ERROR: Cannot write dependency file \"%s\".\n", global::depFile->lexically_normal().string().c_str() );
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Images skipped as up to date were not hashed, a manifest without any images would lose the earlier one
+	if ( global::hashManifestFile && !hashedImages.empty() && !WriteHashManifest( *global::hashManifestFile, hashedImages ) )
+	{
+		printf( "ERROR: Cannot write hash manifest \"%s\".\n", global::hashManifestFile->lexically_normal().string().c_str() );
+		return EXIT_FAILURE;
+	}
+
+	if ( !WriteTraceEvents() )
+	{
+		return EXIT_FAILURE;
+	}
+
     return 0;
 }
 
-EntryAttributes ReadEntryAttributes(EntryAttributes current, const tinyxml2::XMLElement* dirElement)
+template<typename Element>
+EntryAttributes ReadEntryAttributes(EntryAttributes current, const Element* dirElement)
 {
 	if (dirElement != nullptr)
 	{
@@ -951,7 +1867,46 @@ EntryAttributes ReadEntryAttributes(EntryAttributes current, const tinyxml2::XML
 	return current;
 };
 
-int ParseISOfileSystem(const tinyxml2::XMLElement* trackElement, const fs::path& xmlPath, iso::EntryList& entries, iso::IDENTIFIERS& isoIdentifiers, int& totalLen)
+// Gathers the source files referenced by a directory tree, so they can be probed before the tree is built
+static void CollectSourceFiles(iso::SourceCache& sourceCache, const tinyxml2::XMLElement* parentElement, const fs::path& xmlPath)
+{
+	for ( const tinyxml2::XMLElement* dirElement = parentElement->FirstChildElement(); dirElement != nullptr; dirElement = dirElement->NextSiblingElement() )
+	{
+		if ( CompareICase( "file", dirElement->Name() ) )
+		{
+			const char* typeElement = dirElement->Attribute(xml::attrib::ENTRY_TYPE);
+
+			// DA files point at the sources of audio tracks, those are collected separately
+			if ( typeElement != nullptr && CompareICase( "da", typeElement ) )
+			{
+				continue;
+			}
+
+			const char* sourceElement = dirElement->Attribute(xml::attrib::ENTRY_SOURCE);
+			if ( sourceElement == nullptr )
+			{
+				sourceElement = dirElement->Attribute(xml::attrib::ENTRY_NAME);
+			}
+
+			if ( sourceElement != nullptr )
+			{
+				const bool isXA = typeElement != nullptr &&
+					( CompareICase( "mixed", typeElement ) || CompareICase( "xa", typeElement ) || CompareICase( "str", typeElement ) );
+				sourceCache.Add(xmlPath / sourceElement, isXA, false);
+			}
+		}
+		else if ( CompareICase( "dir", dirElement->Name() ) )
+		{
+			if ( const char* sourceElement = dirElement->Attribute(xml::attrib::ENTRY_SOURCE); sourceElement != nullptr )
+			{
+				sourceCache.Add(xmlPath / sourceElement, false, false);
+			}
+			CollectSourceFiles(sourceCache, dirElement, xmlPath);
+		}
+	}
+}
+
+int ParseISOfileSystem(const tinyxml2::XMLElement* trackElement, const fs::path& xmlPath, iso::EntryList& entries, iso::IDENTIFIERS& isoIdentifiers, int& totalLen, const iso::Settings& settings, iso::SourceCache& sourceCache, StreamedProject* streamedProject)
 {
 	const tinyxml2::XMLElement* identifierElement =
 		trackElement->FirstChildElement(xml::elem::IDENTIFIERS);
@@ -978,6 +1933,8 @@ int ParseISOfileSystem(const tinyxml2::XMLElement* trackElement, const fs::path&
 		// Is an ID file specified?
 		if( (identifierFile = identifierElement->Attribute(xml::attrib::ID_FILE)) )
 		{
+			sourceCache.Add(identifierFile, false, false);
+
 			// Load the file as an XML document
 			{
 				tinyxml2::XMLError error;
@@ -1133,6 +2090,7 @@ int ParseISOfileSystem(const tinyxml2::XMLElement* trackElement, const fs::path&
 			{
 				printf( "    License file: \"%s\"\n\n", license_file.lexically_normal().string().c_str() );
 			}
+			sourceCache.Add(license_file, false, false);
 
 			int64_t licenseSize = GetSize( license_file );
 
@@ -1226,16 +2184,72 @@ int ParseISOfileSystem(const tinyxml2::XMLElement* trackElement, const fs::path&
 		return false;
 	}
 
+	StreamedTree* streamedTree = nullptr;
+	if ( streamedProject != nullptr )
+	{
+		if ( auto it = streamedProject->trees.find(directoryTree); it != streamedProject->trees.end() )
+		{
+			streamedTree = &it->second;
+		}
+	}
+
+	// Stat and probe all source files up front, including the audio tracks of this project
+	const auto prefetchStart = std::chrono::steady_clock::now();
+
+	if ( streamedTree != nullptr )
+	{
+		for ( const auto& [source, isXA] : streamedTree->sources )
+		{
+			sourceCache.Add(xmlPath / source, isXA, false);
+		}
+		streamedTree->sources = {};
+	}
+	else
+	{
+		CollectSourceFiles(sourceCache, directoryTree, xmlPath);
+	}
+	for ( const tinyxml2::XMLElement* audioTrack = trackElement->NextSiblingElement(xml::elem::TRACK); audioTrack != nullptr;
+		audioTrack = audioTrack->NextSiblingElement(xml::elem::TRACK) )
+	{
+		const char* trackSource = audioTrack->Attribute(xml::attrib::TRACK_SOURCE);
+		if ( trackSource != nullptr && audioTrack->Attribute(xml::attrib::TRACK_TYPE, "audio") )
+		{
+			sourceCache.Add(xmlPath / trackSource, false, true);
+		}
+	}
+	sourceCache.Prefetch();
+
+	const std::chrono::duration<double> prefetchTime = std::chrono::steady_clock::now() - prefetchStart;
+
 	const EntryAttributes defaultAttributes = ReadEntryAttributes(EntryAttributes{}, trackElement->FirstChildElement(xml::elem::DEFAULT_ATTRIBUTES));
 
-	iso::DIRENTRY& root = iso::DirTreeClass::CreateRootDirectory(entries, volumeDate, ReadEntryAttributes(defaultAttributes, directoryTree));
+	iso::DIRENTRY& root = iso::DirTreeClass::CreateRootDirectory(entries, volumeDate, ReadEntryAttributes(defaultAttributes, directoryTree), settings, &sourceCache);
 	iso::DirTreeClass* dirTree = root.subdir.get();
 
-	if ( !ParseDirectory(dirTree, directoryTree, xmlPath, defaultAttributes) )
+	const tinyxml2::XMLElement* projectElement = trackElement->Parent()->ToElement();
+	const auto parseStart = std::chrono::steady_clock::now();
+
+	bool parsed;
+	{
+		profiler::Scope scope("parse project");
+		parsed = streamedTree != nullptr
+			? ParseStreamedDirectory(dirTree, *streamedProject->reader, *streamedTree, xmlPath, defaultAttributes, projectElement)
+			: ParseDirectory(dirTree, directoryTree, xmlPath, defaultAttributes, projectElement);
+	}
+	if ( !parsed )
 	{
 		return false;
 	}
 
+	const std::chrono::duration<double> parseTime = std::chrono::steady_clock::now() - parseStart;
+
+	size_t duplicateFiles = 0;
+	uint32_t dedupSavedSectors = 0;
+	if ( global::Dedup )
+	{
+		duplicateFiles = iso::DeduplicateFiles(entries, dedupSavedSectors);
+	}
+
 	int pathTableLen = dirTree->CalculatePathTableLen(root);
 
 	// 16 license sectors + 2 header sectors
@@ -1245,10 +2259,43 @@ int ParseISOfileSystem(const tinyxml2::XMLElement* trackElement, const fs::path&
 	dirTree->SortDirectoryEntries(global::new_type.value_or(false));
 	totalLen = dirTree->CalculateTreeLBA(rootLBA);
 
+	// Rearrange the files for an access trace, through forced LBAs
+	if ( global::traceFile )
+	{
+		const auto trace = seeksim::LoadTrace(*global::traceFile);
+		if ( !trace )
+		{
+			if ( !global::QuietMode )
+			{
+				printf( "      " );
+			}
+			printf( "ERROR: Cannot read access trace \"%s\".\n", global::traceFile->lexically_normal().string().c_str() );
+			return false;
+		}
+
+		if ( iso::PlanLayout(dirTree, *trace, global::traceAlignment) )
+		{
+			totalLen = dirTree->CalculateTreeLBA(rootLBA);
+		}
+	}
+
 	if ( !global::QuietMode )
 	{
 		printf( "      Files Total: %d\n", dirTree->GetFileCountTotal() );
 		printf( "      Directories: %d\n", dirTree->GetDirCountTotal() );
+		printf( "      Source files probed: %zu (%.3f seconds)\n", sourceCache.GetCount(), prefetchTime.count() );
+		if ( streamedTree != nullptr )
+		{
+			printf( "      Directory tree parsed in %.3f seconds (streamed)\n", parseTime.count() );
+		}
+		if ( global::Dedup )
+		{
+			printf( "      Duplicate files: %zu (%u sectors saved)\n", duplicateFiles, dedupSavedSectors );
+		}
+		if ( streamedTree != nullptr )
+		{
+			printf( "      Peak memory usage: %.1f MB\n", GetPeakMemoryUsage() / (1024.0 * 1024.0) );
+		}
 		printf( "      Total file system size: %d bytes (%d sectors)\n\n",
 			CD_SECTOR_SIZE*totalLen, totalLen);
 	}
@@ -1257,10 +2304,26 @@ int ParseISOfileSystem(const tinyxml2::XMLElement* trackElement, const fs::path&
 		printf( "WARNING: System duration > 71 minutes\n\n" );
 	}
 
+	if ( global::simulateTraceFile )
+	{
+		const auto trace = seeksim::LoadTrace(*global::simulateTraceFile);
+		if ( !trace )
+		{
+			if ( !global::QuietMode )
+			{
+				printf( "      " );
+			}
+			printf( "ERROR: Cannot read access trace \"%s\".\n", global::simulateTraceFile->lexically_normal().string().c_str() );
+			return false;
+		}
+		seeksim::PrintTraceSimulation(*trace, iso::GetDiscFiles(dirTree), global::driveModel);
+	}
+
 	return true;
 }
 
-static bool ParseFileEntry(iso::DirTreeClass* dirTree, const tinyxml2::XMLElement* dirElement, const fs::path& xmlPath, const EntryAttributes& defaultAttributes)
+template<typename Element>
+static bool ParseFileEntry(iso::DirTreeClass* dirTree, const Element* dirElement, const fs::path& xmlPath, const EntryAttributes& defaultAttributes, const tinyxml2::XMLElement* projectElement)
 {
 	const char* nameElement = dirElement->Attribute(xml::attrib::ENTRY_NAME);
 	const char* sourceElement = dirElement->Attribute(xml::attrib::ENTRY_SOURCE);
@@ -1375,24 +2438,9 @@ static bool ParseFileEntry(iso::DirTreeClass* dirTree, const tinyxml2::XMLElemen
 				printf( "ERROR: DA audio file(s) does not have an associated CDDA track [trackid]\n" );
 				return false;
 			}
-			// locate the node containing the tracks
-			const tinyxml2::XMLElement *isoElement;
-			for( const tinyxml2::XMLElement *parent = (tinyxml2::XMLElement *)dirElement->Parent(); ; parent = (tinyxml2::XMLElement *)parent->Parent())
-			{
-				if(parent == nullptr)
-				{
-					printf( "ERROR: locating <%s> elem, necessary for locating corresponding track to da file\n", xml::elem::ISO_PROJECT );
-					return false;
-				}
-				if(CompareICase(parent->Name(), xml::elem::ISO_PROJECT))
-				{
-					isoElement = parent;
-					break;
-				}
-			}
 			// locate the track with trackid
 			const tinyxml2::XMLElement *trackElement;
-			for(trackElement = isoElement->FirstChildElement(xml::elem::TRACK); ; trackElement = trackElement->NextSiblingElement(xml::elem::TRACK))
+			for(trackElement = projectElement->FirstChildElement(xml::elem::TRACK); ; trackElement = trackElement->NextSiblingElement(xml::elem::TRACK))
 			{
 				if(trackElement == nullptr)
 				{
@@ -1431,7 +2479,8 @@ static bool ParseFileEntry(iso::DirTreeClass* dirTree, const tinyxml2::XMLElemen
 	return dirTree->AddFileEntry(name.c_str(), entry, xmlPath / srcFile, ReadEntryAttributes(defaultAttributes, dirElement), trackid);
 }
 
-static bool ParseDummyEntry(iso::DirTreeClass* dirTree, const tinyxml2::XMLElement* dirElement)
+template<typename Element>
+static bool ParseDummyEntry(iso::DirTreeClass* dirTree, const Element* dirElement)
 {
 	// TODO: For now this is a hack, unify this code again with the file type in the future
 	// so it isn't as awkward
@@ -1443,7 +2492,9 @@ static bool ParseDummyEntry(iso::DirTreeClass* dirTree, const tinyxml2::XMLEleme
 	return true;
 }
 
-static bool ParseDirEntry(iso::DirTreeClass* dirTree, const tinyxml2::XMLElement* dirElement, const fs::path& xmlPath, const EntryAttributes& defaultAttributes)
+// Returns the added directory, or nullptr on failure
+template<typename Element>
+static iso::DirTreeClass* AddDirEntry(iso::DirTreeClass* dirTree, const Element* dirElement, const fs::path& xmlPath, const EntryAttributes& defaultAttributes)
 {
 	const char* nameElement = dirElement->Attribute(xml::attrib::ENTRY_NAME);
 	if ( strlen( nameElement ) > 12 )
@@ -1452,7 +2503,7 @@ static bool ParseDirEntry(iso::DirTreeClass* dirTree, const tinyxml2::XMLElement
 		{
 			printf( "ERROR: Directory name '%s' on line %d is more than 31 "
 				"characters long.\n", nameElement, dirElement->GetLineNum() );
-			return false;
+			return nullptr;
 		}
 		if ( !global::noWarns )
 		{
@@ -1476,30 +2527,35 @@ static bool ParseDirEntry(iso::DirTreeClass* dirTree, const tinyxml2::XMLElement
 		if (level > 8)
 		{
 			printf("ERROR: Directory hierarchy depth exceeds 8 levels on line %d.\n", dirElement->GetLineNum());
-			return false;
+			return nullptr;
 		}
 	}
 
 	bool alreadyExists = false;
-	iso::DirTreeClass* subdir = dirTree->AddSubDirEntry(
+	return dirTree->AddSubDirEntry(
 		nameElement, srcDir, ReadEntryAttributes(defaultAttributes, dirElement), alreadyExists );
+}
+
+static bool ParseDirEntry(iso::DirTreeClass* dirTree, const tinyxml2::XMLElement* dirElement, const fs::path& xmlPath, const EntryAttributes& defaultAttributes, const tinyxml2::XMLElement* projectElement)
+{
+	iso::DirTreeClass* subdir = AddDirEntry(dirTree, dirElement, xmlPath, defaultAttributes);
 
 	if ( subdir == nullptr )
 	{
 		return false;
 	}
 
-	return ParseDirectory(subdir, dirElement, xmlPath, defaultAttributes);
+	return ParseDirectory(subdir, dirElement, xmlPath, defaultAttributes, projectElement);
 }
 
-bool ParseDirectory(iso::DirTreeClass* dirTree, const tinyxml2::XMLElement* parentElement, const fs::path& xmlPath, const EntryAttributes& defaultAttributes)
+bool ParseDirectory(iso::DirTreeClass* dirTree, const tinyxml2::XMLElement* parentElement, const fs::path& xmlPath, const EntryAttributes& defaultAttributes, const tinyxml2::XMLElement* projectElement)
 {
 	for ( const tinyxml2::XMLElement* dirElement = parentElement->FirstChildElement(); dirElement != nullptr; dirElement = dirElement->NextSiblingElement() )
 	{
 		
 		if ( CompareICase( "file", dirElement->Name() ))
 		{
-			if (!ParseFileEntry(dirTree, dirElement, xmlPath, defaultAttributes))
+			if (!ParseFileEntry(dirTree, dirElement, xmlPath, defaultAttributes, projectElement))
 			{
 				return false;
 			}
@@ -1513,7 +2569,7 @@ bool ParseDirectory(iso::DirTreeClass* dirTree, const tinyxml2::XMLElement* pare
         }
 		else if ( CompareICase( "dir", dirElement->Name() ))
 		{
-			if (!ParseDirEntry(dirTree, dirElement, xmlPath, defaultAttributes))
+			if (!ParseDirEntry(dirTree, dirElement, xmlPath, defaultAttributes, projectElement))
 			{
 				return false;
 			}
@@ -1523,56 +2579,357 @@ bool ParseDirectory(iso::DirTreeClass* dirTree, const tinyxml2::XMLElement* pare
 	return true;
 }
 
-bool PackFileAsCDDA(void* buffer, const fs::path& audioFile)
+// Builds a directory tree straight from the parse events of the XML file, without keeping its elements around
+static bool ParseStreamedDirectory(iso::DirTreeClass* rootDir, xml::EventReader& reader, const StreamedTree& streamedTree, const fs::path& xmlPath, const EntryAttributes& defaultAttributes, const tinyxml2::XMLElement* projectElement)
 {
-	// open the decoder
-	ma_decoder decoder;
-	VirtualWavEx vw;
-	bool isLossy;
-	bool isPCM;
-	if(ma_redbook_decoder_init_path_by_ext(audioFile, &decoder, &vw, isLossy, isPCM) != MA_SUCCESS)
-	{
-		ma_decoder_uninit(&decoder);
+	using Event = xml::EventReader::Event;
+
+	if ( !reader.Seek(streamedTree.offset, streamedTree.line) || reader.Next() != Event::StartElement )
+	{
+		printf( "ERROR: Cannot read <%s> element on line %d.\n", xml::elem::DIRECTORY_TREE, streamedTree.line );
 		return false;
 	}
-	else if (isPCM && !global::QuietMode && !global::noWarns)
+
+	// Directory the children of each open element are added to, nullptr if they are ignored
+	std::vector<iso::DirTreeClass*> dirStack { rootDir };
+	while ( !dirStack.empty() )
+	{
+		const Event event = reader.Next();
+		if ( event == Event::EndElement )
+		{
+			dirStack.pop_back();
+			continue;
+		}
+		if ( event != Event::StartElement )
+		{
+			printf( "ERROR: %s on line %d\n", reader.GetErrorName(), reader.GetErrorLineNum() );
+			return false;
+		}
+
+		iso::DirTreeClass* dirTree = dirStack.back();
+		iso::DirTreeClass* subdir = nullptr;
+		if ( dirTree != nullptr )
+		{
+			xml::StreamElement& dirElement = reader.Current();
+			if ( CompareICase( "file", dirElement.Name() ))
+			{
+				// Point DA files converted from the source syntax at their new tracks
+				if ( auto it = streamedTree.daTrackIds.find(reader.GetElementOffset()); it != streamedTree.daTrackIds.end() )
+				{
+					dirElement.DeleteAttribute(xml::attrib::ENTRY_SOURCE);
+					dirElement.SetAttribute(xml::attrib::TRACK_ID, it->second.c_str());
+				}
+
+				if (!ParseFileEntry(dirTree, &dirElement, xmlPath, defaultAttributes, projectElement))
+				{
+					return false;
+				}
+			}
+			else if ( CompareICase( "dummy", dirElement.Name() ))
+			{
+				if (!ParseDummyEntry(dirTree, &dirElement))
+				{
+					return false;
+				}
+			}
+			else if ( CompareICase( "dir", dirElement.Name() ))
+			{
+				subdir = AddDirEntry(dirTree, &dirElement, xmlPath, defaultAttributes);
+				if ( subdir == nullptr )
+				{
+					return false;
+				}
+			}
+		}
+		dirStack.push_back(subdir);
+	}
+
+	return true;
+}
+
+static void AppendEscapedXML(std::string& str, std::string_view value)
+{
+	for ( const char ch : value )
+	{
+		switch ( ch )
+		{
+		case '&': str += "&amp;"; break;
+		case '<': str += "&lt;"; break;
+		case '>': str += "&gt;"; break;
+		case '"': str += "&quot;"; break;
+		case '\n': str += "&#10;"; break;
+		case '\r': str += "&#13;"; break;
+		case '\t': str += "&#9;"; break;
+		default: str += ch; break;
+		}
+	}
+}
+
+// Pairs up the directory tree elements of the document with the trees found while streaming, in document order
+static void MapStreamedTrees(const tinyxml2::XMLNode* parent, std::vector<StreamedTree>::iterator& tree, StreamedProject& project)
+{
+	for ( const tinyxml2::XMLElement* element = parent->FirstChildElement(); element != nullptr; element = element->NextSiblingElement() )
 	{
-		printf("\n      WARNING: Guessing it's signed 16 bit stereo @ 44100 kHz pcm audio... ");
+		if ( strcmp( element->Name(), xml::elem::DIRECTORY_TREE ) == 0 )
+		{
+			project.trees.emplace(element, std::move(*tree++));
+		}
+		else
+		{
+			MapStreamedTrees(element, tree, project);
+		}
 	}
+}
+
+// Streams through the XML file or project manifest, loading everything but the contents of directory trees into xmlFile.
+// The trees are only located and scanned for source files, to be parsed straight from the file later.
+// DA files using the source syntax are converted to the trackid syntax the same way as in the DOM mode.
+static bool LoadStreamedProject(const fs::path& xmlPath, tinyxml2::XMLDocument& xmlFile, StreamedProject& project)
+{
+	profiler::Scope scope("load project");
+	using Event = xml::EventReader::Event;
 
-	// note if there's some data converting going on
-	ma_format internalFormat;
-	ma_uint32 internalChannels;
-	ma_uint32 internalSampleRate;
-	if(ma_data_source_get_data_format(decoder.pBackend, &internalFormat, &internalChannels, &internalSampleRate, NULL, 0) != MA_SUCCESS)
+	unique_file file = OpenScopedFile(xmlPath, "rb");
+	if ( file == nullptr )
 	{
-		printf("\n    ERROR: unable to get internal metadata for \"%s\"\n", audioFile.string().c_str());
-		ma_decoder_uninit(&decoder);
+		printf( "ERROR: File not found.\n" );
 		return false;
 	}
-	if(((internalFormat != ma_format_s16) || (internalChannels != 2) || (internalSampleRate != 44100) || isLossy) && !global::QuietMode && !global::noWarns)
+
+	bool opened;
+	if ( xml::IsManifestPath(xmlPath) )
+	{
+		auto manifestReader = std::make_unique<xml::ManifestReader>();
+		opened = manifestReader->Open(std::move(file));
+		project.reader = std::move(manifestReader);
+	}
+	else
 	{
-		printf("\n      WARNING: This is not Redbook audio, converting... ");
+		auto xmlReader = std::make_unique<xml::XMLStreamReader>();
+		opened = xmlReader->Open(std::move(file));
+		project.reader = std::move(xmlReader);
 	}
 
-	// get expected pcm frame count (if your file isn't redbook this can vary from the input file's amount)
-	// unfortunately it needs to decode the whole file to determine this for mp3
-	ma_uint64 expectedPCMFrames;
-	if(ma_decoder_get_length_in_pcm_frames(&decoder, &expectedPCMFrames) != MA_SUCCESS)
+	xml::EventReader& reader = *project.reader;
+	if ( !opened )
 	{
-		printf("\n    ERROR: corrupt file? unable to get_length_in_pcm_frames\n");
-		ma_decoder_uninit(&decoder);
+		printf( "ERROR: %s on line %d\n", reader.GetErrorName(), reader.GetErrorLineNum() );
 		return false;
 	}
 
-	ma_uint64 framesRead;
-	ma_decoder_read_pcm_frames(&decoder, buffer, expectedPCMFrames, &framesRead);
-	ma_decoder_uninit(&decoder);
+	// DA file with a source attribute, which gets an audio track of its own
+	struct DAFile
+	{
+		std::vector<unsigned> childPath;
+		uint64_t offset;
+		std::string source;
+	};
+
+	// Element inside a directory tree
+	struct TreeLevel
+	{
+		unsigned childCount;
+		bool parsed;	// Children are parsed as directory entries
+		bool scanned;	// Children are scanned for DA files to convert
+	};
+
+	// Document without the directory tree contents, padded so elements keep their line numbers
+	std::string skeleton;
+	int skeletonLine = 1;
+
+	std::vector<StreamedTree> trees;
+	std::vector<TreeLevel> treeLevels;
+	std::vector<unsigned> childPath;
+	std::vector<DAFile> daFiles;
+	size_t convertedTree = 0;
+	unsigned trackindex = 2;
+
+	// Like in the DOM mode, only the first directory tree of a project's first track is converted, if it's a data track
+	size_t depth = 0;
+	bool inProject = false, projectHasTrack = false, convertTrack = false, trackHasTree = false;
+
+	for (;;)
+	{
+		const Event event = reader.Next();
+		if ( event == Event::EndOfDocument )
+		{
+			break;
+		}
+		if ( event == Event::Error )
+		{
+			printf( "ERROR: %s on line %d\n", reader.GetErrorName(), reader.GetErrorLineNum() );
+			return false;
+		}
+
+		const xml::StreamElement& element = reader.Current();
+		if ( event == Event::EndElement )
+		{
+			depth--;
+			if ( treeLevels.size() > 1 )
+			{
+				treeLevels.pop_back();
+				childPath.pop_back();
+				continue;
+			}
+			treeLevels.clear();
+
+			skeleton += "</";
+			skeleton += element.Name();
+			skeleton += '>';
+
+			// Add the new audio tracks right after the data track, in breadth first order of their files
+			if ( convertTrack && depth == 1 )
+			{
+				convertTrack = false;
+				std::sort(daFiles.begin(), daFiles.end(), [](const DAFile& left, const DAFile& right)
+				{
+					if ( left.childPath.size() != right.childPath.size() )
+					{
+						return left.childPath.size() < right.childPath.size();
+					}
+					return left.childPath < right.childPath;
+				});
+
+				for ( const DAFile& daFile : daFiles )
+				{
+					char tid[3];
+					snprintf(tid, sizeof(tid), "%02u", trackindex);
+					trackindex++;
+
+					skeleton += '<';
+					skeleton += xml::elem::TRACK;
+					skeleton += ' ';
+					skeleton += xml::attrib::TRACK_TYPE;
+					skeleton += "=\"audio\" ";
+					skeleton += xml::attrib::TRACK_ID;
+					skeleton += "=\"";
+					skeleton += tid;
+					skeleton += "\" ";
+					skeleton += xml::attrib::TRACK_SOURCE;
+					skeleton += "=\"";
+					AppendEscapedXML(skeleton, daFile.source);
+					skeleton += "\"/>";
+
+					trees[convertedTree].daTrackIds.emplace(daFile.offset, tid);
+				}
+				daFiles.clear();
+			}
+			continue;
+		}
+
+		// Contents of a directory tree
+		if ( !treeLevels.empty() )
+		{
+			depth++;
+
+			TreeLevel& parent = treeLevels.back();
+			childPath.push_back(parent.childCount++);
+
+			const bool isFile = CompareICase( "file", element.Name() );
+			const bool isDir = CompareICase( "dir", element.Name() );
+			if ( isFile )
+			{
+				const char* typeElement = element.Attribute(xml::attrib::ENTRY_TYPE);
+				if ( parent.parsed && ( typeElement == nullptr || !CompareICase( "da", typeElement ) ) )
+				{
+					const char* sourceElement = element.Attribute(xml::attrib::ENTRY_SOURCE);
+					if ( sourceElement == nullptr )
+					{
+						sourceElement = element.Attribute(xml::attrib::ENTRY_NAME);
+					}
+
+					if ( sourceElement != nullptr )
+					{
+						const bool isXA = typeElement != nullptr &&
+							( CompareICase( "mixed", typeElement ) || CompareICase( "xa", typeElement ) || CompareICase( "str", typeElement ) );
+						trees.back().sources.emplace_back(sourceElement, isXA);
+					}
+				}
+
+				if ( parent.scanned && element.Attribute(xml::attrib::ENTRY_TYPE, "da") )
+				{
+					const char *trackid = element.Attribute(xml::attrib::TRACK_ID);
+					const char *source = element.Attribute(xml::attrib::ENTRY_SOURCE);
+					if ( (trackid != nullptr) && (source != nullptr) )
+					{
+						printf( "ERROR: Cannot specify trackid and source at the same time\n ");
+						return false;
+					}
+					if ( source != nullptr )
+					{
+						daFiles.push_back({childPath, reader.GetElementOffset(), source});
+					}
+				}
+			}
+			else if ( isDir && parent.parsed )
+			{
+				if ( const char* sourceElement = element.Attribute(xml::attrib::ENTRY_SOURCE); sourceElement != nullptr )
+				{
+					trees.back().sources.emplace_back(sourceElement, false);
+				}
+			}
+
+			const TreeLevel level { 0, parent.parsed && isDir, parent.scanned && !isFile };
+			treeLevels.push_back(level);
+			continue;
+		}
+
+		const char* name = element.Name();
+		if ( depth == 0 )
+		{
+			inProject = strcmp( name, xml::elem::ISO_PROJECT ) == 0;
+			projectHasTrack = false;
+		}
+		else if ( depth == 1 && inProject && strcmp( name, xml::elem::TRACK ) == 0 )
+		{
+			convertTrack = !projectHasTrack && element.Attribute(xml::attrib::TRACK_TYPE, "data") != nullptr;
+			projectHasTrack = true;
+			trackHasTree = false;
+		}
+
+		while ( skeletonLine < element.GetLineNum() )
+		{
+			skeleton += '\n';
+			skeletonLine++;
+		}
+
+		skeleton += '<';
+		skeleton += name;
+		for ( size_t i = 0; i < element.GetAttributeCount(); i++ )
+		{
+			skeleton += ' ';
+			skeleton += element.GetAttributeName(i);
+			skeleton += "=\"";
+			AppendEscapedXML(skeleton, element.GetAttributeValue(i));
+			skeleton += '"';
+		}
+		skeleton += '>';
+
+		if ( strcmp( name, xml::elem::DIRECTORY_TREE ) == 0 )
+		{
+			const bool convert = convertTrack && depth == 2 && !trackHasTree;
+			if ( convert )
+			{
+				convertedTree = trees.size();
+				trackHasTree = true;
+			}
+
+			StreamedTree& tree = trees.emplace_back();
+			tree.offset = reader.GetElementOffset();
+			tree.line = element.GetLineNum();
+			treeLevels.push_back({ 0, true, convert });
+		}
+		depth++;
+	}
 
-	if(framesRead != expectedPCMFrames)
+	if ( xmlFile.Parse(skeleton.data(), skeleton.size()) != tinyxml2::XML_SUCCESS )
 	{
-		printf("\n    ERROR: corrupt file? (framesRead != expectedPCMFrames)\n");
+		printf( "ERROR: %s on line %d\n", xmlFile.ErrorName(), xmlFile.ErrorLineNum() );
 		return false;
 	}
+
+	auto tree = trees.begin();
+	MapStreamedTrees(&xmlFile, tree, project);
+
 	return true;
 }
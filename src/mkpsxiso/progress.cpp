@@ -0,0 +1,91 @@
+#include "progress.h"
+#include "cd.h"
+#include <algorithm>
+
+using namespace progress;
+
+static constexpr std::chrono::milliseconds STATUS_INTERVAL(250);
+static constexpr std::chrono::seconds JSON_INTERVAL(1);
+
+Reporter::Reporter(const Counters& counters, FILE* statusLine, FILE* jsonLines)
+	: m_counters(counters), m_statusLine(statusLine), m_jsonLines(jsonLines)
+	, m_start(std::chrono::steady_clock::now()), m_lastJson(m_start)
+{
+	m_thread = std::thread(&Reporter::Run, this);
+}
+
+Reporter::~Reporter()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_stopCondition.notify_one();
+	m_thread.join();
+
+	Report(true);
+}
+
+void Reporter::Run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_stopCondition.wait_for(lock, STATUS_INTERVAL, [this] { return m_stop; }))
+	{
+		Report(false);
+	}
+}
+
+void Reporter::Report(bool final)
+{
+	const auto now = std::chrono::steady_clock::now();
+	const double elapsed = std::chrono::duration<double>(now - m_start).count();
+
+	const char* phase = final ? "done" : m_counters.phase.load(std::memory_order_relaxed);
+	const uint64_t total = m_counters.totalSectors.load(std::memory_order_relaxed);
+	const uint64_t written = m_counters.writtenSectors.load(std::memory_order_relaxed);
+	const uint64_t checksummed = m_counters.checksummedSectors.load(std::memory_order_relaxed);
+	const int64_t queued = m_counters.queuedChecksums.load(std::memory_order_relaxed);
+
+	// Rates over the whole build, which are steadier than the ones of the last interval
+	const double sectorsPerSecond = elapsed > 0.0 ? written / elapsed : 0.0;
+	const double bytesPerSecond = sectorsPerSecond * CD_SECTOR_SIZE;
+	const uint64_t remaining = total > written ? total - written : 0;
+	const double eta = sectorsPerSecond > 0.0 ? remaining / sectorsPerSecond : -1.0;
+	const double percent = total != 0 ? std::min(100.0, 100.0 * written / total) : 0.0;
+
+	if (m_statusLine != nullptr)
+	{
+		char etaText[16] = "--:--";
+		if (eta >= 0.0)
+		{
+			const unsigned int seconds = static_cast<unsigned int>(eta + 0.5);
+			snprintf(etaText, sizeof(etaText), "%u:%02u", seconds / 60, seconds % 60);
+		}
+
+		fprintf(m_statusLine, "\r  %-12s %5.1f%% %8.1f MB/s %9.0f sectors/s  queue %-5lld ETA %-8s",
+			phase, percent, bytesPerSecond / (1024.0 * 1024.0), sectorsPerSecond, static_cast<long long>(queued), etaText);
+		if (final)
+		{
+			fprintf(m_statusLine, "\n");
+		}
+		fflush(m_statusLine);
+	}
+
+	if (m_jsonLines != nullptr && (final || now - m_lastJson >= JSON_INTERVAL))
+	{
+		m_lastJson = now;
+		fprintf(m_jsonLines, "{\"phase\":\"%s\",\"elapsed\":%.3f,\"written_sectors\":%llu,\"total_sectors\":%llu,"
+			"\"checksummed_sectors\":%llu,\"checksum_queue\":%lld,\"bytes_per_second\":%.0f,\"sectors_per_second\":%.1f,",
+			phase, elapsed, static_cast<unsigned long long>(written), static_cast<unsigned long long>(total),
+			static_cast<unsigned long long>(checksummed), static_cast<long long>(queued), bytesPerSecond, sectorsPerSecond);
+		if (eta >= 0.0)
+		{
+			fprintf(m_jsonLines, "\"eta\":%.1f}\n", eta);
+		}
+		else
+		{
+			fprintf(m_jsonLines, "\"eta\":null}\n");
+		}
+		fflush(m_jsonLines);
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef _PROGRESS_H
+#define _PROGRESS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+namespace progress
+{
+	/// Counters of a running image build, updated from any thread. Writers only update them when
+	/// given a pointer to them, so builds without progress reporting pay nothing for them.
+	struct Counters
+	{
+		std::atomic<const char*>	phase { "starting" };		/// Short name of the current build phase
+		std::atomic<uint64_t>		totalSectors { 0 };			/// Sectors the build is going to write
+		std::atomic<uint64_t>		writtenSectors { 0 };		/// Sectors filled in by sector views
+		std::atomic<uint64_t>		checksummedSectors { 0 };	/// Sectors with their EDC/ECC calculated
+		std::atomic<int64_t>		queuedChecksums { 0 };		/// Sectors whose checksums are still to be calculated
+	};
+
+	class Reporter
+	{
+	public:
+		/** Starts reporting the counters on a thread of its own, until the reporter is destroyed.
+		 *
+		 *	statusLine	- Stream to render a status line on, rewritten in place, or null.
+		 *	jsonLines	- Stream to write a JSON object to every second, one per line, or null.
+		 */
+		Reporter(const Counters& counters, FILE* statusLine, FILE* jsonLines);
+
+		/** Stops the reporter thread and reports the final counters.
+		 */
+		~Reporter();
+
+	private:
+		void Run();
+		void Report(bool final);
+
+		const Counters& m_counters;
+		FILE* m_statusLine;
+		FILE* m_jsonLines;
+		const std::chrono::steady_clock::time_point m_start;
+		std::chrono::steady_clock::time_point m_lastJson;
+
+		std::mutex m_mutex;
+		std::condition_variable m_stopCondition;
+		bool m_stop = false;
+		std::thread m_thread;
+	};
+};
+
+#endif // _PROGRESS_H
@@ -0,0 +1,185 @@
+#include "watch.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace watch;
+
+static constexpr int POLL_INTERVAL_MS = 250;
+
+// Changes closer together than this are taken as one, editors and build tools often save files in steps
+static constexpr int SETTLE_TIME_MS = 200;
+
+FileWatcher::FileWatcher()
+{
+#ifdef __linux__
+	m_inotify = inotify_init1(IN_CLOEXEC);
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+	if (m_inotify >= 0)
+	{
+		close(m_inotify);
+	}
+#endif
+}
+
+void FileWatcher::Add(const fs::path& path)
+{
+	std::error_code ec;
+	const fs::path absolutePath = fs::absolute(path, ec).lexically_normal();
+	if (ec)
+	{
+		return;
+	}
+
+	File& file = m_files[absolutePath.native()];
+	file.path = absolutePath;
+	file.attrib = Stat(absolutePath);
+
+#ifdef __linux__
+	if (m_inotify >= 0)
+	{
+		const fs::path directory = absolutePath.parent_path();
+		const int wd = inotify_add_watch(m_inotify, directory.c_str(),
+			IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+		if (wd >= 0)
+		{
+			m_directories.emplace(wd, directory);
+		}
+	}
+#endif
+}
+
+void FileWatcher::Clear()
+{
+	m_files.clear();
+
+#ifdef __linux__
+	for (const auto& [wd, directory] : m_directories)
+	{
+		inotify_rm_watch(m_inotify, wd);
+	}
+	m_directories.clear();
+#endif
+}
+
+fs::path FileWatcher::Wait()
+{
+	std::optional<fs::path> changed;
+	while (!(changed = WaitForChange(-1)))
+	{
+	}
+
+	while (WaitForChange(SETTLE_TIME_MS))
+	{
+	}
+	return *changed;
+}
+
+std::optional<fs::path> FileWatcher::WaitForChange(int timeoutMs)
+{
+#ifdef __linux__
+	if (m_inotify >= 0)
+	{
+		// Events of other files in the watched directories, such as the image being written, are skipped
+		alignas(inotify_event) char buffer[16 * 1024];
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+		for (;;)
+		{
+			int remainingMs = -1;
+			if (timeoutMs >= 0)
+			{
+				remainingMs = static_cast<int>(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(
+					deadline - std::chrono::steady_clock::now()).count()));
+			}
+
+			pollfd fd { m_inotify, POLLIN, 0 };
+			const int ready = poll(&fd, 1, remainingMs);
+			if (ready == 0)
+			{
+				return std::nullopt;
+			}
+
+			const ssize_t size = ready > 0 ? read(m_inotify, buffer, sizeof(buffer)) : -1;
+			if (size <= 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				// Keep going by comparing modification times
+				close(m_inotify);
+				m_inotify = -1;
+				m_directories.clear();
+				return PollForChange(timeoutMs);
+			}
+
+			std::optional<fs::path> changed;
+			for (const char* ptr = buffer; ptr < buffer + size; )
+			{
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+				ptr += sizeof(inotify_event) + event->len;
+
+				if (event->len == 0 || changed.has_value())
+				{
+					continue;
+				}
+				if (auto directory = m_directories.find(event->wd); directory != m_directories.end())
+				{
+					const fs::path path = directory->second / event->name;
+					if (m_files.find(path.native()) != m_files.end())
+					{
+						changed = path;
+					}
+				}
+			}
+
+			if (changed.has_value())
+			{
+				return changed;
+			}
+		}
+	}
+#endif
+
+	return PollForChange(timeoutMs);
+}
+
+std::optional<fs::path> FileWatcher::PollForChange(int timeoutMs)
+{
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+	for (;;)
+	{
+		const auto now = std::chrono::steady_clock::now();
+		if (timeoutMs >= 0 && now >= deadline)
+		{
+			return std::nullopt;
+		}
+		std::this_thread::sleep_for(timeoutMs >= 0 ? std::min<std::chrono::steady_clock::duration>(deadline - now,
+			std::chrono::milliseconds(POLL_INTERVAL_MS)) : std::chrono::milliseconds(POLL_INTERVAL_MS));
+
+		for (auto& [key, file] : m_files)
+		{
+			std::optional<struct stat64> attrib = Stat(file.path);
+			const bool changed = attrib.has_value() != file.attrib.has_value() || (attrib.has_value() &&
+				(attrib->st_size != file.attrib->st_size || attrib->st_mtime != file.attrib->st_mtime));
+			if (changed)
+			{
+				file.attrib = attrib;
+				return file.path;
+			}
+		}
+	}
+}
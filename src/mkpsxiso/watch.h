@@ -0,0 +1,62 @@
+#ifndef _WATCH_H
+#define _WATCH_H
+
+#include "platform.h"
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace watch
+{
+	/// Waits for changes of a set of files. Uses inotify on Linux, so a change is noticed as soon as
+	/// it is written, and compares the modification time of every file a few times a second elsewhere.
+	class FileWatcher
+	{
+	public:
+		FileWatcher();
+		~FileWatcher();
+
+		FileWatcher(const FileWatcher&) = delete;
+		FileWatcher& operator=(const FileWatcher&) = delete;
+
+		/** Starts watching a file. The directory holding it is watched as well, so a file which
+		 *	editors save by replacing it, or which does not exist yet, is still seen to change.
+		 */
+		void Add(const fs::path& path);
+
+		/** Stops watching all files.
+		 */
+		void Clear();
+
+		size_t GetCount() const { return m_files.size(); }
+
+		/** Blocks until a watched file changes, then until no further changes come for a short
+		 *	while, so the files are not read while they are still being saved.
+		 *
+		 *	Returns the first of the changed files.
+		 */
+		fs::path Wait();
+
+	private:
+		struct File
+		{
+			fs::path path;
+			std::optional<struct stat64> attrib;
+		};
+
+		/** Returns a changed file, or nothing if none changed within the timeout.
+		 */
+		std::optional<fs::path> WaitForChange(int timeoutMs);
+		std::optional<fs::path> PollForChange(int timeoutMs);
+
+		// Files by absolute path
+		std::unordered_map<fs::path::string_type, File> m_files;
+
+#ifdef __linux__
+		int m_inotify = -1;
+		std::unordered_map<int, fs::path> m_directories; // Watched directories by watch descriptor
+#endif
+	};
+};
+
+#endif // _WATCH_H
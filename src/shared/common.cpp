@@ -149,6 +149,53 @@ bool CompareICase(std::string_view strLeft, std::string_view strRight)
 		});
 }
 
+bool MatchWildcardICase(std::string_view pattern, std::string_view str)
+{
+	// Greedy matching, backtracking to the last * on a mismatch
+	size_t p = 0, s = 0;
+	size_t starPattern = std::string_view::npos, starStr = 0;
+	while (s < str.length())
+	{
+		if (p < pattern.length() && pattern[p] == '*')
+		{
+			starPattern = p++;
+			starStr = s;
+		}
+		else if (p < pattern.length() && (pattern[p] == '?' || std::tolower(pattern[p]) == std::tolower(str[s])))
+		{
+			p++;
+			s++;
+		}
+		else if (starPattern != std::string_view::npos)
+		{
+			p = starPattern + 1;
+			s = ++starStr;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	while (p < pattern.length() && pattern[p] == '*')
+	{
+		p++;
+	}
+	return p == pattern.length();
+}
+
+size_t ICaseHash::operator()(std::string_view str) const
+{
+	// FNV-1a over the lowercased characters, so it agrees with CompareICase
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (char ch : str)
+	{
+		hash ^= static_cast<unsigned char>(std::tolower(ch));
+		hash *= 0x100000001b3ull;
+	}
+	return static_cast<size_t>(hash);
+}
+
 bool ParseArgument(char** argv, std::string_view command, std::string_view longCommand)
 {
 	const std::string_view arg(*argv);
@@ -170,7 +217,9 @@ std::optional<fs::path> ParsePathArgument(char**& argv, std::string_view command
 {
 	if (ParseArgument(argv, command, longCommand))
 	{
-		if (*(argv+1) != nullptr && **(argv+1) != '-')
+		// A lone - is a value, standing for stdin or stdout
+		const char* next = *(argv+1);
+		if (next != nullptr && (next[0] != '-' || next[1] == '\0'))
 		{
 			argv++;
 		}
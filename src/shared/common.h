@@ -49,12 +49,6 @@ public:
 	unsigned int FLBA = DEFAULT_FORCE_LBA;
 };
 
-// Shared by mkpsxiso and dumpsxiso
-namespace global
-{
-	extern std::optional<bool> new_type;
-}
-
 // Helper functions for datestamp manipulation
 cd::ISO_DATESTAMP GetDateFromString(const char* str, bool* success = nullptr);
 cd::ISO_LONG_DATESTAMP GetLongDateFromString(const char* str);
@@ -87,6 +81,21 @@ unique_file OpenScopedFile(const fs::path& path, const char* mode);
 // Helper functions for string manipulation
 std::string CleanIdentifier(std::string_view id);
 bool CompareICase(std::string_view strLeft, std::string_view strRight);
+bool MatchWildcardICase(std::string_view pattern, std::string_view str); // * matches any run of characters, ? any single one
+
+// Case insensitive hash and equality, for unordered containers keyed by identifiers
+struct ICaseHash
+{
+	size_t operator()(std::string_view str) const;
+};
+
+struct ICaseEqual
+{
+	bool operator()(std::string_view strLeft, std::string_view strRight) const
+	{
+		return CompareICase(strLeft, strRight);
+	}
+};
 
 // Argument parsing
 bool ParseArgument(char** argv, std::string_view command, std::string_view longCommand = std::string_view{});
@@ -0,0 +1,317 @@
+#include "ecm.h"
+#include "edcecc.h"
+#include "platform.h"
+#include <algorithm>
+
+static const EDCECC EDC_ECC_GEN;
+
+static constexpr unsigned char SIGNATURE[4] = { 'E', 'C', 'M', 0 };
+static constexpr unsigned char SYNC_PATTERN[12] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+static constexpr uint32_t END_OF_RECORDS = 0xFFFFFFFF;
+
+// Raw records are flushed once they reach this size, so long runs of audio are not buffered whole
+static constexpr size_t RAW_RECORD_SIZE = 256 * CD_SECTOR_SIZE;
+
+// Bytes stored in the file for each unit of a record
+static uint32_t GetStoredUnitSize(ecm::Type type)
+{
+	switch (type)
+	{
+	case ecm::Type::Mode1:		return 3 + F1_DATA_SIZE;
+	case ecm::Type::Mode2Form1:	return 4 + F1_DATA_SIZE;
+	case ecm::Type::Mode2Form2:	return 4 + F2_DATA_SIZE;
+	default:					return 1;
+	}
+}
+
+// Bytes of the decoded image for each unit of a record
+static uint32_t GetDecodedUnitSize(ecm::Type type)
+{
+	switch (type)
+	{
+	case ecm::Type::Mode1:		return CD_SECTOR_SIZE;
+	case ecm::Type::Mode2Form1:
+	case ecm::Type::Mode2Form2:	return XA_DATA_SIZE;
+	default:					return 1;
+	}
+}
+
+bool ecm::IsEcmFile(FILE* file)
+{
+	unsigned char signature[sizeof(SIGNATURE)];
+	return SeekFile(file, 0, SEEK_SET) == 0 && fread(signature, sizeof(signature), 1, file) == 1 &&
+		std::equal(std::begin(signature), std::end(signature), std::begin(SIGNATURE));
+}
+
+// ======================================================
+
+bool ecm::Writer::Open(FILE* file)
+{
+	m_file = file;
+	m_raw.clear();
+	m_raw.reserve(RAW_RECORD_SIZE + CD_SECTOR_SIZE);
+	m_edc = 0;
+	m_failed = fwrite(SIGNATURE, sizeof(SIGNATURE), 1, m_file) != 1;
+	return !m_failed;
+}
+
+void ecm::Writer::WriteRecordHeader(Type type, uint32_t count)
+{
+	count--;
+
+	unsigned char header[5];
+	size_t length = 0;
+	header[length++] = ((count >= 32) << 7) | ((count & 31) << 2) | static_cast<unsigned char>(type);
+	for (count >>= 5; count != 0; count >>= 7)
+	{
+		header[length++] = ((count >= 128) << 7) | (count & 127);
+	}
+
+	if (fwrite(header, 1, length, m_file) != length)
+	{
+		m_failed = true;
+	}
+}
+
+void ecm::Writer::FlushRaw()
+{
+	if (m_raw.empty())
+	{
+		return;
+	}
+
+	WriteRecordHeader(Type::Raw, static_cast<uint32_t>(m_raw.size()));
+	if (fwrite(m_raw.data(), 1, m_raw.size(), m_file) != m_raw.size())
+	{
+		m_failed = true;
+	}
+	m_raw.clear();
+}
+
+void ecm::Writer::WriteSector(const unsigned char* sector, Type type)
+{
+	m_edc = EDC_ECC_GEN.ComputeEdcBlockPartial(m_edc, sector, CD_SECTOR_SIZE);
+
+	// Decoders take the subheader from its second copy, so both must match
+	if ((type == Type::Mode2Form1 || type == Type::Mode2Form2) && !std::equal(sector + 0x10, sector + 0x14, sector + 0x14))
+	{
+		type = Type::Raw;
+	}
+
+	if (type == Type::Raw)
+	{
+		m_raw.insert(m_raw.end(), sector, sector + CD_SECTOR_SIZE);
+		if (m_raw.size() >= RAW_RECORD_SIZE)
+		{
+			FlushRaw();
+		}
+		return;
+	}
+
+	const unsigned char* data;
+	if (type == Type::Mode1)
+	{
+		FlushRaw();
+		WriteRecordHeader(type, 1);
+		if (fwrite(sector + 0xC, 3, 1, m_file) != 1)
+		{
+			m_failed = true;
+		}
+		data = sector + 0x10;
+	}
+	else
+	{
+		// The sync and address of Mode 2 sectors go in a Raw record
+		m_raw.insert(m_raw.end(), sector, sector + 0x10);
+		FlushRaw();
+		WriteRecordHeader(type, 1);
+		data = sector + 0x14;
+	}
+
+	const size_t dataSize = type == Type::Mode1 ? F1_DATA_SIZE : GetStoredUnitSize(type);
+	if (fwrite(data, 1, dataSize, m_file) != dataSize)
+	{
+		m_failed = true;
+	}
+}
+
+bool ecm::Writer::Close()
+{
+	FlushRaw();
+	WriteRecordHeader(Type::Raw, END_OF_RECORDS + 1);
+
+	const unsigned char edc[4] = { static_cast<unsigned char>(m_edc), static_cast<unsigned char>(m_edc >> 8),
+		static_cast<unsigned char>(m_edc >> 16), static_cast<unsigned char>(m_edc >> 24) };
+	if (fwrite(edc, sizeof(edc), 1, m_file) != 1)
+	{
+		m_failed = true;
+	}
+	return !m_failed && !ferror(m_file);
+}
+
+// ======================================================
+
+bool ecm::Reader::Open(unique_file file)
+{
+	m_file = std::move(file);
+	m_records.clear();
+	m_size = 0;
+
+	FILE* fp = m_file.get();
+	if (fp == nullptr || !IsEcmFile(fp))
+	{
+		return false;
+	}
+
+	uint64_t fileOffset = sizeof(SIGNATURE);
+	for (;;)
+	{
+		int c = getc(fp);
+		if (c == EOF)
+		{
+			return false;
+		}
+		fileOffset++;
+
+		const Type type = static_cast<Type>(c & 3);
+		uint32_t count = (c >> 2) & 0x1F;
+		for (unsigned int bits = 5; c & 0x80; bits += 7)
+		{
+			if (bits >= 32 || (c = getc(fp)) == EOF)
+			{
+				return false;
+			}
+			fileOffset++;
+			count |= static_cast<uint32_t>(c & 0x7F) << bits;
+		}
+
+		if (count == END_OF_RECORDS)
+		{
+			break;
+		}
+		count++;
+
+		m_records.push_back({ m_size, fileOffset, count, type });
+
+		const uint64_t storedSize = static_cast<uint64_t>(count) * GetStoredUnitSize(type);
+		if (SeekFile(fp, storedSize, SEEK_CUR) != 0)
+		{
+			return false;
+		}
+		fileOffset += storedSize;
+		m_size += static_cast<uint64_t>(count) * GetDecodedUnitSize(type);
+	}
+
+	// The checksum must follow the end marker, which also tells that no record was cut short
+	unsigned char edc[4];
+	return fread(edc, sizeof(edc), 1, fp) == 1;
+}
+
+bool ecm::Reader::DecodeSector(const Record& record, uint32_t index, unsigned char* sector)
+{
+	static constexpr unsigned char ZERO_ADDRESS[4] = { 0, 0, 0, 0 };
+
+	FILE* fp = m_file.get();
+	if (SeekFile(fp, record.fileOffset + static_cast<uint64_t>(index) * GetStoredUnitSize(record.type), SEEK_SET) != 0)
+	{
+		return false;
+	}
+
+	std::copy(std::begin(SYNC_PATTERN), std::end(SYNC_PATTERN), sector);
+	switch (record.type)
+	{
+	case Type::Mode1:
+		if (fread(sector + 0xC, 3, 1, fp) != 1 || fread(sector + 0x10, F1_DATA_SIZE, 1, fp) != 1)
+		{
+			return false;
+		}
+		sector[0xF] = 1;
+		EDC_ECC_GEN.ComputeEdcBlock(sector, 0x810, sector + 0x810);
+		std::fill_n(sector + 0x814, 8, 0);
+		EDC_ECC_GEN.ComputeEccBlock(sector + 0xC, sector + 0x10, 86, 24, 2, 86, sector + 0x81C);
+		EDC_ECC_GEN.ComputeEccBlock(sector + 0xC, sector + 0x10, 52, 43, 86, 88, sector + 0x81C + 172);
+		break;
+
+	case Type::Mode2Form1:
+		if (fread(sector + 0x14, GetStoredUnitSize(record.type), 1, fp) != 1)
+		{
+			return false;
+		}
+		std::copy_n(sector + 0x14, 4, sector + 0x10);
+		EDC_ECC_GEN.ComputeEdcBlock(sector + 0x10, 8 + F1_DATA_SIZE, sector + 0x818);
+		EDC_ECC_GEN.ComputeEccBlock(ZERO_ADDRESS, sector + 0x10, 86, 24, 2, 86, sector + 0x81C);
+		EDC_ECC_GEN.ComputeEccBlock(ZERO_ADDRESS, sector + 0x10, 52, 43, 86, 88, sector + 0x81C + 172);
+		break;
+
+	case Type::Mode2Form2:
+		if (fread(sector + 0x14, GetStoredUnitSize(record.type), 1, fp) != 1)
+		{
+			return false;
+		}
+		std::copy_n(sector + 0x14, 4, sector + 0x10);
+		EDC_ECC_GEN.ComputeEdcBlock(sector + 0x10, 8 + F2_DATA_SIZE, sector + 0x92C);
+		break;
+
+	default:
+		return false;
+	}
+	return true;
+}
+
+size_t ecm::Reader::Read(uint64_t offset, void* data, size_t size)
+{
+	unsigned char* out = static_cast<unsigned char*>(data);
+	size_t bytesRead = 0;
+
+	// Find the last record starting at or before the offset
+	auto record = std::upper_bound(m_records.begin(), m_records.end(), offset,
+		[](uint64_t offset, const Record& record) { return offset < record.offset; });
+	if (record == m_records.begin())
+	{
+		return 0;
+	}
+	--record;
+
+	unsigned char sector[CD_SECTOR_SIZE];
+	while (size > 0 && record != m_records.end())
+	{
+		const uint32_t unitSize = GetDecodedUnitSize(record->type);
+		const uint64_t recordEnd = record->offset + static_cast<uint64_t>(record->count) * unitSize;
+		if (offset >= recordEnd)
+		{
+			++record;
+			continue;
+		}
+
+		const uint64_t pos = offset - record->offset;
+		size_t toRead;
+		if (record->type == Type::Raw)
+		{
+			toRead = static_cast<size_t>(std::min<uint64_t>(recordEnd - offset, size));
+			if (SeekFile(m_file.get(), record->fileOffset + pos, SEEK_SET) != 0 || fread(out, 1, toRead, m_file.get()) != toRead)
+			{
+				break;
+			}
+		}
+		else
+		{
+			if (!DecodeSector(*record, static_cast<uint32_t>(pos / unitSize), sector))
+			{
+				break;
+			}
+
+			// Mode 2 records decode to the sector without its sync and address
+			const unsigned char* decoded = record->type == Type::Mode1 ? sector : sector + 0x10;
+			const size_t start = static_cast<size_t>(pos % unitSize);
+			toRead = std::min<size_t>(unitSize - start, size);
+			std::copy_n(decoded + start, toRead, out);
+		}
+
+		out += toRead;
+		offset += toRead;
+		bytesRead += toRead;
+		size -= toRead;
+	}
+
+	return bytesRead;
+}
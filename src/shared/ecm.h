@@ -0,0 +1,83 @@
+#pragma once
+
+#include "common.h"
+#include <vector>
+
+// ECM images, the format of ecmtools by Neill Corlett, which strips the sync, address, EDC and ECC
+// data of sectors whenever it can be regenerated from their contents.
+//
+// The file starts with "ECM\0", followed by records made of a type and count header and the data
+// of count bytes or sectors:
+//   Raw			count bytes stored as they are
+//   Mode1			address and 2048 bytes of user data of each Mode 1 sector
+//   Mode2Form1		subheader and 2048 bytes of user data, the 16 bytes of sync and address
+//					before each sector are stored in a Raw record
+//   Mode2Form2		subheader and 2324 bytes of user data, likewise
+// The last record has a count of 0xFFFFFFFF and is followed by the EDC of the decoded image.
+namespace ecm
+{
+
+enum class Type : unsigned char
+{
+	Raw = 0,
+	Mode1,
+	Mode2Form1,	// Mode 2 Form 1 with the ECC calculated over a zeroed address
+	Mode2Form2,	// Mode 2 Form 2 with the EDC calculated
+};
+
+// Returns true if the file starts with the ECM signature, the file position is left undefined
+bool IsEcmFile(FILE* file);
+
+// Encodes an image sector by sector
+class Writer
+{
+public:
+	// Writes the signature, returns false if that fails
+	bool Open(FILE* file);
+
+	// Writes a sector of the given type, which is stored raw if it does not fit the type
+	void WriteSector(const unsigned char* sector, Type type);
+
+	// Writes the end marker and the checksum of the image
+	bool Close();
+
+private:
+	void WriteRecordHeader(Type type, uint32_t count);
+	void FlushRaw();
+
+	FILE* m_file = nullptr;
+	std::vector<unsigned char> m_raw; // Pending bytes of a Raw record
+	uint32_t m_edc = 0;
+	bool m_failed = false;
+};
+
+// Random access to the decoded contents of an ECM image
+class Reader
+{
+public:
+	// Takes ownership of the file and indexes its records, returns false if it is not a valid ECM image
+	bool Open(unique_file file);
+
+	// Size of the decoded image in bytes
+	uint64_t GetSize() const { return m_size; }
+
+	// Reads decoded data, returns the number of bytes read
+	size_t Read(uint64_t offset, void* data, size_t size);
+
+private:
+	struct Record
+	{
+		uint64_t offset;		// Offset in the decoded image
+		uint64_t fileOffset;	// Offset of the record data in the file
+		uint32_t count;
+		Type type;
+	};
+
+	bool DecodeSector(const Record& record, uint32_t index, unsigned char* sector);
+
+	unique_file m_file;
+	std::vector<Record> m_records;
+	uint64_t m_size = 0;
+};
+
+}
@@ -0,0 +1,285 @@
+#include "hash.h"
+#include <algorithm>
+#include <vector>
+
+std::optional<uint64_t> hash::HashFile(const fs::path& path)
+{
+	unique_file file = OpenScopedFile(path, "rb");
+	if (file == nullptr)
+	{
+		return std::nullopt;
+	}
+
+	Fnv1a64 hash;
+	std::vector<unsigned char> buffer(64 * 1024);
+	size_t bytesRead;
+	while ((bytesRead = fread(buffer.data(), 1, buffer.size(), file.get())) != 0)
+	{
+		hash.Update(buffer.data(), bytesRead);
+	}
+	if (ferror(file.get()))
+	{
+		return std::nullopt;
+	}
+	return hash.Finish();
+}
+
+// ======================================================
+
+// Tables of slicing by 8, entry [k][n] is the CRC of byte n followed by k zero bytes
+static const std::array<std::array<uint32_t, 256>, 8> CRC32_TABLES = []
+{
+	std::array<std::array<uint32_t, 256>, 8> tables;
+	for (uint32_t n = 0; n < 256; n++)
+	{
+		uint32_t crc = n;
+		for (int bit = 0; bit < 8; bit++)
+		{
+			crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+		}
+		tables[0][n] = crc;
+	}
+	for (uint32_t n = 0; n < 256; n++)
+	{
+		for (size_t k = 1; k < tables.size(); k++)
+		{
+			tables[k][n] = (tables[k - 1][n] >> 8) ^ tables[0][tables[k - 1][n] & 0xFF];
+		}
+	}
+	return tables;
+}();
+
+void hash::Crc32::Update(const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint32_t crc = m_crc;
+	for (; size >= 8; size -= 8, bytes += 8)
+	{
+		const uint32_t low = crc ^ (bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24));
+		crc = CRC32_TABLES[7][low & 0xFF] ^ CRC32_TABLES[6][(low >> 8) & 0xFF] ^ CRC32_TABLES[5][(low >> 16) & 0xFF] ^ CRC32_TABLES[4][low >> 24] ^
+			CRC32_TABLES[3][bytes[4]] ^ CRC32_TABLES[2][bytes[5]] ^ CRC32_TABLES[1][bytes[6]] ^ CRC32_TABLES[0][bytes[7]];
+	}
+	for (; size > 0; size--)
+	{
+		crc = (crc >> 8) ^ CRC32_TABLES[0][(crc ^ *bytes++) & 0xFF];
+	}
+	m_crc = crc;
+}
+
+// ======================================================
+
+static uint32_t RotateLeft(uint32_t value, int bits)
+{
+	return (value << bits) | (value >> (32 - bits));
+}
+
+// Feeds data to a hash of 64-byte blocks, buffering what does not fill a block
+template<typename Compress>
+static void UpdateBlocks(unsigned char (&block)[64], size_t& blockSize, const void* data, size_t size, Compress compress)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	if (blockSize != 0)
+	{
+		const size_t toCopy = std::min(size, sizeof(block) - blockSize);
+		std::copy_n(bytes, toCopy, block + blockSize);
+		blockSize += toCopy;
+		bytes += toCopy;
+		size -= toCopy;
+		if (blockSize < sizeof(block))
+		{
+			return;
+		}
+		compress(block);
+		blockSize = 0;
+	}
+
+	for (; size >= sizeof(block); size -= sizeof(block), bytes += sizeof(block))
+	{
+		compress(bytes);
+	}
+	std::copy_n(bytes, size, block);
+	blockSize = size;
+}
+
+// Appends the padding and the length of the message in bits, in the byte order of the hash
+template<typename Compress>
+static void FinishBlocks(unsigned char (&block)[64], size_t blockSize, uint64_t length, bool bigEndian, Compress compress)
+{
+	block[blockSize++] = 0x80;
+	if (blockSize > sizeof(block) - 8)
+	{
+		std::fill(block + blockSize, std::end(block), 0);
+		compress(block);
+		blockSize = 0;
+	}
+	std::fill(block + blockSize, std::end(block) - 8, 0);
+
+	const uint64_t bits = length * 8;
+	for (int i = 0; i < 8; i++)
+	{
+		block[bigEndian ? 63 - i : 56 + i] = static_cast<unsigned char>(bits >> (i * 8));
+	}
+	compress(block);
+}
+
+void hash::Md5::Compress(const unsigned char* block)
+{
+	static constexpr uint32_t K[64] = {
+		0xD76AA478, 0xE8C7B756, 0x242070DB, 0xC1BDCEEE, 0xF57C0FAF, 0x4787C62A, 0xA8304613, 0xFD469501,
+		0x698098D8, 0x8B44F7AF, 0xFFFF5BB1, 0x895CD7BE, 0x6B901122, 0xFD987193, 0xA679438E, 0x49B40821,
+		0xF61E2562, 0xC040B340, 0x265E5A51, 0xE9B6C7AA, 0xD62F105D, 0x02441453, 0xD8A1E681, 0xE7D3FBC8,
+		0x21E1CDE6, 0xC33707D6, 0xF4D50D87, 0x455A14ED, 0xA9E3E905, 0xFCEFA3F8, 0x676F02D9, 0x8D2A4C8A,
+		0xFFFA3942, 0x8771F681, 0x6D9D6122, 0xFDE5380C, 0xA4BEEA44, 0x4BDECFA9, 0xF6BB4B60, 0xBEBFBC70,
+		0x289B7EC6, 0xEAA127FA, 0xD4EF3085, 0x04881D05, 0xD9D4D039, 0xE6DB99E5, 0x1FA27CF8, 0xC4AC5665,
+		0xF4292244, 0x432AFF97, 0xAB9423A7, 0xFC93A039, 0x655B59C3, 0x8F0CCC92, 0xFFEFF47D, 0x85845DD1,
+		0x6FA87E4F, 0xFE2CE6E0, 0xA3014314, 0x4E0811A1, 0xF7537E82, 0xBD3AF235, 0x2AD7D2BB, 0xEB86D391,
+	};
+	static constexpr int SHIFTS[4][4] = { { 7, 12, 17, 22 }, { 5, 9, 14, 20 }, { 4, 11, 16, 23 }, { 6, 10, 15, 21 } };
+
+	uint32_t words[16];
+	for (int i = 0; i < 16; i++, block += 4)
+	{
+		words[i] = block[0] | (block[1] << 8) | (block[2] << 16) | (static_cast<uint32_t>(block[3]) << 24);
+	}
+
+	uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+	for (int i = 0; i < 64; i++)
+	{
+		uint32_t f;
+		int word;
+		switch (i / 16)
+		{
+		case 0:		f = (b & c) | (~b & d);	word = i;				break;
+		case 1:		f = (d & b) | (~d & c);	word = (5 * i + 1) % 16;	break;
+		case 2:		f = b ^ c ^ d;			word = (3 * i + 5) % 16;	break;
+		default:	f = c ^ (b | ~d);		word = (7 * i) % 16;		break;
+		}
+
+		const uint32_t rotated = RotateLeft(a + f + K[i] + words[word], SHIFTS[i / 16][i % 4]);
+		a = d;
+		d = c;
+		c = b;
+		b += rotated;
+	}
+
+	m_state[0] += a;
+	m_state[1] += b;
+	m_state[2] += c;
+	m_state[3] += d;
+}
+
+void hash::Md5::Update(const void* data, size_t size)
+{
+	m_length += size;
+	UpdateBlocks(m_block, m_blockSize, data, size, [this](const unsigned char* block) { Compress(block); });
+}
+
+std::array<unsigned char, 16> hash::Md5::Finish()
+{
+	FinishBlocks(m_block, m_blockSize, m_length, false, [this](const unsigned char* block) { Compress(block); });
+
+	std::array<unsigned char, 16> digest;
+	for (size_t i = 0; i < digest.size(); i++)
+	{
+		digest[i] = static_cast<unsigned char>(m_state[i / 4] >> ((i % 4) * 8));
+	}
+	return digest;
+}
+
+void hash::Sha1::Compress(const unsigned char* block)
+{
+	uint32_t words[80];
+	for (int i = 0; i < 16; i++, block += 4)
+	{
+		words[i] = (static_cast<uint32_t>(block[0]) << 24) | (block[1] << 16) | (block[2] << 8) | block[3];
+	}
+	for (int i = 16; i < 80; i++)
+	{
+		words[i] = RotateLeft(words[i - 3] ^ words[i - 8] ^ words[i - 14] ^ words[i - 16], 1);
+	}
+
+	uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3], e = m_state[4];
+	for (int i = 0; i < 80; i++)
+	{
+		uint32_t f, k;
+		switch (i / 20)
+		{
+		case 0:		f = (b & c) | (~b & d);				k = 0x5A827999;	break;
+		case 1:		f = b ^ c ^ d;						k = 0x6ED9EBA1;	break;
+		case 2:		f = (b & c) | (b & d) | (c & d);	k = 0x8F1BBCDC;	break;
+		default:	f = b ^ c ^ d;						k = 0xCA62C1D6;	break;
+		}
+
+		const uint32_t temp = RotateLeft(a, 5) + f + e + k + words[i];
+		e = d;
+		d = c;
+		c = RotateLeft(b, 30);
+		b = a;
+		a = temp;
+	}
+
+	m_state[0] += a;
+	m_state[1] += b;
+	m_state[2] += c;
+	m_state[3] += d;
+	m_state[4] += e;
+}
+
+void hash::Sha1::Update(const void* data, size_t size)
+{
+	m_length += size;
+	UpdateBlocks(m_block, m_blockSize, data, size, [this](const unsigned char* block) { Compress(block); });
+}
+
+std::array<unsigned char, 20> hash::Sha1::Finish()
+{
+	FinishBlocks(m_block, m_blockSize, m_length, true, [this](const unsigned char* block) { Compress(block); });
+
+	std::array<unsigned char, 20> digest;
+	for (size_t i = 0; i < digest.size(); i++)
+	{
+		digest[i] = static_cast<unsigned char>(m_state[i / 4] >> (24 - (i % 4) * 8));
+	}
+	return digest;
+}
+
+// ======================================================
+
+void hash::Digester::Update(const void* data, size_t size)
+{
+	m_size += size;
+	m_crc32.Update(data, size);
+	m_md5.Update(data, size);
+	m_sha1.Update(data, size);
+}
+
+hash::Digests hash::Digester::Finish()
+{
+	Digests digests;
+	digests.size = m_size;
+	digests.crc32 = m_crc32.Finish();
+	digests.md5 = m_md5.Finish();
+	digests.sha1 = m_sha1.Finish();
+	return digests;
+}
+
+std::string hash::ToHex(const unsigned char* data, size_t size)
+{
+	static constexpr char DIGITS[] = "0123456789abcdef";
+
+	std::string hex;
+	hex.reserve(size * 2);
+	for (size_t i = 0; i < size; i++)
+	{
+		hex += DIGITS[data[i] >> 4];
+		hex += DIGITS[data[i] & 0xF];
+	}
+	return hex;
+}
+
+std::string hash::ToHex(uint32_t crc32)
+{
+	const unsigned char bytes[4] = { static_cast<unsigned char>(crc32 >> 24), static_cast<unsigned char>(crc32 >> 16),
+		static_cast<unsigned char>(crc32 >> 8), static_cast<unsigned char>(crc32) };
+	return ToHex(bytes, sizeof(bytes));
+}
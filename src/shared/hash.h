@@ -0,0 +1,108 @@
+#pragma once
+
+#include "common.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace hash
+{
+
+// 64-bit FNV-1a, a quick non-cryptographic hash for telling apart file contents
+class Fnv1a64
+{
+public:
+	void Update(const void* data, size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			m_hash = (m_hash ^ bytes[i]) * PRIME;
+		}
+	}
+
+	uint64_t Finish() const { return m_hash; }
+
+private:
+	static constexpr uint64_t OFFSET_BASIS = 0xCBF29CE484222325;
+	static constexpr uint64_t PRIME = 0x100000001B3;
+
+	uint64_t m_hash = OFFSET_BASIS;
+};
+
+// Returns the 64-bit FNV-1a hash of the contents of a file, or nothing if it cannot be read
+std::optional<uint64_t> HashFile(const fs::path& path);
+
+// CRC-32 of zip and redump DAT files (reflected polynomial 0xEDB88320), slicing by 8 bytes at a time
+class Crc32
+{
+public:
+	void Update(const void* data, size_t size);
+	uint32_t Finish() const { return ~m_crc; }
+
+private:
+	uint32_t m_crc = 0xFFFFFFFF;
+};
+
+// MD5 (RFC 1321)
+class Md5
+{
+public:
+	void Update(const void* data, size_t size);
+	std::array<unsigned char, 16> Finish();
+
+private:
+	void Compress(const unsigned char* block);
+
+	uint32_t m_state[4] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
+	unsigned char m_block[64];
+	size_t m_blockSize = 0; // Bytes buffered in m_block
+	uint64_t m_length = 0;
+};
+
+// SHA-1 (FIPS 180-4)
+class Sha1
+{
+public:
+	void Update(const void* data, size_t size);
+	std::array<unsigned char, 20> Finish();
+
+private:
+	void Compress(const unsigned char* block);
+
+	uint32_t m_state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+	unsigned char m_block[64];
+	size_t m_blockSize = 0;
+	uint64_t m_length = 0;
+};
+
+// Size and hashes of a file or track, as listed in redump DAT files
+struct Digests
+{
+	uint64_t size = 0;
+	uint32_t crc32 = 0;
+	std::array<unsigned char, 16> md5 {};
+	std::array<unsigned char, 20> sha1 {};
+};
+
+// Calculates the size, CRC-32, MD5 and SHA-1 of the same data at once
+class Digester
+{
+public:
+	void Update(const void* data, size_t size);
+	Digests Finish();
+
+private:
+	uint64_t m_size = 0;
+	Crc32 m_crc32;
+	Md5 m_md5;
+	Sha1 m_sha1;
+};
+
+// Lowercase hexadecimal digits of a hash, most significant byte first for CRC-32
+std::string ToHex(const unsigned char* data, size_t size);
+std::string ToHex(uint32_t crc32);
+
+}
@@ -0,0 +1,401 @@
+#include "manifest.h"
+#include "platform.h"
+
+static constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+
+bool xml::IsManifestPath(const fs::path& path)
+{
+	return CompareICase(path.extension().string(), manifest::EXTENSION);
+}
+
+void xml::WriteJSONString(FILE* file, const char* str)
+{
+	fputc('"', file);
+	for (; *str != '\0'; str++)
+	{
+		const unsigned char ch = *str;
+		if (ch == '"' || ch == '\\')
+		{
+			fputc('\\', file);
+			fputc(ch, file);
+		}
+		else if (ch < 0x20)
+		{
+			fprintf(file, "\\u%04x", ch);
+		}
+		else
+		{
+			fputc(ch, file);
+		}
+	}
+	fputc('"', file);
+}
+
+static void WriteManifestElement(FILE* file, const tinyxml2::XMLElement* element)
+{
+	const bool hasChildren = element->FirstChildElement() != nullptr;
+
+	fputs(hasChildren ? "{\"start\":" : "{\"element\":", file);
+	xml::WriteJSONString(file, element->Name());
+	for (const tinyxml2::XMLAttribute* attrib = element->FirstAttribute(); attrib != nullptr; attrib = attrib->Next())
+	{
+		fputc(',', file);
+		xml::WriteJSONString(file, attrib->Name());
+		fputc(':', file);
+		xml::WriteJSONString(file, attrib->Value());
+	}
+	fputs("}\n", file);
+
+	if (hasChildren)
+	{
+		for (const tinyxml2::XMLElement* child = element->FirstChildElement(); child != nullptr; child = child->NextSiblingElement())
+		{
+			WriteManifestElement(file, child);
+		}
+
+		fputs("{\"end\":", file);
+		xml::WriteJSONString(file, element->Name());
+		fputs("}\n", file);
+	}
+}
+
+bool xml::WriteManifest(FILE* file, const tinyxml2::XMLDocument& document)
+{
+	fprintf(file, "{\"format\":\"%s\",\"version\":%u}\n", manifest::FORMAT, manifest::FORMAT_VERSION);
+	for (const tinyxml2::XMLElement* element = document.FirstChildElement(); element != nullptr; element = element->NextSiblingElement())
+	{
+		WriteManifestElement(file, element);
+	}
+	return ferror(file) == 0;
+}
+
+static void SkipWhitespace(const char*& pos)
+{
+	while (*pos == ' ' || *pos == '\t')
+	{
+		pos++;
+	}
+}
+
+static bool ParseHex4(const char*& pos, unsigned long& value)
+{
+	value = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		const char ch = *pos++;
+		value <<= 4;
+		if (ch >= '0' && ch <= '9') value |= ch - '0';
+		else if (ch >= 'a' && ch <= 'f') value |= ch - 'a' + 10;
+		else if (ch >= 'A' && ch <= 'F') value |= ch - 'A' + 10;
+		else return false;
+	}
+	return true;
+}
+
+static bool ParseString(const char*& pos, std::string& str)
+{
+	if (*pos != '"')
+	{
+		return false;
+	}
+	pos++;
+
+	for (;;)
+	{
+		char ch = *pos++;
+		if (ch == '\0')
+		{
+			return false;
+		}
+		if (ch == '"')
+		{
+			return true;
+		}
+		if (ch != '\\')
+		{
+			str += ch;
+			continue;
+		}
+
+		ch = *pos++;
+		switch (ch)
+		{
+		case '"':
+		case '\\':
+		case '/':
+			str += ch;
+			break;
+		case 'b': str += '\b'; break;
+		case 'f': str += '\f'; break;
+		case 'n': str += '\n'; break;
+		case 'r': str += '\r'; break;
+		case 't': str += '\t'; break;
+		case 'u':
+		{
+			unsigned long codepoint;
+			if (!ParseHex4(pos, codepoint))
+			{
+				return false;
+			}
+
+			// Combine surrogate pairs
+			if (codepoint >= 0xD800 && codepoint <= 0xDBFF)
+			{
+				unsigned long low;
+				if (pos[0] != '\\' || pos[1] != 'u')
+				{
+					return false;
+				}
+				pos += 2;
+				if (!ParseHex4(pos, low) || low < 0xDC00 || low > 0xDFFF)
+				{
+					return false;
+				}
+				codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+			}
+			xml::AppendUTF8(str, codepoint);
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+}
+
+xml::ManifestReader::ManifestReader()
+	: m_buffer(std::make_unique<char[]>(READ_BUFFER_SIZE))
+{
+}
+
+bool xml::ManifestReader::Open(unique_file file)
+{
+	m_file = std::move(file);
+	if (!Seek(0, 1) || !ReadLine())
+	{
+		SetError("MANIFEST_ERROR_EMPTY_DOCUMENT", 1);
+		return false;
+	}
+
+	// Skip the UTF-8 byte order mark, if present
+	if (m_line.compare(0, 3, "\xEF\xBB\xBF") == 0)
+	{
+		m_line.erase(0, 3);
+	}
+
+	if (!ParseObject() || m_current.Attribute("format", manifest::FORMAT) == nullptr)
+	{
+		SetError("MANIFEST_ERROR_INVALID_HEADER", 1);
+		return false;
+	}
+	if (m_current.UnsignedAttribute("version") != manifest::FORMAT_VERSION)
+	{
+		SetError("MANIFEST_ERROR_UNSUPPORTED_VERSION", 1);
+		return false;
+	}
+	return true;
+}
+
+bool xml::ManifestReader::Seek(uint64_t offset, int line)
+{
+	if (m_file == nullptr || SeekFile(m_file.get(), offset, SEEK_SET) != 0)
+	{
+		return false;
+	}
+
+	m_bufferOffset = offset;
+	m_bufferPos = m_bufferLength = 0;
+	m_lineNum = line - 1;
+	m_pendingEnd = false;
+	m_depth = 0;
+	return true;
+}
+
+bool xml::ManifestReader::ReadLine()
+{
+	m_line.clear();
+	m_lineOffset = m_bufferOffset + m_bufferPos;
+	for (;;)
+	{
+		if (m_bufferPos == m_bufferLength)
+		{
+			m_bufferOffset += m_bufferLength;
+			m_bufferPos = 0;
+			m_bufferLength = fread(m_buffer.get(), 1, READ_BUFFER_SIZE, m_file.get());
+			if (m_bufferLength == 0)
+			{
+				if (m_line.empty())
+				{
+					return false;
+				}
+				break;
+			}
+		}
+
+		const char* start = m_buffer.get() + m_bufferPos;
+		const size_t available = m_bufferLength - m_bufferPos;
+		const char* newline = static_cast<const char*>(memchr(start, '\n', available));
+		if (newline == nullptr)
+		{
+			m_line.append(start, available);
+			m_bufferPos = m_bufferLength;
+			continue;
+		}
+
+		m_line.append(start, newline - start);
+		m_bufferPos += (newline - start) + 1;
+		break;
+	}
+
+	m_lineNum++;
+	if (!m_line.empty() && m_line.back() == '\r')
+	{
+		m_line.pop_back();
+	}
+	return true;
+}
+
+bool xml::ManifestReader::ParseObject()
+{
+	const char* pos = m_line.c_str();
+	m_current.Reset({}, m_lineNum);
+
+	SkipWhitespace(pos);
+	if (*pos != '{')
+	{
+		return false;
+	}
+	pos++;
+
+	SkipWhitespace(pos);
+	if (*pos == '}')
+	{
+		pos++;
+	}
+	else for (;;)
+	{
+		SkipWhitespace(pos);
+		std::string& key = m_scratch;
+		key.clear();
+		if (!ParseString(pos, key))
+		{
+			return false;
+		}
+
+		SkipWhitespace(pos);
+		if (*pos != ':')
+		{
+			return false;
+		}
+		pos++;
+		SkipWhitespace(pos);
+
+		if (*pos == '"')
+		{
+			if (!ParseString(pos, m_current.AddAttribute(key)))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			// Numbers and literals are kept as they are written, null means the attribute is absent
+			const char* start = pos;
+			while (*pos != '\0' && *pos != ',' && *pos != '}' && *pos != ' ' && *pos != '\t')
+			{
+				pos++;
+			}
+
+			const std::string_view token(start, pos - start);
+			if (token.empty() || token[0] == '{' || token[0] == '[')
+			{
+				return false;
+			}
+			if (token != "null")
+			{
+				m_current.AddAttribute(key) = token;
+			}
+		}
+
+		SkipWhitespace(pos);
+		if (*pos == ',')
+		{
+			pos++;
+			continue;
+		}
+		if (*pos != '}')
+		{
+			return false;
+		}
+		pos++;
+		break;
+	}
+
+	SkipWhitespace(pos);
+	return *pos == '\0';
+}
+
+xml::EventReader::Event xml::ManifestReader::Next()
+{
+	if (m_pendingEnd)
+	{
+		m_pendingEnd = false;
+		return Event::EndElement;
+	}
+
+	for (;;)
+	{
+		if (!ReadLine())
+		{
+			if (m_depth != 0)
+			{
+				return SetError("MANIFEST_ERROR_UNCLOSED_ELEMENT", m_lineNum);
+			}
+			return Event::EndOfDocument;
+		}
+
+		if (m_line.find_first_not_of(" \t") == std::string::npos)
+		{
+			continue;
+		}
+
+		m_elementOffset = m_lineOffset;
+		if (!ParseObject() || m_current.GetAttributeCount() == 0 || m_current.GetAttributeValue(0).empty())
+		{
+			return SetError("MANIFEST_ERROR_PARSING", m_lineNum);
+		}
+
+		// The first member tells the kind of record and the element name
+		std::string& kind = m_scratch;
+		kind = m_current.GetAttributeName(0);
+		m_current.SetName(m_current.GetAttributeValue(0));
+		m_current.DeleteAttribute(kind.c_str());
+
+		if (kind == "end")
+		{
+			if (m_depth == 0 || m_openElements[m_depth - 1] != m_current.Name())
+			{
+				return SetError("MANIFEST_ERROR_MISMATCHED_ELEMENT", m_lineNum);
+			}
+			m_depth--;
+			return Event::EndElement;
+		}
+
+		if (kind == "start")
+		{
+			if (m_depth == m_openElements.size())
+			{
+				m_openElements.emplace_back();
+			}
+			m_openElements[m_depth++] = m_current.Name();
+			return Event::StartElement;
+		}
+
+		if (kind == "element")
+		{
+			m_pendingEnd = true;
+			return Event::StartElement;
+		}
+
+		return SetError("MANIFEST_ERROR_UNKNOWN_RECORD", m_lineNum);
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "xml.h"
+#include "xmlstream.h"
+
+// JSON lines project manifests, a machine oriented alternative to XML projects.
+//
+// The first line is a header: {"format":"mkpsxiso-manifest","version":1}
+// Every following line is one JSON object describing an element of the project, with the
+// same names and attributes as in XML projects. The first member gives the element name:
+//   {"start":"dir","name":"DATA"}		opens an element which has children
+//   {"element":"file","name":"A.BIN"}	an element without children
+//   {"end":"dir"}						closes the last opened element
+// Attribute values may be strings, numbers or booleans. Empty lines are ignored.
+namespace xml
+{
+
+namespace manifest
+{
+	constexpr const char* FORMAT = "mkpsxiso-manifest";
+	constexpr unsigned FORMAT_VERSION = 1;
+	constexpr const char* EXTENSION = ".jsonl";
+}
+
+// Returns true if the path has the file extension of project manifests
+bool IsManifestPath(const fs::path& path);
+
+// Writes a string as a quoted JSON string, escaping it as needed
+void WriteJSONString(FILE* file, const char* str);
+
+// Writes an XML project document as a manifest
+bool WriteManifest(FILE* file, const tinyxml2::XMLDocument& document);
+
+class ManifestReader final : public EventReader
+{
+public:
+	ManifestReader();
+
+	// Takes ownership of the file and validates the header
+	bool Open(unique_file file);
+
+	Event Next() override;
+	bool Seek(uint64_t offset, int line) override;
+
+private:
+	bool ReadLine();
+	bool ParseObject();
+
+	unique_file m_file;
+	std::unique_ptr<char[]> m_buffer;
+	size_t m_bufferPos = 0;
+	size_t m_bufferLength = 0;
+	uint64_t m_bufferOffset = 0;
+
+	std::string m_line;
+	uint64_t m_lineOffset = 0;
+	int m_lineNum = 0;
+
+	bool m_pendingEnd = false;
+	std::vector<std::string> m_openElements;
+	size_t m_depth = 0;
+	std::string m_scratch;
+};
+
+}
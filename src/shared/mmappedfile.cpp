@@ -1,5 +1,7 @@
 #include "mmappedfile.h"
 
+#include <utility>
+
 #ifdef _WIN32
 #ifndef NOMINMAX
 #define NOMINMAX
@@ -22,6 +24,10 @@ MMappedFile::~MMappedFile()
 	{
 		CloseHandle(reinterpret_cast<HANDLE>(m_handle));
 	}
+	if (m_file != nullptr)
+	{
+		CloseHandle(reinterpret_cast<HANDLE>(m_file));
+	}
 #else
 	if (m_handle != nullptr)
 	{
@@ -45,10 +51,13 @@ bool MMappedFile::Create(const fs::path& filePath, uint64_t size)
 		if (fileMapping != nullptr)
 		{
 			m_handle = fileMapping;
+			m_file = file;
 			result = true;
 		}
-
-		CloseHandle(file);
+		else
+		{
+			CloseHandle(file);
+		}
 	}
 #else
 	int file = open(filePath.c_str(), O_RDWR|O_CREAT, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH);
@@ -68,12 +77,94 @@ bool MMappedFile::Create(const fs::path& filePath, uint64_t size)
 	return result;
 }
 
+bool MMappedFile::Open(const fs::path& filePath)
+{
+	bool result = false;
+	m_writable = false;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		HANDLE fileMapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (fileMapping != nullptr)
+		{
+			m_handle = fileMapping;
+			m_file = file;
+			result = true;
+		}
+		else
+		{
+			CloseHandle(file);
+		}
+	}
+#else
+	int file = open(filePath.c_str(), O_RDONLY);
+	if (file != -1)
+	{
+		m_handle = reinterpret_cast<void*>(file);
+		result = true;
+	}
+#endif
+	return result;
+}
+
+bool MMappedFile::OpenForWriting(const fs::path& filePath)
+{
+	bool result = false;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileW(filePath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		HANDLE fileMapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+		if (fileMapping != nullptr)
+		{
+			m_handle = fileMapping;
+			m_file = file;
+			result = true;
+		}
+		else
+		{
+			CloseHandle(file);
+		}
+	}
+#else
+	int file = open(filePath.c_str(), O_RDWR);
+	if (file != -1)
+	{
+		m_handle = reinterpret_cast<void*>(file);
+		result = true;
+	}
+#endif
+	return result;
+}
+
 MMappedFile::View MMappedFile::GetView(uint64_t offset, size_t size) const
 {
-	return View(m_handle, offset, size);
+	return View(m_handle, offset, size, m_writable);
+}
+
+void MMappedFile::StartWriteback(uint64_t offset, uint64_t size) const
+{
+#ifdef __linux__
+	if (m_handle != nullptr)
+	{
+		sync_file_range(static_cast<int>(reinterpret_cast<intptr_t>(m_handle)), offset, size, SYNC_FILE_RANGE_WRITE);
+	}
+#endif
+}
+
+bool MMappedFile::Flush() const
+{
+#ifdef _WIN32
+	return m_file != nullptr && FlushFileBuffers(reinterpret_cast<HANDLE>(m_file));
+#else
+	return m_handle != nullptr && fsync(static_cast<int>(reinterpret_cast<intptr_t>(m_handle))) == 0;
+#endif
 }
 
-MMappedFile::View::View(void* handle, uint64_t offset, size_t size)
+MMappedFile::View::View(void* handle, uint64_t offset, size_t size, bool writable)
 {
 #ifdef _WIN32
 	SYSTEM_INFO SysInfo;
@@ -90,10 +181,10 @@ MMappedFile::View::View(void* handle, uint64_t offset, size_t size)
 #ifdef _WIN32
 	ULARGE_INTEGER ulOffset;
 	ulOffset.QuadPart = mapStartOffset;
-	void* mapping = MapViewOfFile(reinterpret_cast<HANDLE>(handle), FILE_MAP_ALL_ACCESS, ulOffset.HighPart, ulOffset.LowPart, size);
+	void* mapping = MapViewOfFile(reinterpret_cast<HANDLE>(handle), writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, ulOffset.HighPart, ulOffset.LowPart, size);
 	if (mapping != nullptr)
 #else
-	void* mapping = mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_SHARED, static_cast<int>(reinterpret_cast<intptr_t>(handle)), mapStartOffset);
+	void* mapping = mmap(nullptr, size, writable ? PROT_READ|PROT_WRITE : PROT_READ, MAP_SHARED, static_cast<int>(reinterpret_cast<intptr_t>(handle)), mapStartOffset);
 	if (mapping != MAP_FAILED)
 #endif
 	{
@@ -103,6 +194,36 @@ MMappedFile::View::View(void* handle, uint64_t offset, size_t size)
 	}
 }
 
+MMappedFile::View::View(View&& other) noexcept
+	: m_mapping(std::exchange(other.m_mapping, nullptr))
+	, m_data(std::exchange(other.m_data, nullptr))
+	, m_size(std::exchange(other.m_size, 0))
+{
+}
+
+MMappedFile::View& MMappedFile::View::operator=(View&& other) noexcept
+{
+	std::swap(m_mapping, other.m_mapping);
+	std::swap(m_data, other.m_data);
+	std::swap(m_size, other.m_size);
+	return *this;
+}
+
+void MMappedFile::View::Evict()
+{
+	if (m_mapping == nullptr)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	FlushViewOfFile(m_mapping, m_size);
+#else
+	msync(m_mapping, m_size, MS_ASYNC);
+	madvise(m_mapping, m_size, MADV_DONTNEED);
+#endif
+}
+
 MMappedFile::View::~View()
 {
 #ifdef _WIN32
@@ -10,11 +10,19 @@ public:
 	class View
 	{
 	public:
-		View(void* handle, uint64_t offset, size_t size);
+		View(void* handle, uint64_t offset, size_t size, bool writable = true);
+		View(View&& other) noexcept;
+		View& operator=(View&& other) noexcept;
+		View(const View&) = delete;
+		View& operator=(const View&) = delete;
 		~View();
 
 		void* GetBuffer() const { return m_data; }
 
+		// Starts writing back the modified pages of the view and drops them from the working set,
+		// for views which are done with and about to be unmapped
+		void Evict();
+
 	private:
 		void* m_mapping = nullptr; // Aligned down to allocation granularity
 		void* m_data = nullptr;
@@ -25,8 +33,25 @@ public:
 	~MMappedFile();
 
 	bool Create(const fs::path& filePath, uint64_t size);
+
+	// Opens an existing file for reading, its views must not be written to
+	bool Open(const fs::path& filePath);
+
+	// Opens an existing file for writing in place, keeping its size and contents
+	bool OpenForWriting(const fs::path& filePath);
+
 	View GetView(uint64_t offset, size_t size) const;
 
+	// Starts writing a range of the file back to disk without waiting for it, only supported on Linux
+	void StartWriteback(uint64_t offset, uint64_t size) const;
+
+	// Writes all modified data of the file to disk and waits for it, views should be unmapped first
+	bool Flush() const;
+
 private:
 	void* m_handle = nullptr; // Opaque, platform-specific
+	bool m_writable = true;
+#ifdef _WIN32
+	void* m_file = nullptr; // Kept open for flushing
+#endif
 };
\ No newline at end of file
@@ -5,9 +5,20 @@
 #define NOMINMAX
 #endif
 #include <windows.h>
+#include <psapi.h>
+#include <fcntl.h>
+#include <io.h>
 #include <vector>
 #else
 #include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <algorithm>
+#include <cerrno>
+#include <sys/sendfile.h>
 #endif
 
 #ifdef _WIN32
@@ -173,6 +184,134 @@ void UpdateTimestamps(const fs::path& path, const cd::ISO_DATESTAMP& entryDate)
 #endif
 }
 
+int SeekFile(FILE* file, int64_t offset, int origin)
+{
+#ifdef _WIN32
+	return _fseeki64(file, offset, origin);
+#else
+	return fseeko(file, static_cast<off_t>(offset), origin);
+#endif
+}
+
+bool SyncFile(FILE* file)
+{
+	if (fflush(file) != 0)
+	{
+		return false;
+	}
+#ifdef _WIN32
+	return _commit(_fileno(file)) == 0;
+#else
+	return fsync(fileno(file)) == 0;
+#endif
+}
+
+int64_t CopyFileRange(FILE* input, uint64_t offset, FILE* output, uint64_t size)
+{
+#ifdef __linux__
+	if (fflush(output) != 0)
+	{
+		return 0;
+	}
+
+	const int inFd = fileno(input);
+	const int outFd = fileno(output);
+	off_t inOffset = static_cast<off_t>(offset);
+	off_t outOffset = lseek(outFd, 0, SEEK_CUR);
+	if (outOffset < 0)
+	{
+		return 0;
+	}
+
+	// copy_file_range cannot copy between filesystems on older kernels, sendfile can
+	uint64_t copied = 0;
+	bool useSendfile = false;
+	while (copied < size)
+	{
+		const size_t chunk = static_cast<size_t>(std::min<uint64_t>(size - copied, 1u << 30));
+		ssize_t result;
+		if (!useSendfile)
+		{
+			result = copy_file_range(inFd, &inOffset, outFd, &outOffset, chunk, 0);
+			if (result < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP))
+			{
+				useSendfile = true;
+				continue;
+			}
+		}
+		else
+		{
+			// sendfile writes at the file position of the output
+			result = lseek(outFd, outOffset, SEEK_SET) >= 0 ? sendfile(outFd, inFd, &inOffset, chunk) : -1;
+			if (result > 0)
+			{
+				outOffset += result;
+			}
+		}
+
+		if (result <= 0)
+		{
+			break;
+		}
+		copied += result;
+	}
+
+	// Put the stream after the copied data, for anything written to it next
+	if (SeekFile(output, outOffset, SEEK_SET) != 0)
+	{
+		return -1;
+	}
+	return static_cast<int64_t>(copied);
+#else
+	return 0;
+#endif
+}
+
+FILE* DetachStandardOutput()
+{
+	fflush(stdout);
+#ifdef _WIN32
+	const int fd = _dup(_fileno(stdout));
+	if (fd < 0 || _dup2(_fileno(stderr), _fileno(stdout)) != 0)
+	{
+		return nullptr;
+	}
+	_setmode(fd, _O_BINARY);
+	return _fdopen(fd, "wb");
+#else
+	const int fd = dup(STDOUT_FILENO);
+	if (fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+	{
+		return nullptr;
+	}
+	return fdopen(fd, "wb");
+#endif
+}
+
+// Returns the peak resident memory of this process in bytes, or 0 if unknown
+uint64_t GetPeakMemoryUsage()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters {};
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return counters.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	struct rusage usage {};
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+	{
+		return 0;
+	}
+#ifdef __APPLE__
+	return static_cast<uint64_t>(usage.ru_maxrss); // Already in bytes
+#else
+	return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
 extern int Main(int argc, char* argv[]);
 
 #ifdef _WIN32
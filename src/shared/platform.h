@@ -22,5 +22,21 @@ FILE* OpenFile(const fs::path& path, const char* mode);
 std::optional<struct stat64> Stat(const fs::path& path);
 int64_t GetSize(const fs::path& path);
 void UpdateTimestamps(const fs::path& path, const cd::ISO_DATESTAMP& entryDate);
+int SeekFile(FILE* file, int64_t offset, int origin);
+
+// Flushes a stream and waits for its data to reach the disk
+bool SyncFile(FILE* file);
+
+// Copies size bytes at offset of one file to the current position of another inside the kernel, using
+// copy_file_range (which shares the blocks on filesystems with reflinks, such as Btrfs and XFS) or
+// sendfile. The position of the input is left alone. Returns the number of bytes copied, which is 0
+// where neither is available, so callers copy the rest themselves. Returns -1 if data was copied but
+// the output could not be put after it, which leaves the output unusable.
+int64_t CopyFileRange(FILE* input, uint64_t offset, FILE* output, uint64_t size);
+
+// Returns a binary stream on the original stdout and sends stdout to stderr from now on,
+// so console messages do not end up in data piped to another program
+FILE* DetachStandardOutput();
+uint64_t GetPeakMemoryUsage();
 time_t CustomMkTime(struct tm* timeBuf);
 struct tm CustomLocalTime(const time_t* timeSec);
@@ -0,0 +1,124 @@
+#include "profiler.h"
+#include "platform.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct Event
+{
+	const char* name;
+	int64_t start;			// Microseconds since profiling was enabled
+	int64_t duration;
+	std::string details;
+};
+
+// Events of a single thread, only ever appended to by that thread
+struct ThreadBuffer
+{
+	unsigned int id;
+	std::vector<Event> events;
+};
+
+std::atomic<bool> profiler::detail::enabled { false };
+
+static std::chrono::steady_clock::time_point startTime;
+
+// Buffers outlive their threads, so the events of finished thread pools can still be written out
+static std::mutex buffersMutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+static thread_local ThreadBuffer* threadBuffer = nullptr;
+
+static ThreadBuffer* GetThreadBuffer()
+{
+	if (threadBuffer == nullptr)
+	{
+		// Taken once per thread
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		buffers.push_back(std::make_unique<ThreadBuffer>());
+		threadBuffer = buffers.back().get();
+		threadBuffer->id = static_cast<unsigned int>(buffers.size());
+	}
+	return threadBuffer;
+}
+
+void profiler::Enable()
+{
+	// The thread enabling profiling gets the first buffer, to be named the main thread
+	GetThreadBuffer();
+
+	startTime = std::chrono::steady_clock::now();
+	detail::enabled = true;
+}
+
+int64_t profiler::detail::GetTime()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void profiler::detail::Record(const char* name, int64_t start, int64_t end, std::string&& details)
+{
+	GetThreadBuffer()->events.push_back({ name, start, end - start, std::move(details) });
+}
+
+static void WriteEscapedString(FILE* file, std::string_view str)
+{
+	fputc('"', file);
+	for (const char ch : str)
+	{
+		if (ch == '"' || ch == '\\')
+		{
+			fputc('\\', file);
+			fputc(ch, file);
+		}
+		else if (static_cast<unsigned char>(ch) < 0x20)
+		{
+			fprintf(file, "\\u%04x", ch);
+		}
+		else
+		{
+			fputc(ch, file);
+		}
+	}
+	fputc('"', file);
+}
+
+bool profiler::WriteTrace(const fs::path& path)
+{
+	unique_file file = OpenScopedFile(path, "w");
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	FILE* fp = file.get();
+	std::lock_guard<std::mutex> lock(buffersMutex);
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	for (const auto& buffer : buffers)
+	{
+		// Name the threads so they can be told apart in the viewer
+		fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+			first ? "" : ",\n", buffer->id, buffer->id == 1 ? "main" : "thread", buffer->id);
+		first = false;
+
+		for (const Event& event : buffer->events)
+		{
+			fprintf(fp, ",\n{\"name\":");
+			WriteEscapedString(fp, event.name);
+			fprintf(fp, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%lld", buffer->id,
+				static_cast<long long>(event.start), static_cast<long long>(event.duration));
+			if (!event.details.empty())
+			{
+				fprintf(fp, ",\"args\":{\"details\":");
+				WriteEscapedString(fp, event.details);
+				fputc('}', fp);
+			}
+			fputc('}', fp);
+		}
+	}
+	fprintf(fp, "\n]}\n");
+
+	return fflush(fp) == 0 && !ferror(fp);
+}
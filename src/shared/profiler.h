@@ -0,0 +1,64 @@
+#pragma once
+
+#include "common.h"
+#include <atomic>
+#include <string>
+#include <string_view>
+
+// Recording of timed events for profiling builds, written in the Chrome trace event format which
+// chrome://tracing and Perfetto open. Every thread records into a buffer of its own without locking,
+// recording costs a single check while it is not enabled.
+namespace profiler
+{
+
+namespace detail
+{
+	extern std::atomic<bool> enabled;
+	int64_t GetTime();
+	void Record(const char* name, int64_t start, int64_t end, std::string&& details);
+}
+
+// Starts recording, events are kept until the process exits
+void Enable();
+
+inline bool IsEnabled()
+{
+	return detail::enabled.load(std::memory_order_relaxed);
+}
+
+// Writes all recorded events as a JSON trace, no events may be recorded while this runs
+bool WriteTrace(const fs::path& path);
+
+// Records the time from its construction to its destruction as an event of the calling thread
+class Scope
+{
+public:
+	// The name must be a string literal, details (such as a file name) are only copied while recording
+	explicit Scope(const char* name, std::string_view details = {})
+	{
+		if (IsEnabled())
+		{
+			m_name = name;
+			m_details = details;
+			m_start = detail::GetTime();
+		}
+	}
+
+	~Scope()
+	{
+		if (m_name != nullptr)
+		{
+			detail::Record(m_name, m_start, detail::GetTime(), std::move(m_details));
+		}
+	}
+
+	Scope(const Scope&) = delete;
+	Scope& operator=(const Scope&) = delete;
+
+private:
+	const char* m_name = nullptr;
+	std::string m_details;
+	int64_t m_start = 0;
+};
+
+}
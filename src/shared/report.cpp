@@ -0,0 +1,46 @@
+#include "report.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+
+static std::mutex handlerMutex;
+static const report::Handler* currentHandler = nullptr;
+
+void report::Error(const char* prefix, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	std::lock_guard lock(handlerMutex);
+	if (currentHandler == nullptr)
+	{
+		printf("%sERROR: ", prefix);
+		vprintf(format, args);
+		printf("\n");
+		va_end(args);
+		return;
+	}
+
+	va_list sizeArgs;
+	va_copy(sizeArgs, args);
+	std::string message(static_cast<size_t>(std::max(vsnprintf(nullptr, 0, format, sizeArgs), 0)), '\0');
+	va_end(sizeArgs);
+	vsnprintf(message.data(), message.size() + 1, format, args);
+	va_end(args);
+
+	(*currentHandler)(message);
+}
+
+report::ScopedHandler::ScopedHandler(Handler handler)
+	: m_handler(std::move(handler))
+{
+	std::lock_guard lock(handlerMutex);
+	m_previous = currentHandler;
+	currentHandler = &m_handler;
+}
+
+report::ScopedHandler::~ScopedHandler()
+{
+	std::lock_guard lock(handlerMutex);
+	currentHandler = m_previous;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+// Errors of the image builder and reader. They are printed to stdout as "ERROR:" lines like the
+// rest of the output of the tools, unless a handler is installed, which is how library calls
+// return them to their caller instead. The handler is process-wide so errors reported from worker
+// threads reach it as well, and it is called with a lock held, one error at a time.
+namespace report
+{
+
+using Handler = std::function<void(const std::string& message)>;
+
+// Reports an error with a printf style message without a trailing newline. The prefix only goes
+// in front of the printed line, to line it up with the progress output around it.
+void Error(const char* prefix, const char* format, ...);
+
+// Receives the errors reported on any thread for as long as it exists. The handler must not
+// report errors itself.
+class ScopedHandler
+{
+public:
+	explicit ScopedHandler(Handler handler);
+	~ScopedHandler();
+
+	ScopedHandler(const ScopedHandler&) = delete;
+	ScopedHandler& operator=(const ScopedHandler&) = delete;
+
+private:
+	Handler m_handler;
+	const Handler* m_previous;
+};
+
+}
@@ -0,0 +1,325 @@
+#include "seeksim.h"
+#include "platform.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <unordered_map>
+
+std::string seeksim::NormalizeDiscPath(std::string_view path)
+{
+	std::string result;
+	result.reserve(path.length());
+	for (const char ch : path)
+	{
+		if (ch == '\\' || ch == '/')
+		{
+			if (!result.empty() && result.back() != '/')
+			{
+				result += '/';
+			}
+			continue;
+		}
+		result += static_cast<char>(std::toupper(static_cast<unsigned char>(ch)));
+	}
+
+	if (const size_t version = result.find_last_of(';'); version != std::string::npos)
+	{
+		result.erase(version);
+	}
+	return result;
+}
+
+// Parses an unsigned number at the start of str, returns false if there is none
+static bool ParseNumber(const char*& str, uint32_t& value)
+{
+	const bool isHex = str[0] == '0' && (str[1] == 'x' || str[1] == 'X');
+	char* end = nullptr;
+	const unsigned long result = strtoul(str, &end, isHex ? 16 : 10);
+	if (end == str || (*end != '\0' && !std::isspace(static_cast<unsigned char>(*end))))
+	{
+		return false;
+	}
+
+	value = static_cast<uint32_t>(result);
+	str = end;
+	return true;
+}
+
+std::optional<std::vector<seeksim::TraceRead>> seeksim::LoadTrace(const fs::path& path)
+{
+	unique_file file = OpenScopedFile(path, "r");
+	if (file == nullptr)
+	{
+		return std::nullopt;
+	}
+
+	std::vector<TraceRead> reads;
+	char buffer[1024];
+	int lineNum = 0;
+	while (fgets(buffer, sizeof(buffer), file.get()) != nullptr)
+	{
+		lineNum++;
+
+		std::string_view line(buffer);
+		const size_t start = line.find_first_not_of(" \t");
+		const size_t end = line.find_last_not_of(" \t\r\n");
+		if (start == std::string_view::npos || line[start] == '#')
+		{
+			continue;
+		}
+		line = line.substr(start, end - start + 1);
+
+		TraceRead read;
+		read.line = lineNum;
+
+		// Sector reads start with a number, anything else is a file path
+		const char* pos = buffer + start;
+		if (std::isdigit(static_cast<unsigned char>(*pos)) && ParseNumber(pos, read.lba))
+		{
+			read.sectors = 1;
+			while (std::isspace(static_cast<unsigned char>(*pos)))
+			{
+				pos++;
+			}
+			if (*pos != '\0' && !ParseNumber(pos, read.sectors))
+			{
+				read.lba = read.sectors = 0;
+			}
+		}
+
+		if (read.sectors == 0)
+		{
+			read.path = NormalizeDiscPath(line);
+		}
+		reads.emplace_back(std::move(read));
+	}
+
+	return reads;
+}
+
+uint64_t seeksim::GetSeekDistance(const std::vector<Extent>& reads)
+{
+	uint64_t distance = 0;
+	for (size_t i = 1; i < reads.size(); i++)
+	{
+		const int64_t head = static_cast<int64_t>(reads[i - 1].lba) + reads[i - 1].sectors;
+		const int64_t target = reads[i].lba;
+		distance += static_cast<uint64_t>(target >= head ? target - head : head - target);
+	}
+	return distance;
+}
+
+// Sectors on a full 80 minute disc
+static constexpr double FULL_DISC_SECTORS = 80 * 60 * 75;
+
+double seeksim::DriveModel::GetSeekTime(uint32_t distance) const
+{
+	if (distance == 0)
+	{
+		return 0.0;
+	}
+	const double stroke = std::min(1.0, distance / FULL_DISC_SECTORS);
+	return minSeekTime + (maxSeekTime - minSeekTime) * std::sqrt(stroke);
+}
+
+double seeksim::DriveModel::GetReadTime(uint32_t sectors) const
+{
+	return sectors * 1000.0 / (75.0 * speed);
+}
+
+bool seeksim::ParseDriveModel(std::string_view spec, DriveModel& model)
+{
+	while (!spec.empty())
+	{
+		const size_t comma = spec.find(',');
+		const std::string_view setting = spec.substr(0, comma);
+		spec = comma != std::string_view::npos ? spec.substr(comma + 1) : std::string_view{};
+
+		const size_t equals = setting.find('=');
+		if (equals == std::string_view::npos)
+		{
+			return false;
+		}
+
+		const std::string_view key = setting.substr(0, equals);
+		const std::string value(setting.substr(equals + 1));
+		char* end = nullptr;
+		const double number = strtod(value.c_str(), &end);
+		if (value.empty() || *end != '\0' || number < 0.0)
+		{
+			return false;
+		}
+
+		if (CompareICase(key, "speed") && number >= 1.0)
+		{
+			model.speed = static_cast<unsigned int>(number);
+		}
+		else if (CompareICase(key, "seekmin"))
+		{
+			model.minSeekTime = number;
+		}
+		else if (CompareICase(key, "seekmax"))
+		{
+			model.maxSeekTime = number;
+		}
+		else if (CompareICase(key, "latency"))
+		{
+			model.rotationalLatency = number;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void seeksim::PrintTraceSimulation(const std::vector<TraceRead>& trace, const std::vector<DiscFile>& files, const DriveModel& model, size_t worstCount)
+{
+	std::unordered_map<std::string_view, size_t> fileIndices;
+	std::vector<size_t> filesByLBA;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		fileIndices.emplace(files[i].path, i);
+		filesByLBA.push_back(i);
+	}
+	std::sort(filesByLBA.begin(), filesByLBA.end(), [&files](size_t left, size_t right)
+		{
+			return files[left].lba < files[right].lba;
+		});
+
+	struct FileStats
+	{
+		unsigned int reads = 0;
+		unsigned int seeks = 0;
+		double seekTime = 0.0;		// Including rotational latency
+		double readTime = 0.0;
+		double totalTime = 0.0;
+	};
+
+	// The last slot collects sector reads outside of any file
+	std::vector<FileStats> stats(files.size() + 1);
+	size_t unresolved = 0, seeks = 0;
+	uint64_t seekDistance = 0;
+	double seekTime = 0.0, latencyTime = 0.0, readTime = 0.0;
+	std::optional<uint32_t> head;
+
+	for (const TraceRead& read : trace)
+	{
+		Extent extent;
+		size_t file = files.size();
+		if (!read.path.empty())
+		{
+			auto it = fileIndices.find(read.path);
+			if (it == fileIndices.end())
+			{
+				unresolved++;
+				continue;
+			}
+			file = it->second;
+			extent = { files[file].lba, files[file].sectors };
+		}
+		else
+		{
+			extent = { read.lba, read.sectors };
+			auto it = std::upper_bound(filesByLBA.begin(), filesByLBA.end(), read.lba, [&files](uint32_t lba, size_t index)
+				{
+					return lba < files[index].lba;
+				});
+			if (it != filesByLBA.begin() && read.lba < files[*std::prev(it)].lba + files[*std::prev(it)].sectors)
+			{
+				file = *std::prev(it);
+			}
+		}
+
+		FileStats& fileStats = stats[file];
+		fileStats.reads++;
+
+		double time = model.GetReadTime(extent.sectors);
+		readTime += time;
+		fileStats.readTime += time;
+		if (head && *head != extent.lba)
+		{
+			const uint32_t distance = *head > extent.lba ? *head - extent.lba : extent.lba - *head;
+			const double seek = model.GetSeekTime(distance) + model.rotationalLatency;
+			seekTime += model.GetSeekTime(distance);
+			latencyTime += model.rotationalLatency;
+			seekDistance += distance;
+			seeks++;
+
+			fileStats.seeks++;
+			fileStats.seekTime += seek;
+			time += seek;
+		}
+		fileStats.totalTime += time;
+		head = extent.lba + extent.sectors;
+	}
+
+	printf("Trace simulation (%ux drive, %.0f-%.0f ms seeks, %.0f ms rotational latency):\n",
+		model.speed, model.minSeekTime, model.maxSeekTime, model.rotationalLatency);
+	printf("  Reads: %zu", trace.size() - unresolved);
+	if (unresolved != 0)
+	{
+		printf(" (%zu reads of unknown files skipped)", unresolved);
+	}
+	printf("\n  Seeks: %zu (%llu sectors total)\n", seeks, static_cast<unsigned long long>(seekDistance));
+	printf("  Total load time: %.3f seconds (seeking %.3f, rotational latency %.3f, reading %.3f)\n\n",
+		(seekTime + latencyTime + readTime) / 1000.0, seekTime / 1000.0, latencyTime / 1000.0, readTime / 1000.0);
+
+	auto getName = [&files](size_t index)
+		{
+			return index < files.size() ? files[index].path.c_str() : "<outside of files>";
+		};
+
+	// Every file read, in the order they are laid out on the disc
+	std::vector<size_t> read;
+	for (size_t index : filesByLBA)
+	{
+		if (stats[index].reads != 0)
+		{
+			read.push_back(index);
+		}
+	}
+	if (stats.back().reads != 0)
+	{
+		read.push_back(files.size());
+	}
+
+	printf("  Files read: %zu of %zu\n\n", read.size() - (stats.back().reads != 0), files.size());
+	printf("     Total (ms) |  Seek (ms) |  Read (ms) | Seeks | Reads |    LBA | File\n\n");
+	for (size_t index : read)
+	{
+		const FileStats& fileStats = stats[index];
+		if (index < files.size())
+		{
+			printf("    %11.1f | %10.1f | %10.1f | %5u | %5u | %6u | %s\n", fileStats.totalTime, fileStats.seekTime, fileStats.readTime,
+				fileStats.seeks, fileStats.reads, files[index].lba, getName(index));
+		}
+		else
+		{
+			printf("    %11.1f | %10.1f | %10.1f | %5u | %5u | %6s | %s\n", fileStats.totalTime, fileStats.seekTime, fileStats.readTime,
+				fileStats.seeks, fileStats.reads, "", getName(index));
+		}
+	}
+	printf("\n");
+
+	std::vector<size_t> worst = read;
+	std::stable_sort(worst.begin(), worst.end(), [&stats](size_t left, size_t right)
+		{
+			return stats[left].seekTime > stats[right].seekTime;
+		});
+	if (worst.size() > worstCount)
+	{
+		worst.resize(worstCount);
+	}
+
+	printf("  Files with the most seek time:\n\n");
+	printf("     Total (ms) |  Seek (ms) | Seeks | Reads | File\n\n");
+	for (size_t index : worst)
+	{
+		const FileStats& fileStats = stats[index];
+		printf("    %11.1f | %10.1f | %5u | %5u | %s\n", fileStats.totalTime, fileStats.seekTime, fileStats.seeks, fileStats.reads, getName(index));
+	}
+	printf("\n");
+}
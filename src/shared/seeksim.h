@@ -0,0 +1,88 @@
+#pragma once
+
+#include "common.h"
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Disc access traces and seek simulation, used to plan and evaluate disc layouts
+namespace seeksim
+{
+
+// A read from an access trace, either of a whole file or of a range of sectors
+struct TraceRead
+{
+	std::string path;		// Normalized path of the file on the disc, empty for sector reads
+	uint32_t lba = 0;
+	uint32_t sectors = 0;
+	int line = 0;
+};
+
+// A range of sectors read from the disc
+struct Extent
+{
+	uint32_t lba;
+	uint32_t sectors;
+};
+
+// A file on the disc, for resolving trace reads
+struct DiscFile
+{
+	std::string path;		// Normalized with NormalizeDiscPath()
+	uint32_t lba;
+	uint32_t sectors;
+};
+
+// Timing model of a CD drive, times are in milliseconds
+struct DriveModel
+{
+	unsigned int speed = 2;				// Read speed multiplier, at 1x 75 sectors are read per second
+	double minSeekTime = 25.0;			// Seek to a nearby sector
+	double maxSeekTime = 300.0;			// Seek across a full 80 minute disc, the curve in between is a square root
+	double rotationalLatency = 40.0;	// Average wait for the target sector to come around after a seek
+
+	double GetSeekTime(uint32_t distance) const;
+	double GetReadTime(uint32_t sectors) const;
+};
+
+/** Loads an access trace. Every line is either the path of a file on the disc, or a sector read
+ *	exported from an emulator log given as an LBA optionally followed by a sector count. Numbers
+ *	may be decimal or hexadecimal with a 0x prefix. Empty lines and lines starting with # are ignored.
+ *
+ *	path	- Path of the trace file.
+ *
+ *	Returns: The reads in trace order, or nothing if the file cannot be read.
+ */
+std::optional<std::vector<TraceRead>> LoadTrace(const fs::path& path);
+
+/** Normalizes a path of a file on the disc so it can be compared against trace paths. Separators
+ *	become forward slashes, and leading slashes, the ;1 version suffix and the case are dropped.
+ */
+std::string NormalizeDiscPath(std::string_view path);
+
+/** Returns the total distance the head travels over a sequence of reads, in sectors. The head is
+ *	assumed to be right after the end of the previous read when the next one starts.
+ */
+uint64_t GetSeekDistance(const std::vector<Extent>& reads);
+
+/** Parses a drive model from a comma separated list of settings, any of speed=<n>, seekmin=<ms>,
+ *	seekmax=<ms> and latency=<ms>. Settings which are not given keep their current values.
+ *
+ *	Returns: False if the list is malformed.
+ */
+bool ParseDriveModel(std::string_view spec, DriveModel& model);
+
+/** Replays an access trace against a drive model and prints a report of the simulated load times:
+ *	the totals, the load, seek and read time of every file read, and a summary of the files that
+ *	spend the most time seeking.
+ *
+ *	trace		- Access trace. File reads cover the whole file, sector reads are attributed to
+ *				the file they start in.
+ *	files		- All files on the disc.
+ *	model		- Drive timing model.
+ *	worstCount	- Number of files to list in the summary.
+ */
+void PrintTraceSimulation(const std::vector<TraceRead>& trace, const std::vector<DiscFile>& files, const DriveModel& model, size_t worstCount = 10);
+
+}
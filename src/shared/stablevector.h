@@ -0,0 +1,147 @@
+#pragma once
+
+// A vector-like container which allocates its elements in fixed size chunks.
+// Growing it never moves existing elements, so references to them stay valid
+// like with std::list, but elements are laid out contiguously within a chunk
+// and only one allocation is made per ChunkSize elements.
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+template<typename T, size_t ChunkSize = 256>
+class StableVector
+{
+	static_assert((ChunkSize & (ChunkSize - 1)) == 0, "ChunkSize must be a power of two");
+
+public:
+	using value_type = T;
+	using size_type = size_t;
+	using reference = T&;
+	using const_reference = const T&;
+
+	template<bool Const>
+	class Iterator
+	{
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = std::conditional_t<Const, const T*, T*>;
+		using reference = std::conditional_t<Const, const T&, T&>;
+		using container = std::conditional_t<Const, const StableVector, StableVector>;
+
+		Iterator() = default;
+		Iterator(container* owner, size_t index)
+			: m_owner(owner), m_index(index)
+		{
+		}
+
+		reference operator*() const { return (*m_owner)[m_index]; }
+		pointer operator->() const { return &(*m_owner)[m_index]; }
+
+		Iterator& operator++()
+		{
+			m_index++;
+			return *this;
+		}
+
+		Iterator operator++(int)
+		{
+			Iterator result = *this;
+			m_index++;
+			return result;
+		}
+
+		bool operator==(const Iterator& other) const { return m_index == other.m_index; }
+		bool operator!=(const Iterator& other) const { return m_index != other.m_index; }
+
+	private:
+		container* m_owner = nullptr;
+		size_t m_index = 0;
+	};
+
+	using iterator = Iterator<false>;
+	using const_iterator = Iterator<true>;
+
+	StableVector() = default;
+	StableVector(const StableVector&) = delete;
+	StableVector& operator=(const StableVector&) = delete;
+
+	StableVector(StableVector&& other) noexcept
+		: m_chunks(std::move(other.m_chunks)), m_size(std::exchange(other.m_size, 0))
+	{
+	}
+
+	StableVector& operator=(StableVector&& other) noexcept
+	{
+		clear();
+		m_chunks = std::move(other.m_chunks);
+		m_size = std::exchange(other.m_size, 0);
+		return *this;
+	}
+
+	~StableVector()
+	{
+		clear();
+	}
+
+	template<typename... Args>
+	T& emplace_back(Args&&... args)
+	{
+		if (m_size == m_chunks.size() * ChunkSize)
+		{
+			m_chunks.emplace_back(std::make_unique<Chunk>());
+		}
+
+		T* element = new(Slot(m_size)) T(std::forward<Args>(args)...);
+		m_size++;
+		return *element;
+	}
+
+	void push_back(T&& value) { emplace_back(std::move(value)); }
+	void push_back(const T& value) { emplace_back(value); }
+
+	void clear()
+	{
+		for (size_t i = 0; i < m_size; i++)
+		{
+			std::destroy_at(&(*this)[i]);
+		}
+		m_chunks.clear();
+		m_size = 0;
+	}
+
+	T& operator[](size_t index) { return *std::launder(reinterpret_cast<T*>(Slot(index))); }
+	const T& operator[](size_t index) const { return *std::launder(reinterpret_cast<const T*>(Slot(index))); }
+
+	T& front() { return (*this)[0]; }
+	const T& front() const { return (*this)[0]; }
+	T& back() { return (*this)[m_size - 1]; }
+	const T& back() const { return (*this)[m_size - 1]; }
+
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(this, m_size); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, m_size); }
+
+private:
+	struct Chunk
+	{
+		alignas(T) std::byte storage[sizeof(T) * ChunkSize];
+	};
+
+	std::byte* Slot(size_t index) const
+	{
+		return m_chunks[index / ChunkSize]->storage + sizeof(T) * (index % ChunkSize);
+	}
+
+	std::vector<std::unique_ptr<Chunk>> m_chunks;
+	size_t m_size = 0;
+};
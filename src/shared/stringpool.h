@@ -0,0 +1,105 @@
+#pragma once
+
+// A pool of interned, immutable strings. Every unique string is stored once,
+// NUL terminated, in large shared blocks, and handed out as a string_view
+// which stays valid for the lifetime of the pool.
+
+#include <algorithm>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+template<typename CharT>
+class BasicStringPool
+{
+public:
+	using view_type = std::basic_string_view<CharT>;
+
+	BasicStringPool() = default;
+	BasicStringPool(const BasicStringPool&) = delete;
+	BasicStringPool& operator=(const BasicStringPool&) = delete;
+	BasicStringPool(BasicStringPool&&) = default;
+	BasicStringPool& operator=(BasicStringPool&&) = default;
+
+	view_type Intern(view_type str)
+	{
+		if (str.empty())
+		{
+			return {};
+		}
+
+		// Keep the lookup table at most half full
+		if ((m_count + 1) * 2 > m_table.size())
+		{
+			Rehash(m_table.empty() ? 1024 : m_table.size() * 2);
+		}
+
+		const size_t mask = m_table.size() - 1;
+		size_t slot = std::hash<view_type>{}(str) & mask;
+		while (m_table[slot].data() != nullptr)
+		{
+			if (m_table[slot] == str)
+			{
+				return m_table[slot];
+			}
+			slot = (slot + 1) & mask;
+		}
+
+		const view_type result = Store(str);
+		m_table[slot] = result;
+		m_count++;
+		return result;
+	}
+
+	size_t size() const { return m_count; }
+
+private:
+	static constexpr size_t BLOCK_SIZE = 16 * 1024;
+
+	view_type Store(view_type str)
+	{
+		const size_t length = str.length() + 1;
+		if (m_blocks.empty() || m_blockUsed + length > m_blockSize)
+		{
+			m_blockSize = std::max(BLOCK_SIZE, length);
+			m_blocks.emplace_back(std::make_unique<CharT[]>(m_blockSize));
+			m_blockUsed = 0;
+		}
+
+		CharT* dest = m_blocks.back().get() + m_blockUsed;
+		str.copy(dest, str.length());
+		dest[str.length()] = CharT(0);
+		m_blockUsed += length;
+
+		return view_type(dest, str.length());
+	}
+
+	void Rehash(size_t newSize)
+	{
+		std::vector<view_type> newTable(newSize);
+		const size_t mask = newSize - 1;
+		for (const view_type& str : m_table)
+		{
+			if (str.data() != nullptr)
+			{
+				size_t slot = std::hash<view_type>{}(str) & mask;
+				while (newTable[slot].data() != nullptr)
+				{
+					slot = (slot + 1) & mask;
+				}
+				newTable[slot] = str;
+			}
+		}
+		m_table = std::move(newTable);
+	}
+
+	std::vector<std::unique_ptr<CharT[]>> m_blocks;
+	size_t m_blockSize = 0;
+	size_t m_blockUsed = 0;
+
+	// Open addressing table of the interned strings, empty slots have a null data pointer
+	std::vector<view_type> m_table;
+	size_t m_count = 0;
+};
+
+using StringPool = BasicStringPool<char>;
@@ -0,0 +1,510 @@
+#include "xmlstream.h"
+#include "platform.h"
+#include <algorithm>
+#include <cstdlib>
+
+static constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+
+static bool IsWhitespace(int ch)
+{
+	return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+// Parses integers the same way tinyxml2 does, including hexadecimal values with a 0x prefix
+template<typename T>
+static bool ParseInteger(const char* str, T& value)
+{
+	while (IsWhitespace(*str))
+	{
+		str++;
+	}
+
+	const bool isHex = str[0] == '0' && (str[1] == 'x' || str[1] == 'X');
+	char* end = nullptr;
+	if constexpr (std::is_unsigned_v<T>)
+	{
+		const unsigned long result = strtoul(str, &end, isHex ? 16 : 10);
+		if (end == str)
+		{
+			return false;
+		}
+		value = static_cast<T>(result);
+	}
+	else
+	{
+		const long result = strtol(str, &end, isHex ? 16 : 10);
+		if (end == str)
+		{
+			return false;
+		}
+		value = static_cast<T>(result);
+	}
+	return true;
+}
+
+void xml::AppendUTF8(std::string& str, unsigned long codepoint)
+{
+	if (codepoint < 0x80)
+	{
+		str += static_cast<char>(codepoint);
+	}
+	else if (codepoint < 0x800)
+	{
+		str += static_cast<char>(0xC0 | (codepoint >> 6));
+		str += static_cast<char>(0x80 | (codepoint & 0x3F));
+	}
+	else if (codepoint < 0x10000)
+	{
+		str += static_cast<char>(0xE0 | (codepoint >> 12));
+		str += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+		str += static_cast<char>(0x80 | (codepoint & 0x3F));
+	}
+	else
+	{
+		str += static_cast<char>(0xF0 | (codepoint >> 18));
+		str += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+		str += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+		str += static_cast<char>(0x80 | (codepoint & 0x3F));
+	}
+}
+
+const std::string* xml::StreamElement::FindAttribute(const char* name) const
+{
+	for (size_t i = 0; i < m_attributeCount; i++)
+	{
+		if (m_attributes[i].first == name)
+		{
+			return &m_attributes[i].second;
+		}
+	}
+	return nullptr;
+}
+
+const char* xml::StreamElement::Attribute(const char* name, const char* value) const
+{
+	const std::string* attrib = FindAttribute(name);
+	if (attrib == nullptr || (value != nullptr && *attrib != value))
+	{
+		return nullptr;
+	}
+	return attrib->c_str();
+}
+
+int xml::StreamElement::IntAttribute(const char* name, int defaultValue) const
+{
+	const std::string* attrib = FindAttribute(name);
+	int value = defaultValue;
+	if (attrib != nullptr)
+	{
+		ParseInteger(attrib->c_str(), value);
+	}
+	return value;
+}
+
+unsigned xml::StreamElement::UnsignedAttribute(const char* name, unsigned defaultValue) const
+{
+	const std::string* attrib = FindAttribute(name);
+	unsigned value = defaultValue;
+	if (attrib != nullptr)
+	{
+		ParseInteger(attrib->c_str(), value);
+	}
+	return value;
+}
+
+bool xml::StreamElement::BoolAttribute(const char* name, bool defaultValue) const
+{
+	const std::string* attrib = FindAttribute(name);
+	if (attrib == nullptr)
+	{
+		return defaultValue;
+	}
+
+	int intValue;
+	if (ParseInteger(attrib->c_str(), intValue))
+	{
+		return intValue != 0;
+	}
+	if (CompareICase(*attrib, "true"))
+	{
+		return true;
+	}
+	if (CompareICase(*attrib, "false"))
+	{
+		return false;
+	}
+	return defaultValue;
+}
+
+void xml::StreamElement::SetAttribute(const char* name, const char* value)
+{
+	for (size_t i = 0; i < m_attributeCount; i++)
+	{
+		if (m_attributes[i].first == name)
+		{
+			m_attributes[i].second = value;
+			return;
+		}
+	}
+	AddAttribute(name) = value;
+}
+
+void xml::StreamElement::DeleteAttribute(const char* name)
+{
+	for (size_t i = 0; i < m_attributeCount; i++)
+	{
+		if (m_attributes[i].first == name)
+		{
+			// Keep the order of the remaining attributes
+			for (size_t j = i + 1; j < m_attributeCount; j++)
+			{
+				std::swap(m_attributes[j - 1], m_attributes[j]);
+			}
+			m_attributeCount--;
+			return;
+		}
+	}
+}
+
+void xml::StreamElement::Reset(std::string_view name, int line)
+{
+	m_name = name;
+	m_line = line;
+	m_attributeCount = 0;
+}
+
+std::string& xml::StreamElement::AddAttribute(std::string_view name)
+{
+	if (m_attributeCount == m_attributes.size())
+	{
+		m_attributes.emplace_back();
+	}
+
+	auto& [attribName, attribValue] = m_attributes[m_attributeCount++];
+	attribName = name;
+	attribValue.clear();
+	return attribValue;
+}
+
+xml::XMLStreamReader::XMLStreamReader()
+	: m_buffer(std::make_unique<char[]>(READ_BUFFER_SIZE))
+{
+}
+
+bool xml::XMLStreamReader::Open(unique_file file)
+{
+	m_file = std::move(file);
+	if (!Seek(0, 1))
+	{
+		SetError("XML_ERROR_FILE_READ_ERROR", 1);
+		return false;
+	}
+
+	// Skip the UTF-8 byte order mark, if present
+	if (Peek() == 0xEF)
+	{
+		Get();
+		Get();
+		Get();
+	}
+	return true;
+}
+
+bool xml::XMLStreamReader::Seek(uint64_t offset, int line)
+{
+	if (m_file == nullptr || SeekFile(m_file.get(), offset, SEEK_SET) != 0)
+	{
+		return false;
+	}
+
+	m_bufferOffset = offset;
+	m_bufferPos = m_bufferLength = 0;
+	m_line = line;
+	m_pendingEnd = false;
+	m_depth = 0;
+	return true;
+}
+
+int xml::XMLStreamReader::Peek()
+{
+	if (m_bufferPos == m_bufferLength)
+	{
+		m_bufferOffset += m_bufferLength;
+		m_bufferPos = 0;
+		m_bufferLength = fread(m_buffer.get(), 1, READ_BUFFER_SIZE, m_file.get());
+		if (m_bufferLength == 0)
+		{
+			return EOF;
+		}
+	}
+	return static_cast<unsigned char>(m_buffer[m_bufferPos]);
+}
+
+int xml::XMLStreamReader::Get()
+{
+	const int ch = Peek();
+	if (ch != EOF)
+	{
+		m_bufferPos++;
+		if (ch == '\n')
+		{
+			m_line++;
+		}
+	}
+	return ch;
+}
+
+void xml::XMLStreamReader::SkipWhitespace()
+{
+	while (IsWhitespace(Peek()))
+	{
+		Get();
+	}
+}
+
+bool xml::XMLStreamReader::SkipPast(std::string_view terminator)
+{
+	// Compare against a window of the last characters read, so overlapping partial matches
+	// such as the "---" in "--->" are not lost. Terminators are at most three characters long.
+	char window[4] = {};
+	const size_t length = std::min(terminator.length(), sizeof(window));
+	for (size_t read = 0; ; read++)
+	{
+		const int ch = Get();
+		if (ch == EOF)
+		{
+			return false;
+		}
+
+		std::move(window + 1, window + length, window);
+		window[length - 1] = static_cast<char>(ch);
+		if (read + 1 >= length && terminator == std::string_view(window, length))
+		{
+			return true;
+		}
+	}
+}
+
+// Consumes the literal if the input continues with it, stopping at the first mismatching character
+bool xml::XMLStreamReader::SkipLiteral(std::string_view literal)
+{
+	for (const char ch : literal)
+	{
+		if (Peek() != static_cast<unsigned char>(ch))
+		{
+			return false;
+		}
+		Get();
+	}
+	return true;
+}
+
+bool xml::XMLStreamReader::ReadName(std::string& name)
+{
+	name.clear();
+	for (int ch = Peek(); ch != EOF && !IsWhitespace(ch) && ch != '/' && ch != '>' && ch != '='; ch = Peek())
+	{
+		name += static_cast<char>(Get());
+	}
+	return !name.empty();
+}
+
+bool xml::XMLStreamReader::ReadAttributeValue(std::string& value)
+{
+	const int quote = Get();
+	if (quote != '"' && quote != '\'')
+	{
+		return false;
+	}
+
+	for (int ch = Get(); ch != quote; ch = Get())
+	{
+		if (ch == EOF || ch == '<')
+		{
+			return false;
+		}
+
+		if (ch != '&')
+		{
+			value += static_cast<char>(ch);
+			continue;
+		}
+
+		// Decode an entity
+		std::string& entity = m_scratch;
+		entity.clear();
+		for (ch = Get(); ch != ';'; ch = Get())
+		{
+			if (ch == EOF || entity.length() > 10)
+			{
+				return false;
+			}
+			entity += static_cast<char>(ch);
+		}
+
+		if (entity == "amp") value += '&';
+		else if (entity == "lt") value += '<';
+		else if (entity == "gt") value += '>';
+		else if (entity == "quot") value += '"';
+		else if (entity == "apos") value += '\'';
+		else if (entity.length() > 1 && entity[0] == '#')
+		{
+			const bool isHex = entity[1] == 'x' || entity[1] == 'X';
+			char* end = nullptr;
+			const unsigned long codepoint = strtoul(entity.c_str() + (isHex ? 2 : 1), &end, isHex ? 16 : 10);
+			if (*end != '\0')
+			{
+				return false;
+			}
+			xml::AppendUTF8(value, codepoint);
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+xml::EventReader::Event xml::XMLStreamReader::Next()
+{
+	if (m_pendingEnd)
+	{
+		m_pendingEnd = false;
+		return Event::EndElement;
+	}
+
+	for (;;)
+	{
+		// Skip over text content
+		int ch;
+		while ((ch = Peek()) != '<')
+		{
+			if (ch == EOF)
+			{
+				if (m_depth != 0)
+				{
+					return SetError("XML_ERROR_PARSING", m_line);
+				}
+				return Event::EndOfDocument;
+			}
+			Get();
+		}
+
+		m_elementOffset = GetOffset();
+		const int line = m_line;
+		Get();
+
+		ch = Peek();
+		if (ch == '?')
+		{
+			if (!SkipPast("?>"))
+			{
+				return SetError("XML_ERROR_PARSING_DECLARATION", line);
+			}
+			continue;
+		}
+
+		if (ch == '!')
+		{
+			Get();
+			// Anything other than a comment or CDATA section is a DTD or unknown node ending at '>'
+			bool result;
+			if (SkipLiteral("--"))
+			{
+				result = SkipPast("-->");
+			}
+			else if (SkipLiteral("[CDATA["))
+			{
+				result = SkipPast("]]>");
+			}
+			else
+			{
+				result = SkipPast(">");
+			}
+
+			if (!result)
+			{
+				return SetError("XML_ERROR_PARSING_UNKNOWN", line);
+			}
+			continue;
+		}
+
+		if (ch == '/')
+		{
+			Get();
+			std::string& name = m_scratch;
+			if (!ReadName(name))
+			{
+				return SetError("XML_ERROR_PARSING_ELEMENT", line);
+			}
+			SkipWhitespace();
+			if (Get() != '>')
+			{
+				return SetError("XML_ERROR_PARSING_ELEMENT", line);
+			}
+
+			if (m_depth == 0 || m_openElements[m_depth - 1] != name)
+			{
+				return SetError("XML_ERROR_MISMATCHED_ELEMENT", line);
+			}
+			m_depth--;
+
+			m_current.Reset(name, line);
+			return Event::EndElement;
+		}
+
+		// Start of an element
+		std::string& name = m_scratch;
+		if (!ReadName(name))
+		{
+			return SetError("XML_ERROR_PARSING_ELEMENT", line);
+		}
+		m_current.Reset(name, line);
+
+		for (;;)
+		{
+			SkipWhitespace();
+			ch = Peek();
+			if (ch == '/')
+			{
+				Get();
+				if (Get() != '>')
+				{
+					return SetError("XML_ERROR_PARSING_ELEMENT", line);
+				}
+				m_pendingEnd = true;
+				return Event::StartElement;
+			}
+
+			if (ch == '>')
+			{
+				Get();
+				if (m_depth == m_openElements.size())
+				{
+					m_openElements.emplace_back();
+				}
+				m_openElements[m_depth++] = m_current.Name();
+				return Event::StartElement;
+			}
+
+			std::string& attribName = m_scratch;
+			if (!ReadName(attribName))
+			{
+				return SetError("XML_ERROR_PARSING_ATTRIBUTE", m_line);
+			}
+			std::string& value = m_current.AddAttribute(attribName);
+
+			SkipWhitespace();
+			if (Get() != '=')
+			{
+				return SetError("XML_ERROR_PARSING_ATTRIBUTE", m_line);
+			}
+			SkipWhitespace();
+			if (!ReadAttributeValue(value))
+			{
+				return SetError("XML_ERROR_PARSING_ATTRIBUTE", m_line);
+			}
+		}
+	}
+}
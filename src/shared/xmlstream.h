@@ -0,0 +1,139 @@
+#pragma once
+
+#include "common.h"
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Streaming (pull style) readers for project files, for projects too large
+// to comfortably hold as a tinyxml2 DOM
+namespace xml
+{
+
+// A single element produced by an EventReader. Mirrors the subset of tinyxml2::XMLElement
+// used by the project parsers, so parsing code can be shared between both modes.
+class StreamElement
+{
+public:
+	const char* Name() const { return m_name.c_str(); }
+	int GetLineNum() const { return m_line; }
+
+	const char* Attribute(const char* name, const char* value = nullptr) const;
+	int IntAttribute(const char* name, int defaultValue = 0) const;
+	unsigned UnsignedAttribute(const char* name, unsigned defaultValue = 0) const;
+	bool BoolAttribute(const char* name, bool defaultValue = false) const;
+
+	void SetAttribute(const char* name, const char* value);
+	void DeleteAttribute(const char* name);
+
+	size_t GetAttributeCount() const { return m_attributeCount; }
+	const std::string& GetAttributeName(size_t index) const { return m_attributes[index].first; }
+	const std::string& GetAttributeValue(size_t index) const { return m_attributes[index].second; }
+
+	// Used by readers to fill in the element, reusing previously allocated strings
+	void Reset(std::string_view name, int line);
+	void SetName(std::string_view name) { m_name = name; }
+	std::string& AddAttribute(std::string_view name);
+
+private:
+	const std::string* FindAttribute(const char* name) const;
+
+	std::string m_name;
+	int m_line = 0;
+	std::vector<std::pair<std::string, std::string>> m_attributes;
+	size_t m_attributeCount = 0;
+};
+
+// Appends a Unicode code point to a UTF-8 string
+void AppendUTF8(std::string& str, unsigned long codepoint);
+
+class EventReader
+{
+public:
+	enum class Event
+	{
+		StartElement,
+		EndElement,
+		EndOfDocument,
+		Error,
+	};
+
+	virtual ~EventReader() = default;
+
+	/** Reads the next element event. Self-closing elements produce both a start and an end event.
+	 */
+	virtual Event Next() = 0;
+
+	/** Repositions the reader at an offset previously returned by GetElementOffset(), so the element
+	 *	can be read again. Elements read afterwards are treated as if they were at the top level.
+	 *
+	 *	offset	- Offset of the element.
+	 *	line	- Line number of the element, so reported line numbers stay correct.
+	 */
+	virtual bool Seek(uint64_t offset, int line) = 0;
+
+	// Element of the last event. End events leave it with the name and line number of the end tag
+	// and no attributes, except at the end of a self-closing element, which leaves it unchanged.
+	const StreamElement& Current() const { return m_current; }
+	StreamElement& Current() { return m_current; }
+
+	uint64_t GetElementOffset() const { return m_elementOffset; }
+
+	const char* GetErrorName() const { return m_errorName; }
+	int GetErrorLineNum() const { return m_errorLine; }
+
+protected:
+	Event SetError(const char* name, int line)
+	{
+		m_errorName = name;
+		m_errorLine = line;
+		return Event::Error;
+	}
+
+	StreamElement m_current;
+	uint64_t m_elementOffset = 0;
+
+private:
+	const char* m_errorName = "";
+	int m_errorLine = 0;
+};
+
+// Reads elements and their attributes from an XML file, ignoring text content,
+// comments, processing instructions and DTDs.
+class XMLStreamReader final : public EventReader
+{
+public:
+	XMLStreamReader();
+
+	// Takes ownership of the file, reading starts at its beginning
+	bool Open(unique_file file);
+
+	Event Next() override;
+	bool Seek(uint64_t offset, int line) override;
+
+private:
+	int Peek();
+	int Get();
+	void SkipWhitespace();
+	bool SkipPast(std::string_view terminator);
+	bool SkipLiteral(std::string_view literal);
+	bool ReadName(std::string& name);
+	bool ReadAttributeValue(std::string& value);
+
+	uint64_t GetOffset() const { return m_bufferOffset + m_bufferPos; }
+
+	unique_file m_file;
+	std::unique_ptr<char[]> m_buffer;
+	size_t m_bufferPos = 0;
+	size_t m_bufferLength = 0;
+	uint64_t m_bufferOffset = 0;
+	int m_line = 1;
+
+	bool m_pendingEnd = false;
+	std::vector<std::string> m_openElements;
+	size_t m_depth = 0;
+	std::string m_scratch;
+};
+
+}